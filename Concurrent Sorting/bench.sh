@@ -0,0 +1,79 @@
+#!/usr/bin/env bash
+#
+# Usage: bench.sh <count> "<threads...>" "<dists...>" <repeats> <outdir>
+#
+# Runs msort once per distribution and tmsort at every thread count,
+# <repeats> times each, on inputs made by ./numbers. Writes:
+#   <outdir>/runs.csv    - every run (read/sort/print seconds)
+#   <outdir>/summary.csv - medians, speedup and efficiency vs msort
+#   <outdir>/summary.md  - the same as a markdown table
+
+count=$1
+threads=$2
+dists=$3
+repeats=$4
+out=$5
+
+mkdir -p $out
+runs=$out/runs.csv
+echo "program,dist,threads,run,read,sort,print" > $runs
+
+# Pull the "<what> ... in X seconds" timings out of the programs' log
+timings() {
+  awk '/read in/ { r = $4 } /Sorting completed/ { s = $4 } /printed in/ { p = $4 }
+       END { printf "%s,%s,%s", r, s, p }' $1
+}
+
+for dist in $dists; do
+  input=$out/input-$dist.txt
+  ./numbers 1 $count $dist > $input
+
+  for run in $(seq 1 $repeats); do
+    ./msort $count < $input > /dev/null 2> $out/log.txt
+    echo "msort,$dist,1,$run,$(timings $out/log.txt)" >> $runs
+
+    for t in $threads; do
+      MSORT_THREADS=$t ./tmsort $count < $input > /dev/null 2> $out/log.txt
+      echo "tmsort,$dist,$t,$run,$(timings $out/log.txt)" >> $runs
+    done
+  done
+  rm -f $input $out/log.txt
+done
+
+# Medians per (program, dist, threads); speedup is msort's sort time over
+# this row's, efficiency is speedup per thread
+sort -t, -k1,1 -k2,2 -k3,3n $runs | awk -F, -v csv=$out/summary.csv -v md=$out/summary.md '
+  function median(list,   n, v, i, j, tmp) {
+    n = split(list, v, " ")
+    for (i = 2; i <= n; i++)
+      for (j = i; j > 1 && v[j - 1] + 0 > v[j] + 0; j--) {
+        tmp = v[j]; v[j] = v[j - 1]; v[j - 1] = tmp
+      }
+    return n % 2 ? v[(n + 1) / 2] : (v[n / 2] + v[n / 2 + 1]) / 2
+  }
+  $1 != "program" {
+    key = $1 "," $2 "," $3
+    if (!(key in reads)) keys[++nkeys] = key
+    reads[key] = reads[key] " " $5
+    sorts[key] = sorts[key] " " $6
+    prints[key] = prints[key] " " $7
+  }
+  END {
+    for (i = 1; i <= nkeys; i++) {
+      split(keys[i], k, ",")
+      if (k[1] == "msort") base[k[2]] = median(sorts[keys[i]])
+    }
+    print "program,dist,threads,read,sort,print,speedup,efficiency" > csv
+    print "| program | dist | threads | read (s) | sort (s) | print (s) | speedup | efficiency |" > md
+    print "|---------|------|--------:|---------:|---------:|----------:|--------:|-----------:|" > md
+    for (i = 1; i <= nkeys; i++) {
+      split(keys[i], k, ",")
+      r = median(reads[keys[i]]); s = median(sorts[keys[i]]); p = median(prints[keys[i]])
+      speedup = s > 0 ? base[k[2]] / s : 0
+      eff = speedup / k[3]
+      printf "%s,%s,%d,%.6f,%.6f,%.6f,%.2f,%.2f\n", k[1], k[2], k[3], r, s, p, speedup, eff > csv
+      printf "| %s | %s | %d | %.6f | %.6f | %.6f | %.2f | %.2f |\n", k[1], k[2], k[3], r, s, p, speedup, eff > md
+    }
+  }'
+
+cat $out/summary.md
@@ -6,7 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
+#include <time.h>
 
 #include <unistd.h>
 
@@ -23,13 +23,16 @@
 /** The number of threads to be used for sorting. Default: 1 */
 int thread_count = 1;
 
+/** Sort in place with an N/2 buffer instead of a full copy. Default: 0 */
+int lowmem_mode = 0;
+
 /**
- * Compute the delta between the given timevals in seconds.
+ * Compute the delta between the given timespecs in seconds.
  */
-double time_in_secs(const struct timeval *begin, const struct timeval *end) {
+double time_in_secs(const struct timespec *begin, const struct timespec *end) {
   long s = end->tv_sec - begin->tv_sec;
-  long ms = end->tv_usec - begin->tv_usec;
-  return s + ms * 1e-6;
+  long ns = end->tv_nsec - begin->tv_nsec;
+  return s + ns * 1e-9;
 }
 
 /**
@@ -86,14 +89,72 @@ void merge_sort_aux(long nums[], int from, int to, long target[]) {
 }
 
 
+/**
+ * Merge nums[from, mid) and nums[mid, to) in place.
+ *
+ * The left slice is moved out to buf first, so buf needs room for mid - from
+ * elements.
+ */
+void merge_half(long nums[], int from, int mid, int to, long buf[]) {
+  int n = mid - from;
+  memmove(buf, &nums[from], n * sizeof(long));
+
+  int left = 0;
+  int right = mid;
+
+  int i = from;
+  for (; left < n && right < to; i++) {
+    if (buf[left] <= nums[right]) {
+      nums[i] = buf[left];
+      left++;
+    }
+    else {
+      nums[i] = nums[right];
+      right++;
+    }
+  }
+  if (left < n) {
+    memmove(&nums[i], &buf[left], (n - left) * sizeof(long));
+  }
+}
+
+
+/**
+ * Sort the given slice of nums in place.
+ *
+ * buf needs room for (to - from) / 2 elements.
+ */
+void merge_sort_half_aux(long nums[], int from, int to, long buf[]) {
+  if (to - from <= 1) {
+    return;
+  }
+
+  int mid = (from + to) / 2;
+  merge_sort_half_aux(nums, from, mid, buf);
+  merge_sort_half_aux(nums, mid, to, buf);
+  merge_half(nums, from, mid, to, buf);
+}
+
+
 /**
  * Sort the given array and return the sorted version.
  *
  * The result is malloc'd so it is the caller's responsibility to free it.
+ * In lowmem mode the source array is sorted in place and returned instead.
  *
  * Warning: The source array gets overwritten.
  */
 long *merge_sort(long nums[], int count) {
+  if (lowmem_mode) {
+    long *buf = malloc((count / 2 + 1) * sizeof(long));
+    assert(buf != NULL);
+
+    merge_sort_half_aux(nums, 0, count, buf);
+
+    free(buf);
+    return nums;
+  }
+
   long *result = calloc(count, sizeof(long));
   assert(result != NULL);
 
@@ -133,39 +194,45 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  struct timeval begin, end;
+  struct timespec begin, end;
 
   // get the number of threads from the environment variable SORT_THREADS
   if (getenv("MSORT_THREADS") != NULL)
     thread_count = atoi(getenv("MSORT_THREADS"));
 
+  // get the reduced-memory mode from the environment variable MSORT_LOWMEM
+  if (getenv("MSORT_LOWMEM") != NULL)
+    lowmem_mode = atoi(getenv("MSORT_LOWMEM")) != 0;
+
   log("Running with %d thread(s). Reading input.\n", thread_count);
 
   // Read the input
-  gettimeofday(&begin, 0);
+  clock_gettime(CLOCK_MONOTONIC, &begin);
   long *array = NULL;
   int count = allocate_load_array(argc, argv, &array);
-  gettimeofday(&end, 0);
+  clock_gettime(CLOCK_MONOTONIC, &end);
 
   log("Array read in %f seconds, beginning sort.\n", 
       time_in_secs(&begin, &end));
  
   // Sort the array
-  gettimeofday(&begin, 0);
+  clock_gettime(CLOCK_MONOTONIC, &begin);
   long *result = merge_sort(array, count);
-  gettimeofday(&end, 0);
+  clock_gettime(CLOCK_MONOTONIC, &end);
   
   log("Sorting completed in %f seconds.\n", time_in_secs(&begin, &end));
 
   // Print the result
-  gettimeofday(&begin, 0);
+  clock_gettime(CLOCK_MONOTONIC, &begin);
   print_long_array(result, count);
-  gettimeofday(&end, 0);
+  clock_gettime(CLOCK_MONOTONIC, &end);
   
   log("Array printed in %f seconds.\n", time_in_secs(&begin, &end));
 
+  if (result != array) {
+    free(result);
+  }
   free(array);
-  free(result);
 
   return 0;
 }
@@ -0,0 +1,53 @@
+/**
+ * Parallel merge sort library.
+ *
+ * Every entry point sorts the given array in place (stable) and returns 0, or
+ * returns -1 if the scratch memory could not be allocated, in which case the
+ * array is left untouched.
+ *
+ * Fixed-width keys and key+payload records have their own specialised entry
+ * points (generated from tmsort_impl.h, so merges compare with a plain `<=`);
+ * anything else can go through the comparator-based tmsort_cmp.
+ */
+#ifndef _TMSORT_H
+#define _TMSORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Sorting options. Passing NULL means { 1, 0, 0, 0 }. */
+typedef struct {
+  int threads;  /* Number of threads to sort with (<= 1: sequential) */
+  int numa;     /* Pin workers, first-touch scratch slices, split slices in
+                   whole L2-sized leaves */
+  int lowmem;   /* Sort in place with an N/2 buffer instead of an N copy */
+  int adaptive; /* Merge existing runs TimSort-style (implies lowmem) */
+} tmsort_opts_t;
+
+/** A record sorted by key; payload rides along. */
+typedef struct {
+  int64_t key;
+  uint64_t payload;
+} tmsort_kv_t;
+
+int tmsort_long(long *nums, size_t count, const tmsort_opts_t *opts);
+int tmsort_i32(int32_t *nums, size_t count, const tmsort_opts_t *opts);
+int tmsort_i64(int64_t *nums, size_t count, const tmsort_opts_t *opts);
+int tmsort_u64(uint64_t *nums, size_t count, const tmsort_opts_t *opts);
+/** NaNs end up in an unspecified position. */
+int tmsort_f64(double *nums, size_t count, const tmsort_opts_t *opts);
+/** Records with equal keys keep their relative order. */
+int tmsort_kv(tmsort_kv_t *recs, size_t count, const tmsort_opts_t *opts);
+
+/**
+ * Sort count elements of size bytes each, ordered by cmp (qsort-style).
+ *
+ * Elements comparing equal keep their relative order. The adaptive option
+ * only selects the in-place sort here; run detection is left to the
+ * specialised entry points.
+ */
+int tmsort_cmp(void *base, size_t count, size_t size,
+               int (*cmp)(const void *, const void *),
+               const tmsort_opts_t *opts);
+
+#endif /* ifndef _TMSORT_H */
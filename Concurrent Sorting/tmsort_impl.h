@@ -0,0 +1,477 @@
+/**
+ * Type-specialised parallel merge sort.
+ *
+ * Define these and include the file to generate tmsort_<TMSORT_NAME>:
+ *
+ *   TMSORT_NAME      suffix of the generated names
+ *   TMSORT_TYPE      element type
+ *   TMSORT_LE(a, b)  non-zero if a may be placed before b (a "<=" test keeps
+ *                    the sort stable)
+ *
+ * e.g.
+ *
+ *   #define TMSORT_NAME point
+ *   #define TMSORT_TYPE struct point
+ *   #define TMSORT_LE(a, b) ((a).x <= (b).x)
+ *   #include "tmsort_impl.h"
+ *
+ * The three macros are #undef'd at the end so the file can be included again
+ * for the next type.
+ */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmsort_internal.h"
+
+#define TMSORT_CAT_(a, b) a##b
+#define TMSORT_CAT(a, b) TMSORT_CAT_(a, b)
+#define TMSORT_FN(prefix) TMSORT_CAT(prefix, TMSORT_NAME)
+
+#ifndef TMSORT_MIN_GALLOP
+#define TMSORT_MIN_GALLOP 7 // wins in a row before a merge starts galloping
+#define TMSORT_MAX_RUNS 128 // run stack depth (TimSort needs < 90 for 2^64)
+#endif
+
+// State shared by every thread of one sort
+typedef struct {
+  const tmsort_opts_t *opts;
+  TMSORT_TYPE *input;  // caller's array (source for first touch)
+} TMSORT_FN(tmsort_job_);
+
+typedef struct {
+  TMSORT_TYPE *nums;
+  TMSORT_TYPE *target;
+  size_t from;
+  size_t to;
+  int threads;
+  int worker;  // index of the first worker owning this slice
+  TMSORT_FN(tmsort_job_) *job;
+} TMSORT_FN(tmsort_ctx_);
+
+// Merges 2 sorted halves of nums into target
+static void TMSORT_FN(tmsort_merge_)(TMSORT_TYPE nums[], size_t from, size_t mid,
+                                     size_t to, TMSORT_TYPE target[]) {
+  size_t left = from, right = mid, i = from;
+  for (; left < mid && right < to; i++) {
+    if (TMSORT_LE(nums[left], nums[right])) {
+      target[i] = nums[left++];
+    } else {
+      target[i] = nums[right++];
+    }
+  }
+  // Copy remaining from L || R sub-array
+  if (left < mid) {
+    memmove(&target[i], &nums[left], (mid - left) * sizeof(TMSORT_TYPE));
+  } else if (right < to) {
+    memmove(&target[i], &nums[right], (to - right) * sizeof(TMSORT_TYPE));
+  }
+}
+
+// Sequential merge sort of nums[from, to) into target
+static void TMSORT_FN(tmsort_seq_)(TMSORT_TYPE nums[], size_t from, size_t to,
+                                   TMSORT_TYPE target[]) {
+  if (to - from <= 1) return;
+
+  size_t mid = from + (to - from) / 2;
+  TMSORT_FN(tmsort_seq_)(target, from, mid, nums);
+  TMSORT_FN(tmsort_seq_)(target, mid, to, nums);
+  TMSORT_FN(tmsort_merge_)(nums, from, mid, to, target);
+}
+
+// Merges nums[from, mid) & nums[mid, to) in place; the left half is moved
+// out to buf first, so buf needs room for mid - from elements
+static void TMSORT_FN(tmsort_merge_half_)(TMSORT_TYPE nums[], size_t from, size_t mid,
+                                          size_t to, TMSORT_TYPE buf[]) {
+  size_t n = mid - from;
+  memmove(buf, &nums[from], n * sizeof(TMSORT_TYPE));
+
+  // Writes never overtake the right read index, so nums[mid, to) is safe
+  size_t left = 0, right = mid, i = from;
+  for (; left < n && right < to; i++) {
+    if (TMSORT_LE(buf[left], nums[right])) {
+      nums[i] = buf[left++];
+    } else {
+      nums[i] = nums[right++];
+    }
+  }
+  // Anything left in nums[right, to) is already in place
+  if (left < n) {
+    memmove(&nums[i], &buf[left], (n - left) * sizeof(TMSORT_TYPE));
+  }
+}
+
+// Sequential in-place merge sort of nums[from, to)
+// buf is shared by the whole array: [from, to) uses buf[from / 2, to / 2),
+// so disjoint slices never touch the same buffer elements
+static void TMSORT_FN(tmsort_half_seq_)(TMSORT_TYPE nums[], size_t from, size_t to,
+                                        TMSORT_TYPE buf[]) {
+  if (to - from <= 1) return;
+
+  size_t mid = from + (to - from) / 2;
+  TMSORT_FN(tmsort_half_seq_)(nums, from, mid, buf);
+  TMSORT_FN(tmsort_half_seq_)(nums, mid, to, buf);
+  TMSORT_FN(tmsort_merge_half_)(nums, from, mid, to, &buf[from / 2]);
+}
+
+//============================================================= natural =//
+// Run-adaptive (TimSort-style) merge sort, used for the adaptive option.
+// Like the half-buffer sort it works in place and a slice [from, to) only
+// touches buf[from / 2, to / 2): a merge moves the shorter of its two runs
+// out, which is never more than half the slice.
+
+// # of leading elements of a[0, n) that are <= key (strict: < key), found by
+// galloping from the start (or from the end) and then binary searching
+static size_t TMSORT_FN(tmsort_gallop_)(TMSORT_TYPE key, const TMSORT_TYPE *a, size_t n,
+                                        int strict, int from_end) {
+#define BEFORE(x) (strict ? !TMSORT_LE(key, (x)) : TMSORT_LE((x), key))
+  // Invariant: a[lo] is before key (or lo == -1), a[hi] isn't (or hi == n)
+  long lo = -1, hi = n;
+  if (n == 0) return 0;
+  if (!from_end) {
+    if (!BEFORE(a[0])) return 0;
+    long ofs = 1;
+    lo = 0;
+    while (ofs < (long)n && BEFORE(a[ofs])) {
+      lo = ofs;
+      ofs = ofs * 2 + 1;
+    }
+    hi = ofs < (long)n ? ofs : (long)n;
+  } else {
+    if (BEFORE(a[n - 1])) return n;
+    long ofs = 1;
+    hi = n - 1;
+    while (ofs < (long)n && !BEFORE(a[n - 1 - ofs])) {
+      hi = n - 1 - ofs;
+      ofs = ofs * 2 + 1;
+    }
+    lo = ofs < (long)n ? (long)n - 1 - ofs : -1;
+  }
+  while (lo + 1 < hi) {
+    long m = lo + (hi - lo) / 2;
+    if (BEFORE(a[m])) {
+      lo = m;
+    } else {
+      hi = m;
+    }
+  }
+  return hi;
+#undef BEFORE
+}
+
+// Merges runs a[lo, mid) & a[mid, hi) with len1 <= len2: run 1 goes to buf
+// and the merge runs front to back, galloping once one side keeps winning
+static void TMSORT_FN(tmsort_merge_lo_)(TMSORT_TYPE a[], size_t lo, size_t mid, size_t hi,
+                                        TMSORT_TYPE buf[]) {
+  size_t len1 = mid - lo;
+  memmove(buf, &a[lo], len1 * sizeof(TMSORT_TYPE));
+
+  size_t i = 0, j = mid, d = lo;
+  while (i < len1 && j < hi) {
+    // One element at a time until one run wins TMSORT_MIN_GALLOP in a row
+    int wins1 = 0, wins2 = 0;
+    while (i < len1 && j < hi && wins1 < TMSORT_MIN_GALLOP && wins2 < TMSORT_MIN_GALLOP) {
+      if (TMSORT_LE(buf[i], a[j])) {
+        a[d++] = buf[i++];
+        wins1++;
+        wins2 = 0;
+      } else {
+        a[d++] = a[j++];
+        wins2++;
+        wins1 = 0;
+      }
+    }
+    // Then move whole stretches while they stay long
+    while (i < len1 && j < hi) {
+      size_t k = TMSORT_FN(tmsort_gallop_)(a[j], &buf[i], len1 - i, 0, 0);
+      memmove(&a[d], &buf[i], k * sizeof(TMSORT_TYPE));
+      d += k;
+      i += k;
+      if (i == len1) break;
+
+      size_t m = TMSORT_FN(tmsort_gallop_)(buf[i], &a[j], hi - j, 1, 0);
+      memmove(&a[d], &a[j], m * sizeof(TMSORT_TYPE));
+      d += m;
+      j += m;
+      if (k < TMSORT_MIN_GALLOP && m < TMSORT_MIN_GALLOP) break;
+    }
+  }
+  // Anything left in a[j, hi) is already in place
+  memmove(&a[d], &buf[i], (len1 - i) * sizeof(TMSORT_TYPE));
+}
+
+// Merges runs a[lo, mid) & a[mid, hi) with len2 < len1: run 2 goes to buf
+// and the merge runs back to front
+static void TMSORT_FN(tmsort_merge_hi_)(TMSORT_TYPE a[], size_t lo, size_t mid, size_t hi,
+                                        TMSORT_TYPE buf[]) {
+  size_t len2 = hi - mid;
+  memmove(buf, &a[mid], len2 * sizeof(TMSORT_TYPE));
+
+  // i, j and d are one past the next element to take/place
+  size_t i = mid, j = len2, d = hi;
+  while (i > lo && j > 0) {
+    int wins1 = 0, wins2 = 0;
+    while (i > lo && j > 0 && wins1 < TMSORT_MIN_GALLOP && wins2 < TMSORT_MIN_GALLOP) {
+      // On ties the run 2 element goes last, which keeps the sort stable
+      if (TMSORT_LE(a[i - 1], buf[j - 1])) {
+        a[--d] = buf[--j];
+        wins2++;
+        wins1 = 0;
+      } else {
+        a[--d] = a[--i];
+        wins1++;
+        wins2 = 0;
+      }
+    }
+    while (i > lo && j > 0) {
+      // Run 2 elements >= a[i - 1] all go after it
+      size_t k = j - TMSORT_FN(tmsort_gallop_)(a[i - 1], buf, j, 1, 1);
+      d -= k;
+      j -= k;
+      memmove(&a[d], &buf[j], k * sizeof(TMSORT_TYPE));
+      if (j == 0) break;
+
+      // Run 1 elements > buf[j - 1] all go after it
+      size_t m = (i - lo) - TMSORT_FN(tmsort_gallop_)(buf[j - 1], &a[lo], i - lo, 0, 1);
+      d -= m;
+      i -= m;
+      memmove(&a[d], &a[i], m * sizeof(TMSORT_TYPE));
+      if (k < TMSORT_MIN_GALLOP && m < TMSORT_MIN_GALLOP) break;
+    }
+  }
+  // Anything left in a[lo, i) is already in place
+  memmove(&a[lo], buf, j * sizeof(TMSORT_TYPE));
+}
+
+// Merges adjacent sorted runs a[lo, mid) & a[mid, hi) in place, using at most
+// min(mid - lo, hi - mid) elements of buf. Elements that are already in their
+// final place are trimmed off first, so runs in order cost O(log n).
+static void TMSORT_FN(tmsort_merge_runs_)(TMSORT_TYPE a[], size_t lo, size_t mid, size_t hi,
+                                          TMSORT_TYPE buf[]) {
+  // Run 1 elements <= a[mid] stay where they are
+  lo += TMSORT_FN(tmsort_gallop_)(a[mid], &a[lo], mid - lo, 0, 0);
+  if (lo == mid) return;
+  // So do run 2 elements >= a[mid - 1]
+  hi = mid + TMSORT_FN(tmsort_gallop_)(a[mid - 1], &a[mid], hi - mid, 1, 1);
+  if (hi == mid) return;
+
+  if (mid - lo <= hi - mid) {
+    TMSORT_FN(tmsort_merge_lo_)(a, lo, mid, hi, buf);
+  } else {
+    TMSORT_FN(tmsort_merge_hi_)(a, lo, mid, hi, buf);
+  }
+}
+
+// Length of the run starting at a[from]; a strictly descending run is
+// reversed in place (strictly, so equal elements keep their order)
+static size_t TMSORT_FN(tmsort_count_run_)(TMSORT_TYPE a[], size_t from, size_t to) {
+  size_t end = from + 1;
+  if (end == to) return 1;
+
+  if (!TMSORT_LE(a[from], a[end])) {
+    while (end < to && !TMSORT_LE(a[end - 1], a[end])) end++;
+    for (size_t l = from, r = end - 1; l < r; l++, r--) {
+      TMSORT_TYPE tmp = a[l];
+      a[l] = a[r];
+      a[r] = tmp;
+    }
+  } else {
+    while (end < to && TMSORT_LE(a[end - 1], a[end])) end++;
+  }
+  return end - from;
+}
+
+// Binary insertion sort of a[from, to) where a[from, start) is sorted
+static void TMSORT_FN(tmsort_insertion_)(TMSORT_TYPE a[], size_t from, size_t start,
+                                         size_t to) {
+  for (size_t i = start; i < to; i++) {
+    TMSORT_TYPE pivot = a[i];
+    // Insert after any equal elements to stay stable
+    size_t pos = from + TMSORT_FN(tmsort_gallop_)(pivot, &a[from], i - from, 0, 1);
+    memmove(&a[pos + 1], &a[pos], (i - pos) * sizeof(TMSORT_TYPE));
+    a[pos] = pivot;
+  }
+}
+
+// Sequential natural merge sort of a[from, to): find runs (extending short
+// ones to minrun with insertion sort) and merge them off a stack that keeps
+// TimSort's length invariants, so merges stay balanced
+static void TMSORT_FN(tmsort_natural_seq_)(TMSORT_TYPE a[], size_t from, size_t to,
+                                           TMSORT_TYPE buf[]) {
+  size_t n = to - from;
+  if (n <= 1) return;
+
+  size_t minrun = n, odd = 0;
+  while (minrun >= 64) {
+    odd |= minrun & 1;
+    minrun >>= 1;
+  }
+  minrun += odd;
+
+  size_t base[TMSORT_MAX_RUNS], len[TMSORT_MAX_RUNS];
+  int runs = 0;
+  for (size_t lo = from; lo < to; ) {
+    size_t run = TMSORT_FN(tmsort_count_run_)(a, lo, to);
+    if (run < minrun) {
+      size_t forced = to - lo < minrun ? to - lo : minrun;
+      TMSORT_FN(tmsort_insertion_)(a, lo, lo + run, lo + forced);
+      run = forced;
+    }
+    base[runs] = lo;
+    len[runs++] = run;
+    lo += run;
+
+    // Collapse until len[k - 2] > len[k - 1] + len[k] and len[k - 1] > len[k]
+    // hold down the stack (the final pass below merges everything left)
+    while (runs > 1) {
+      int k = runs - 2;
+      if ((k > 0 && len[k - 1] <= len[k] + len[k + 1]) ||
+          (k > 1 && len[k - 2] <= len[k - 1] + len[k])) {
+        if (len[k - 1] < len[k + 1]) k--;
+      } else if (len[k] > len[k + 1]) {
+        break;
+      }
+      TMSORT_FN(tmsort_merge_runs_)(a, base[k], base[k + 1], base[k + 1] + len[k + 1],
+                                    &buf[from / 2]);
+      len[k] += len[k + 1];
+      for (int r = k + 1; r < runs - 1; r++) {
+        base[r] = base[r + 1];
+        len[r] = len[r + 1];
+      }
+      runs--;
+    }
+  }
+  while (runs > 1) {
+    int k = runs - 2;
+    if (k > 0 && len[k - 1] < len[k + 1]) k--;
+    TMSORT_FN(tmsort_merge_runs_)(a, base[k], base[k + 1], base[k + 1] + len[k + 1],
+                                  &buf[from / 2]);
+    len[k] += len[k + 1];
+    for (int r = k + 1; r < runs - 1; r++) {
+      base[r] = base[r + 1];
+      len[r] = len[r + 1];
+    }
+    runs--;
+  }
+}
+
+static void *TMSORT_FN(tmsort_threaded_)(void *ref);
+
+// Parallel merge sort of nums[from, to) into target (recursive)
+static void TMSORT_FN(tmsort_aux_)(TMSORT_TYPE nums[], size_t from, size_t to,
+                                   TMSORT_TYPE target[], int threads, int worker,
+                                   TMSORT_FN(tmsort_job_) *job) {
+  const tmsort_opts_t *opts = job->opts;
+  size_t mid = tmsort_split(from, to, threads, sizeof(TMSORT_TYPE), opts);
+  if (threads <= 1 || mid <= from || mid >= to) {
+    if (opts->numa) {
+      // The scratch array is untouched so far, so this copy places the
+      // slice's pages on the node of the worker that sorts it
+      TMSORT_TYPE *copy = nums == job->input ? target : nums;
+      memmove(&copy[from], &job->input[from], (to - from) * sizeof(TMSORT_TYPE));
+    }
+    TMSORT_FN(tmsort_seq_)(nums, from, to, target);
+    return;
+  }
+
+  pthread_t thread;
+  int right_threads = (threads + 1) / 2;
+  TMSORT_FN(tmsort_ctx_) args = {target, nums, from, mid, threads / 2,
+                                 worker + right_threads, job};
+  int spawned = pthread_create(&thread, NULL, TMSORT_FN(tmsort_threaded_), &args) == 0;
+  TMSORT_FN(tmsort_aux_)(target, mid, to, nums, right_threads, worker, job);
+  if (spawned) {
+    pthread_join(thread, NULL);
+  } else {
+    TMSORT_FN(tmsort_threaded_)(&args);
+  }
+
+  TMSORT_FN(tmsort_merge_)(nums, from, mid, to, target);
+}
+
+// Parallel in-place merge sort of nums[from, to) with buf (recursive)
+static void TMSORT_FN(tmsort_half_aux_)(TMSORT_TYPE nums[], size_t from, size_t to,
+                                        TMSORT_TYPE buf[], int threads, int worker,
+                                        TMSORT_FN(tmsort_job_) *job) {
+  // tmsort_split never gives the left side more than half, so the
+  // buf[from / 2, to / 2) budget still holds
+  size_t mid = tmsort_split(from, to, threads, sizeof(TMSORT_TYPE), job->opts);
+  if (threads <= 1 || mid <= from || mid >= to) {
+    if (job->opts->adaptive) {
+      TMSORT_FN(tmsort_natural_seq_)(nums, from, to, buf);
+    } else {
+      TMSORT_FN(tmsort_half_seq_)(nums, from, to, buf);
+    }
+    return;
+  }
+
+  pthread_t thread;
+  int right_threads = (threads + 1) / 2;
+  TMSORT_FN(tmsort_ctx_) args = {nums, buf, from, mid, threads / 2,
+                                 worker + right_threads, job};
+  int spawned = pthread_create(&thread, NULL, TMSORT_FN(tmsort_threaded_), &args) == 0;
+  TMSORT_FN(tmsort_half_aux_)(nums, mid, to, buf, right_threads, worker, job);
+  if (spawned) {
+    pthread_join(thread, NULL);
+  } else {
+    TMSORT_FN(tmsort_threaded_)(&args);
+  }
+
+  if (job->opts->adaptive) {
+    TMSORT_FN(tmsort_merge_runs_)(nums, from, mid, to, &buf[from / 2]);
+  } else {
+    TMSORT_FN(tmsort_merge_half_)(nums, from, mid, to, &buf[from / 2]);
+  }
+}
+
+// Parallel merge sort thread (also run inline if a thread can't be spawned)
+static void *TMSORT_FN(tmsort_threaded_)(void *ref) {
+  TMSORT_FN(tmsort_ctx_) *ctx = ref;
+  if (ctx->job->opts->numa) tmsort_pin(ctx->worker);
+  if (ctx->job->opts->lowmem || ctx->job->opts->adaptive) {
+    TMSORT_FN(tmsort_half_aux_)(ctx->nums, ctx->from, ctx->to, ctx->target,
+                                ctx->threads, ctx->worker, ctx->job);
+  } else {
+    TMSORT_FN(tmsort_aux_)(ctx->nums, ctx->from, ctx->to, ctx->target,
+                           ctx->threads, ctx->worker, ctx->job);
+  }
+  return NULL;
+}
+
+int TMSORT_FN(tmsort_)(TMSORT_TYPE *nums, size_t count, const tmsort_opts_t *opts) {
+  tmsort_opts_t o = opts ? *opts : (tmsort_opts_t){1, 0, 0, 0};
+  TMSORT_FN(tmsort_job_) job = {&o, nums};
+  if (count < 2) return 0;
+
+  // The adaptive sort always works in place with an N/2 buffer
+  if (o.lowmem || o.adaptive) {
+    TMSORT_TYPE *buf = malloc((count / 2 + 1) * sizeof(TMSORT_TYPE));
+    if (buf == NULL) return -1;
+    if (o.numa) tmsort_pin_caller();
+    TMSORT_FN(tmsort_half_aux_)(nums, 0, count, buf, o.threads, 0, &job);
+    if (o.numa) tmsort_unpin_caller();
+    free(buf);
+    return 0;
+  }
+
+  TMSORT_TYPE *scratch = malloc(count * sizeof(TMSORT_TYPE));
+  if (scratch == NULL) return -1;
+  if (o.numa) {
+    // Leave scratch untouched, workers first-touch their own slices
+    tmsort_pin_caller();
+  } else {
+    memcpy(scratch, nums, count * sizeof(TMSORT_TYPE));
+  }
+  // The sorted result lands in the target argument, i.e. back in nums
+  TMSORT_FN(tmsort_aux_)(scratch, 0, count, nums, o.threads, 0, &job);
+  if (o.numa) tmsort_unpin_caller();
+  free(scratch);
+  return 0;
+}
+
+#undef TMSORT_FN
+#undef TMSORT_CAT
+#undef TMSORT_CAT_
+#undef TMSORT_NAME
+#undef TMSORT_TYPE
+#undef TMSORT_LE
@@ -0,0 +1,37 @@
+/**
+ * Parallel merge sort library internals: the topology used by the NUMA mode
+ * and the helpers shared by the tmsort_impl.h instantiations. Not part of
+ * the library's interface (see tmsort.h).
+ */
+#ifndef _TMSORT_INTERNAL_H
+#define _TMSORT_INTERNAL_H
+
+#include "tmsort.h"
+
+/** CPU & cache layout used by the NUMA mode (read from /sys). */
+typedef struct {
+  int cpus[1024];  /* Online cpus, grouped by NUMA node */
+  int cpu_count;
+  long l2_size;    /* Bytes */
+} tmsort_topology_t;
+
+/** The topology detected from /sys (detected on first use). */
+const tmsort_topology_t *tmsort_topology();
+
+/** Use an L2 of bytes instead of the detected one (for tests). */
+void tmsort_set_l2_size(long bytes);
+
+/** Index at which to split [from, to) between threads workers. */
+size_t tmsort_split(size_t from, size_t to, int threads, size_t elem_size,
+                    const tmsort_opts_t *opts);
+
+/** Pin the calling thread to the cpu assigned to worker. */
+void tmsort_pin(int worker);
+
+/** Pin the calling thread as worker 0, remembering its old affinity. */
+void tmsort_pin_caller();
+
+/** Restore the affinity saved by tmsort_pin_caller. */
+void tmsort_unpin_caller();
+
+#endif /* ifndef _TMSORT_INTERNAL_H */
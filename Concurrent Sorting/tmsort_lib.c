@@ -0,0 +1,351 @@
+/**
+ * Parallel merge sort library: topology helpers, the specialised entry points
+ * and the comparator-based fallback.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "tmsort_internal.h"
+
+#define MAX_NODES 64           // NUMA nodes probed under /sys
+#define DEFAULT_L2 (256 << 10) // L2 size if /sys doesn't tell us
+
+static tmsort_topology_t topo;
+static pthread_once_t topo_once = PTHREAD_ONCE_INIT;
+
+// Affinity of the calling thread before tmsort_pin_caller
+static __thread cpu_set_t caller_affinity;
+static __thread int caller_affinity_saved;
+
+// Parse a /sys cpulist ("0-3,8,10-11") into cpus, returns # appended
+static int read_cpulist(const char *path, int *cpus, int max) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) return 0;
+
+  int count = 0, lo, hi;
+  while (fscanf(f, "%d", &lo) == 1) {
+    hi = lo;
+    int c = fgetc(f);
+    if (c == '-') {
+      if (fscanf(f, "%d", &hi) != 1) break;
+      c = fgetc(f);
+    }
+    for (int cpu = lo; cpu <= hi && count < max; cpu++) {
+      cpus[count++] = cpu;
+    }
+    if (c != ',') break;
+  }
+  fclose(f);
+  return count;
+}
+
+// Size of the L2 cache seen by cpu (bytes), or DEFAULT_L2
+static long read_l2_size(int cpu) {
+  char path[128];
+  for (int idx = 0; ; idx++) {
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, idx);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return DEFAULT_L2;
+    int level = 0;
+    int ok = fscanf(f, "%d", &level);
+    fclose(f);
+    if (ok != 1 || level != 2) continue;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/size", cpu, idx);
+    f = fopen(path, "r");
+    if (f == NULL) return DEFAULT_L2;
+    long size = 0;
+    char unit = 0;
+    ok = fscanf(f, "%ld%c", &size, &unit);
+    fclose(f);
+    if (ok < 1 || size <= 0) return DEFAULT_L2;
+    if (unit == 'K') size <<= 10;
+    if (unit == 'M') size <<= 20;
+    return size;
+  }
+}
+
+// Fill topo from /sys: cpus ordered node by node, so neighbouring workers
+// (which own neighbouring slices) share a node
+static void detect_topology() {
+  char path[128];
+  int max = sizeof(topo.cpus) / sizeof(topo.cpus[0]);
+  topo.cpu_count = 0;
+  for (int node = 0; node < MAX_NODES; node++) {
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    topo.cpu_count += read_cpulist(path, topo.cpus + topo.cpu_count, max - topo.cpu_count);
+  }
+  if (topo.cpu_count == 0) {
+    // No NUMA info (or non-NUMA kernel), fall back to the online cpus
+    topo.cpu_count = read_cpulist("/sys/devices/system/cpu/online", topo.cpus, max);
+  }
+  if (topo.cpu_count == 0) {
+    topo.cpu_count = 1;
+    topo.cpus[0] = 0;
+  }
+
+  topo.l2_size = read_l2_size(topo.cpus[0]);
+}
+
+const tmsort_topology_t *tmsort_topology() {
+  pthread_once(&topo_once, detect_topology);
+  return &topo;
+}
+
+void tmsort_set_l2_size(long bytes) {
+  pthread_once(&topo_once, detect_topology);
+  topo.l2_size = bytes;
+}
+
+size_t tmsort_split(size_t from, size_t to, int threads, size_t elem_size,
+                    const tmsort_opts_t *opts) {
+  if (!opts->numa) return from + (to - from) / 2;
+  if (threads <= 1) return from;
+
+  // The left half gets threads / 2 workers, so give it that share of the
+  // elements, rounded down to a whole number of L2-sized leaves (a leaf is
+  // what fits in L2 together with its slice of the other array). Only the
+  // split points are rounded: a worker's sequential sort needs no leaf
+  // cutoff of its own, as its top-down recursion sorts each leaf-sized
+  // subrange in cache before merging it further.
+  size_t leaf = tmsort_topology()->l2_size / (2 * elem_size);
+  if (leaf < 1) leaf = 1;
+  size_t left = (to - from) / threads * (threads / 2);
+
+  // Under two leaves, rounding leaves the left half empty and the whole
+  // range to one worker: split by share alone instead
+  if (left >= leaf) left = left / leaf * leaf;
+  return from + left;
+}
+
+void tmsort_pin(int worker) {
+  const tmsort_topology_t *t = tmsort_topology();
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(t->cpus[worker % t->cpu_count], &set);
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+void tmsort_pin_caller() {
+  caller_affinity_saved =
+    pthread_getaffinity_np(pthread_self(), sizeof(caller_affinity), &caller_affinity) == 0;
+  tmsort_pin(0);
+}
+
+void tmsort_unpin_caller() {
+  if (caller_affinity_saved) {
+    pthread_setaffinity_np(pthread_self(), sizeof(caller_affinity), &caller_affinity);
+  }
+}
+
+//============================================================ specialised =//
+
+#define TMSORT_NAME long
+#define TMSORT_TYPE long
+#define TMSORT_LE(a, b) ((a) <= (b))
+#include "tmsort_impl.h"
+
+#define TMSORT_NAME i32
+#define TMSORT_TYPE int32_t
+#define TMSORT_LE(a, b) ((a) <= (b))
+#include "tmsort_impl.h"
+
+#define TMSORT_NAME i64
+#define TMSORT_TYPE int64_t
+#define TMSORT_LE(a, b) ((a) <= (b))
+#include "tmsort_impl.h"
+
+#define TMSORT_NAME u64
+#define TMSORT_TYPE uint64_t
+#define TMSORT_LE(a, b) ((a) <= (b))
+#include "tmsort_impl.h"
+
+#define TMSORT_NAME f64
+#define TMSORT_TYPE double
+#define TMSORT_LE(a, b) ((a) <= (b))
+#include "tmsort_impl.h"
+
+#define TMSORT_NAME kv
+#define TMSORT_TYPE tmsort_kv_t
+#define TMSORT_LE(a, b) ((a).key <= (b).key)
+#include "tmsort_impl.h"
+
+//============================================================ comparator =//
+// Same algorithm as tmsort_impl.h, on elements of a run-time size
+
+// State shared by every thread of one sort
+typedef struct {
+  const tmsort_opts_t *opts;
+  char *input;  // caller's array (source for first touch)
+  size_t size;  // element size in bytes
+  int (*cmp)(const void *, const void *);
+} cmp_job_t;
+
+typedef struct {
+  char *nums;
+  char *target;
+  size_t from;
+  size_t to;
+  int threads;
+  int worker;
+  cmp_job_t *job;
+} cmp_ctx_t;
+
+#define AT(base, i) ((base) + (i) * job->size)
+
+// Merges 2 sorted halves of nums into target
+static void cmp_merge(char *nums, size_t from, size_t mid, size_t to, char *target,
+                      cmp_job_t *job) {
+  size_t left = from, right = mid, i = from;
+  for (; left < mid && right < to; i++) {
+    if (job->cmp(AT(nums, left), AT(nums, right)) <= 0) {
+      memcpy(AT(target, i), AT(nums, left++), job->size);
+    } else {
+      memcpy(AT(target, i), AT(nums, right++), job->size);
+    }
+  }
+  if (left < mid) {
+    memmove(AT(target, i), AT(nums, left), (mid - left) * job->size);
+  } else if (right < to) {
+    memmove(AT(target, i), AT(nums, right), (to - right) * job->size);
+  }
+}
+
+// Sequential merge sort of nums[from, to) into target
+static void cmp_seq(char *nums, size_t from, size_t to, char *target, cmp_job_t *job) {
+  if (to - from <= 1) return;
+
+  size_t mid = from + (to - from) / 2;
+  cmp_seq(target, from, mid, nums, job);
+  cmp_seq(target, mid, to, nums, job);
+  cmp_merge(nums, from, mid, to, target, job);
+}
+
+// Merges nums[from, mid) & nums[mid, to) in place via buf
+static void cmp_merge_half(char *nums, size_t from, size_t mid, size_t to, char *buf,
+                           cmp_job_t *job) {
+  size_t n = mid - from;
+  memmove(buf, AT(nums, from), n * job->size);
+
+  size_t left = 0, right = mid, i = from;
+  for (; left < n && right < to; i++) {
+    if (job->cmp(AT(buf, left), AT(nums, right)) <= 0) {
+      memcpy(AT(nums, i), AT(buf, left++), job->size);
+    } else {
+      memcpy(AT(nums, i), AT(nums, right++), job->size);
+    }
+  }
+  if (left < n) {
+    memmove(AT(nums, i), AT(buf, left), (n - left) * job->size);
+  }
+}
+
+// Sequential in-place merge sort of nums[from, to), using buf[from / 2, to / 2)
+static void cmp_half_seq(char *nums, size_t from, size_t to, char *buf, cmp_job_t *job) {
+  if (to - from <= 1) return;
+
+  size_t mid = from + (to - from) / 2;
+  cmp_half_seq(nums, from, mid, buf, job);
+  cmp_half_seq(nums, mid, to, buf, job);
+  cmp_merge_half(nums, from, mid, to, AT(buf, from / 2), job);
+}
+
+static void *cmp_threaded(void *ref);
+
+// Parallel merge sort of nums[from, to) into target (recursive)
+static void cmp_aux(char *nums, size_t from, size_t to, char *target, int threads,
+                    int worker, cmp_job_t *job) {
+  size_t mid = tmsort_split(from, to, threads, job->size, job->opts);
+  if (threads <= 1 || mid <= from || mid >= to) {
+    if (job->opts->numa) {
+      char *copy = nums == job->input ? target : nums;
+      memmove(AT(copy, from), AT(job->input, from), (to - from) * job->size);
+    }
+    cmp_seq(nums, from, to, target, job);
+    return;
+  }
+
+  pthread_t thread;
+  int right_threads = (threads + 1) / 2;
+  cmp_ctx_t args = {target, nums, from, mid, threads / 2, worker + right_threads, job};
+  int spawned = pthread_create(&thread, NULL, cmp_threaded, &args) == 0;
+  cmp_aux(target, mid, to, nums, right_threads, worker, job);
+  if (spawned) {
+    pthread_join(thread, NULL);
+  } else {
+    cmp_threaded(&args);
+  }
+
+  cmp_merge(nums, from, mid, to, target, job);
+}
+
+// Parallel in-place merge sort of nums[from, to) with buf (recursive)
+static void cmp_half_aux(char *nums, size_t from, size_t to, char *buf, int threads,
+                         int worker, cmp_job_t *job) {
+  size_t mid = tmsort_split(from, to, threads, job->size, job->opts);
+  if (threads <= 1 || mid <= from || mid >= to) {
+    cmp_half_seq(nums, from, to, buf, job);
+    return;
+  }
+
+  pthread_t thread;
+  int right_threads = (threads + 1) / 2;
+  cmp_ctx_t args = {nums, buf, from, mid, threads / 2, worker + right_threads, job};
+  int spawned = pthread_create(&thread, NULL, cmp_threaded, &args) == 0;
+  cmp_half_aux(nums, mid, to, buf, right_threads, worker, job);
+  if (spawned) {
+    pthread_join(thread, NULL);
+  } else {
+    cmp_threaded(&args);
+  }
+
+  cmp_merge_half(nums, from, mid, to, AT(buf, from / 2), job);
+}
+
+// Parallel merge sort thread (also run inline if a thread can't be spawned)
+static void *cmp_threaded(void *ref) {
+  cmp_ctx_t *ctx = ref;
+  if (ctx->job->opts->numa) tmsort_pin(ctx->worker);
+  if (ctx->job->opts->lowmem || ctx->job->opts->adaptive) {
+    cmp_half_aux(ctx->nums, ctx->from, ctx->to, ctx->target, ctx->threads, ctx->worker, ctx->job);
+  } else {
+    cmp_aux(ctx->nums, ctx->from, ctx->to, ctx->target, ctx->threads, ctx->worker, ctx->job);
+  }
+  return NULL;
+}
+
+int tmsort_cmp(void *base, size_t count, size_t size,
+               int (*cmp)(const void *, const void *),
+               const tmsort_opts_t *opts) {
+  tmsort_opts_t o = opts ? *opts : (tmsort_opts_t){1, 0, 0, 0};
+  cmp_job_t job = {&o, base, size, cmp};
+  if (count < 2 || size == 0) return 0;
+
+  // No run detection here; adaptive just selects the in-place sort
+  if (o.lowmem || o.adaptive) {
+    char *buf = malloc((count / 2 + 1) * size);
+    if (buf == NULL) return -1;
+    if (o.numa) tmsort_pin_caller();
+    cmp_half_aux(base, 0, count, buf, o.threads, 0, &job);
+    if (o.numa) tmsort_unpin_caller();
+    free(buf);
+    return 0;
+  }
+
+  char *scratch = malloc(count * size);
+  if (scratch == NULL) return -1;
+  if (o.numa) {
+    tmsort_pin_caller();
+  } else {
+    memcpy(scratch, base, count * size);
+  }
+  cmp_aux(scratch, 0, count, base, o.threads, 0, &job);
+  if (o.numa) tmsort_unpin_caller();
+  free(scratch);
+  return 0;
+}
@@ -0,0 +1,216 @@
+/**
+ * Tests for libtmsort: every entry point, in every mode (threads, NUMA,
+ * lowmem, adaptive), on input shapes that exercise the run-adaptive path.
+ * Results are checked against qsort, and stability against the original
+ * positions of equal keys. The L2 size is set small, so that the NUMA mode
+ * splits these sizes in several leaves.
+ */
+#define _GNU_SOURCE
+#include <assert.h>
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tmsort.h"
+#include "tmsort_internal.h"
+
+#define COUNT 10007  // not a power of 2, so splits are uneven
+#define L2_SIZE 4096 // a leaf of 256 longs, so COUNT spans 39
+
+// Input shapes
+enum { UNIFORM, SORTED, REVERSE, FEW, RUNS, SHAPES };
+
+// Sizes around the small cases, then a big one
+static const size_t counts[] = {0, 1, 2, 3, 17, 100, COUNT};
+#define COUNTS (sizeof(counts) / sizeof(counts[0]))
+
+// Every combination of the options, with 1 & 4 threads
+#define OPTS 16
+static tmsort_opts_t opts_at(int i) {
+  return (tmsort_opts_t){i & 1 ? 4 : 1, (i >> 1) & 1, (i >> 2) & 1, (i >> 3) & 1};
+}
+
+// The i-th of count keys of the given shape (in [0, 1000000), FEW: [0, 8))
+static long key_at(int shape, size_t i, size_t count) {
+  switch (shape) {
+  case SORTED:
+    return i;
+  case REVERSE:
+    return count - i;
+  case FEW:
+    return rand() % 8;
+  case RUNS:
+    // Ascending & descending runs of up to 100, with duplicates
+    return (i / 100) % 2 ? (long)(100 - i % 100) / 2 : (long)(i % 100) / 2 + rand() % 3;
+  default:
+    return rand() % 1000000;
+  }
+}
+
+//============================================================ fixed keys =//
+
+static int cmp_long(const void *a, const void *b) {
+  long x = *(const long *)a, y = *(const long *)b;
+  return (x > y) - (x < y);
+}
+
+static int cmp_i32(const void *a, const void *b) {
+  int32_t x = *(const int32_t *)a, y = *(const int32_t *)b;
+  return (x > y) - (x < y);
+}
+
+static int cmp_i64(const void *a, const void *b) {
+  int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static int cmp_f64(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Sort a copy of nums with sort and one with qsort, and compare them
+#define CHECK_KEYS(TYPE, sort, cmp, nums, count, opts)                     \
+  do {                                                                      \
+    TYPE *got = malloc((count + 1) * sizeof(TYPE));                         \
+    TYPE *want = malloc((count + 1) * sizeof(TYPE));                        \
+    assert(got != NULL && want != NULL);                                    \
+    memcpy(got, nums, count * sizeof(TYPE));                                \
+    memcpy(want, nums, count * sizeof(TYPE));                               \
+    assert(sort(got, count, opts) == 0);                                    \
+    qsort(want, count, sizeof(TYPE), cmp);                                  \
+    assert(memcmp(got, want, count * sizeof(TYPE)) == 0);                   \
+    free(got);                                                              \
+    free(want);                                                             \
+  } while (0)
+
+static void test_keys(int shape, size_t count, const tmsort_opts_t *opts) {
+  long *l = malloc((count + 1) * sizeof(long));
+  int32_t *i32 = malloc((count + 1) * sizeof(int32_t));
+  int64_t *i64 = malloc((count + 1) * sizeof(int64_t));
+  uint64_t *u64 = malloc((count + 1) * sizeof(uint64_t));
+  double *f64 = malloc((count + 1) * sizeof(double));
+  assert(l && i32 && i64 && u64 && f64);
+
+  for (size_t i = 0; i < count; i++) {
+    long key = key_at(shape, i, count);
+    l[i] = key - 500000;
+    i32[i] = (int32_t)(key - 500000) * 2000;     // negatives, and the top bits
+    i64[i] = (key - 500000) * 10000000000000L;   // beyond 32 bits
+    u64[i] = key % 2 ? UINT64_MAX - key : key;   // beyond INT64_MAX
+    f64[i] = (key - 500000) / 7.0;               // fractions & negatives
+  }
+  if (count > 2) {
+    f64[0] = -INFINITY;
+    f64[count / 2] = INFINITY;
+    f64[count - 1] = -0.5;  // (no NaNs: their place is unspecified)
+  }
+
+  CHECK_KEYS(long, tmsort_long, cmp_long, l, count, opts);
+  CHECK_KEYS(int32_t, tmsort_i32, cmp_i32, i32, count, opts);
+  CHECK_KEYS(int64_t, tmsort_i64, cmp_i64, i64, count, opts);
+  CHECK_KEYS(uint64_t, tmsort_u64, cmp_u64, u64, count, opts);
+  CHECK_KEYS(double, tmsort_f64, cmp_f64, f64, count, opts);
+
+  free(l);
+  free(i32);
+  free(i64);
+  free(u64);
+  free(f64);
+}
+
+//============================================================ records =//
+
+// A record for tmsort_cmp whose size (12) isn't a multiple of 8
+typedef struct {
+  int key;
+  int index;
+  char pad[4];
+} rec_t;
+
+static int cmp_rec(const void *a, const void *b) {
+  int x = ((const rec_t *)a)->key, y = ((const rec_t *)b)->key;
+  return (x > y) - (x < y);
+}
+
+// Records come out ordered by key, equal keys in their original order
+// (payloads/indices are the original positions)
+static void test_stable(int shape, size_t count, const tmsort_opts_t *opts) {
+  tmsort_kv_t *kv = malloc((count + 1) * sizeof(tmsort_kv_t));
+  rec_t *recs = malloc((count + 1) * sizeof(rec_t));
+  assert(kv != NULL && recs != NULL);
+
+  for (size_t i = 0; i < count; i++) {
+    // Few distinct keys, so most of them have equals
+    long key = key_at(shape, i, count) % 50;
+    kv[i] = (tmsort_kv_t){key, i};
+    recs[i] = (rec_t){(int)key, (int)i, "abc"};
+  }
+
+  assert(tmsort_kv(kv, count, opts) == 0);
+  assert(tmsort_cmp(recs, count, sizeof(rec_t), cmp_rec, opts) == 0);
+
+  char *seen = calloc(count + 1, 1);
+  assert(seen != NULL);
+  for (size_t i = 0; i < count; i++) {
+    assert(kv[i].payload < count && !seen[kv[i].payload]);
+    seen[kv[i].payload] = 1;
+    assert(recs[i].key == kv[i].key && recs[i].index == (int)kv[i].payload);
+    assert(strcmp(recs[i].pad, "abc") == 0);
+    if (i > 0) {
+      assert(kv[i - 1].key <= kv[i].key);
+      assert(kv[i - 1].key < kv[i].key || kv[i - 1].payload < kv[i].payload);
+    }
+  }
+
+  free(seen);
+  free(kv);
+  free(recs);
+}
+
+int main(int argc, char **argv) {
+  srand(3650);
+
+  // The default options (NULL)
+  long nums[] = {3, -1, 2, -1, 0};
+  assert(tmsort_long(nums, 5, NULL) == 0);
+  assert(nums[0] == -1 && nums[1] == -1 && nums[2] == 0 && nums[3] == 2 && nums[4] == 3);
+
+  // NUMA splits: the left workers' share in whole leaves, or by share alone
+  // under two leaves
+  tmsort_set_l2_size(L2_SIZE);
+  tmsort_opts_t numa = {4, 1, 0, 0};
+  size_t leaf = L2_SIZE / (2 * sizeof(long));
+  assert(tmsort_split(0, COUNT, 4, sizeof(long), &numa) == COUNT / 4 * 2 / leaf * leaf);
+  assert(tmsort_split(7, 7 + COUNT, 3, sizeof(long), &numa) == 7 + COUNT / 3 / leaf * leaf);
+  assert(tmsort_split(0, 100, 4, sizeof(long), &numa) == 50);
+  assert(tmsort_split(0, 100, 1, sizeof(long), &numa) == 0);
+
+  cpu_set_t affinity, now;
+  assert(sched_getaffinity(0, sizeof(affinity), &affinity) == 0);
+
+  for (int o = 0; o < OPTS; o++) {
+    tmsort_opts_t opts = opts_at(o);
+    for (int shape = 0; shape < SHAPES; shape++) {
+      for (size_t c = 0; c < COUNTS; c++) {
+        test_keys(shape, counts[c], &opts);
+        test_stable(shape, counts[c], &opts);
+      }
+    }
+    printf("threads=%d numa=%d lowmem=%d adaptive=%d: ok\n", opts.threads, opts.numa,
+           opts.lowmem, opts.adaptive);
+  }
+
+  // The NUMA mode pinned the caller while sorting, and unpinned it after
+  assert(sched_getaffinity(0, sizeof(now), &now) == 0);
+  assert(CPU_EQUAL(&affinity, &now));
+  printf("%d modes x %d shapes x %zu sizes: ok\n", OPTS, SHAPES, COUNTS);
+  return 0;
+}
@@ -0,0 +1,91 @@
+/**
+ * Microbenchmark helpers for munit suites.
+ *
+ * A benchmark is an ordinary munit test that times its own loop and hands
+ * the result to bench_report, which logs it and appends one CSV line to the
+ * results file, so numbers from different runs (and commits) can be diffed:
+ *
+ *   benchmark,params,threads,ops,ns_per_op
+ *   /queue/enqueue+dequeue,capacity=1024,1,1000000,3.12
+ *
+ * Environment:
+ *   BENCH_OUT  results file (default bench-results.csv; "-" for stdout)
+ *   BENCH_OPS  operations per benchmark (default BENCH_DEFAULT_OPS)
+ *
+ * munit parameters of the test (capacity, mode, threads, ...) become the
+ * params column, and a "threads" parameter also fills the threads column.
+ *
+ * Needs clock_gettime: define _POSIX_C_SOURCE 200809L before any #include.
+ */
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <munit.h>
+
+#define BENCH_DEFAULT_OPS 1000000
+
+/** Seconds on a monotonic clock. */
+static inline double bench_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Operations each benchmark should run (BENCH_OPS). */
+static inline unsigned long bench_ops() {
+  const char *env = getenv("BENCH_OPS");
+  long ops = env ? atol(env) : 0;
+  return ops > 0 ? (unsigned long) ops : BENCH_DEFAULT_OPS;
+}
+
+/** An integer munit parameter (or fallback if it isn't set). */
+static inline long bench_param(const MunitParameter params[], const char *name,
+                               long fallback) {
+  const char *value = munit_parameters_get(params, name);
+  return value ? atol(value) : fallback;
+}
+
+/** Record that ops operations named name took secs seconds. */
+static inline void bench_report(const char *name,
+                                const MunitParameter params[],
+                                unsigned long ops, double secs) {
+  char param_str[256] = "";
+  size_t used = 0;
+  for (int i = 0; params != NULL && params[i].name != NULL; i++) {
+    used += snprintf(param_str + used, sizeof(param_str) - used, "%s%s=%s",
+                     i ? ";" : "", params[i].name, params[i].value);
+    if (used >= sizeof(param_str)) {
+      break;
+    }
+  }
+
+  double ns = secs * 1e9 / (ops ? ops : 1);
+  long threads = bench_param(params, "threads", 1);
+  munit_logf(MUNIT_LOG_INFO, "%s %s: %.2f ns/op", name, param_str, ns);
+
+  const char *path = getenv("BENCH_OUT");
+  if (path == NULL) {
+    path = "bench-results.csv";
+  }
+
+  FILE *out = strcmp(path, "-") == 0 ? stdout : fopen(path, "a");
+  if (out == NULL) {
+    munit_logf(MUNIT_LOG_WARNING, "can't open %s", path);
+    return;
+  }
+  if (out != stdout && fseek(out, 0, SEEK_END) == 0 && ftell(out) == 0) {
+    fprintf(out, "benchmark,params,threads,ops,ns_per_op\n");
+  }
+  fprintf(out, "%s,%s,%ld,%lu,%.3f\n", name, param_str, threads, ops, ns);
+  if (out != stdout) {
+    fclose(out);
+  } else {
+    fflush(out);
+  }
+}
+
+#endif /* ifndef _BENCH_H */
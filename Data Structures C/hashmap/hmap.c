@@ -0,0 +1,124 @@
+/*
+ * Hash map implementation.
+ *
+ * The probing logic lives in hmap_impl.h and is instantiated once per key
+ * type at the bottom of this file; the helpers here are shared by both.
+ *
+ * Each slot has a control byte: HMAP_EMPTY, HMAP_DELETED (both have the top
+ * bit set) or H2, the low 7 bits of the key's hash (top bit clear). The rest
+ * of the hash, H1, picks the group of HMAP_GROUP slots a probe starts at.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "hmap.h"
+
+#define HMAP_EMPTY ((int8_t) -128)
+#define HMAP_DELETED ((int8_t) -2)
+
+static inline uint64_t hmap_h1(uint64_t hash) {
+  return hash >> 7;
+}
+
+static inline int8_t hmap_h2(uint64_t hash) {
+  return hash & 0x7f;
+}
+
+#if defined(__SSE2__)
+
+/** Bit i is set if ctrl[i] == byte, for the HMAP_GROUP bytes at ctrl. */
+static inline uint32_t hmap_match(const int8_t *ctrl, int8_t byte) {
+  __m128i group = _mm_load_si128((const __m128i *) ctrl);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(byte)));
+}
+
+/** Bit i is set if ctrl[i] is empty or deleted (its top bit is set). */
+static inline uint32_t hmap_free_slots(const int8_t *ctrl) {
+  return _mm_movemask_epi8(_mm_load_si128((const __m128i *) ctrl));
+}
+
+#else
+
+static inline uint32_t hmap_match(const int8_t *ctrl, int8_t byte) {
+  uint32_t bits = 0;
+  for (int i = 0; i < HMAP_GROUP; i++) {
+    bits |= (uint32_t) (ctrl[i] == byte) << i;
+  }
+  return bits;
+}
+
+static inline uint32_t hmap_free_slots(const int8_t *ctrl) {
+  uint32_t bits = 0;
+  for (int i = 0; i < HMAP_GROUP; i++) {
+    bits |= (uint32_t) (ctrl[i] < 0) << i;
+  }
+  return bits;
+}
+
+#endif
+
+/** Smallest table (a power of two) holding capacity entries under max load. */
+static size_t hmap_capacity_for(unsigned int capacity) {
+  size_t slots = HMAP_GROUP;
+  while ((size_t) capacity * HMAP_MAX_LOAD_DEN > slots * HMAP_MAX_LOAD_NUM) {
+    slots *= 2;
+  }
+  return slots;
+}
+
+/** Finish a hash so that both H1 and H2 depend on every input bit. */
+static inline uint64_t hmap_mix(uint64_t x) {
+  // splitmix64's finaliser
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+/** FNV-1a over the string, then mixed. */
+static inline uint64_t hmap_hash_str(const char *key) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const unsigned char *p = (const unsigned char *) key; *p; p++) {
+    hash = (hash ^ *p) * 0x100000001b3ULL;
+  }
+  return hmap_mix(hash);
+}
+
+/** Copy key into *dst; 0 on success, -1 on allocation failure. */
+static inline int hmap_copy_str(char **dst, const char *key) {
+  size_t len = strlen(key) + 1;
+  char *copy = malloc(len);
+  if (copy == NULL) {
+    return -1;
+  }
+  memcpy(copy, key, len);
+  *dst = copy;
+  return 0;
+}
+
+#define HMAP_NAME hmap_str
+#define HMAP_KEY const char *
+#define HMAP_SLOT_KEY char *
+#define HMAP_SLOT_KEY_OUT const char *
+#define HMAP_HASH(k) hmap_hash_str(k)
+#define HMAP_EQ(a, b) (strcmp((a), (b)) == 0)
+#define HMAP_KEY_COPY(dst, k) hmap_copy_str(&(dst), (k))
+#define HMAP_KEY_FREE(k) free(k)
+#include "hmap_impl.h"
+
+#define HMAP_NAME hmap_int
+#define HMAP_KEY int64_t
+#define HMAP_SLOT_KEY int64_t
+#define HMAP_SLOT_KEY_OUT int64_t
+#define HMAP_HASH(k) hmap_mix((uint64_t) (k))
+#define HMAP_EQ(a, b) ((a) == (b))
+#define HMAP_KEY_COPY(dst, k) ((dst) = (k), 0)
+#define HMAP_KEY_FREE(k) ((void) (k))
+#include "hmap_impl.h"
@@ -0,0 +1,84 @@
+/**
+ * Open-addressing hash maps from keys to longs.
+ *
+ * - hmap_str_t: string keys (the map keeps its own copy of each key)
+ * - hmap_int_t: 64-bit integer keys
+ *
+ * Both are Swiss-table style: a byte of metadata per slot (empty, deleted,
+ * or 7 bits of the key's hash) is kept in a separate array and probed 16
+ * slots at a time, with SSE2 where the compiler has it, so most lookups
+ * touch one metadata group and one slot and compare keys only on a 7-bit
+ * hash match. Tables grow by doubling at 7/8 load.
+ *
+ * Iterate with a cursor starting at 0:
+ *
+ *   unsigned int pos = 0;
+ *   const char *key;
+ *   long value;
+ *   while (hmap_str_next(m, &pos, &key, &value)) { ... }
+ *
+ * Adding or removing entries while iterating may skip or repeat entries;
+ * changing values with put is fine.
+ */
+#ifndef _HMAP_H
+#define _HMAP_H
+
+#include <stdint.h>
+
+/** Map with string keys (fields are hidden). */
+typedef struct hmap_str hmap_str_t;
+
+/** Map with integer keys (fields are hidden). */
+typedef struct hmap_int hmap_int_t;
+
+/**
+ * Construct a new empty map with room for about capacity entries before it
+ * has to grow (0 is fine).
+ *
+ * Returns NULL on error.
+ */
+hmap_str_t *hmap_str_new(unsigned int capacity);
+
+/** Delete the map, freeing all memory it occupies (keys included). */
+void hmap_str_delete(hmap_str_t *m);
+
+/**
+ * Map key to value, replacing any previous value.
+ *
+ * Returns 0 on success, -1 on allocation failure (the map is unchanged).
+ */
+int hmap_str_put(hmap_str_t *m, const char *key, long value);
+
+/** Look up key. Returns non-0 and sets *value (if not NULL) if it is found. */
+int hmap_str_get(hmap_str_t *m, const char *key, long *value);
+
+/** Remove key. Returns non-0 if it was in the map. */
+int hmap_str_remove(hmap_str_t *m, const char *key);
+
+/** Number of entries in the map. */
+unsigned int hmap_str_size(hmap_str_t *m);
+
+/**
+ * Get the next entry at or after slot *pos and advance *pos past it.
+ *
+ * Returns 0 once there are no more entries. The key is owned by the map.
+ */
+int hmap_str_next(hmap_str_t *m, unsigned int *pos, const char **key,
+                  long *value);
+
+/* The same, for integer keys. */
+hmap_int_t *hmap_int_new(unsigned int capacity);
+void hmap_int_delete(hmap_int_t *m);
+int hmap_int_put(hmap_int_t *m, int64_t key, long value);
+int hmap_int_get(hmap_int_t *m, int64_t key, long *value);
+int hmap_int_remove(hmap_int_t *m, int64_t key);
+unsigned int hmap_int_size(hmap_int_t *m);
+int hmap_int_next(hmap_int_t *m, unsigned int *pos, int64_t *key,
+                  long *value);
+
+/* Map configuration. */
+#define HMAP_GROUP 16           /* Slots probed together */
+#define HMAP_MAX_LOAD_NUM 7     /* Grow when (entries + deleted) exceed */
+#define HMAP_MAX_LOAD_DEN 8     /* capacity * NUM / DEN */
+
+#endif /* ifndef _HMAP_H */
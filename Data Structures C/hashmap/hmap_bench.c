@@ -0,0 +1,124 @@
+/**
+ * Hash map benchmark.
+ *
+ * Times inserts, hits, misses and removes for both key types and prints one
+ * line per operation with the average cost in nanoseconds:
+ *
+ *   ./hmap_bench [count]
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "hmap.h"
+
+#define DEFAULT_COUNT 1000000
+#define KEY_LEN 24
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *map, const char *op, long count, double secs) {
+  printf("%-4s %-8s %10ld ops %8.1f ns/op\n", map, op, count,
+         secs * 1e9 / count);
+}
+
+static void bench_int(long count) {
+  hmap_int_t *m = hmap_int_new(0);
+  long value, found = 0;
+
+  double start = now();
+  for (long i = 0; i < count; i++) {
+    hmap_int_put(m, i * 2654435761L, i);
+  }
+  report("int", "insert", count, now() - start);
+
+  start = now();
+  for (long i = 0; i < count; i++) {
+    found += hmap_int_get(m, i * 2654435761L, &value);
+  }
+  report("int", "hit", count, now() - start);
+
+  start = now();
+  for (long i = 0; i < count; i++) {
+    found += hmap_int_get(m, -i - 1, &value);
+  }
+  report("int", "miss", count, now() - start);
+
+  start = now();
+  for (long i = 0; i < count; i++) {
+    found += hmap_int_remove(m, i * 2654435761L);
+  }
+  report("int", "remove", count, now() - start);
+
+  if (found != 2 * count) {
+    fprintf(stderr, "int map lost entries\n");
+    exit(1);
+  }
+  hmap_int_delete(m);
+}
+
+static void bench_str(long count) {
+  // Build the keys up front so only the map is timed
+  char *keys = malloc((size_t) count * KEY_LEN);
+  char *misses = malloc((size_t) count * KEY_LEN);
+  if (keys == NULL || misses == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  for (long i = 0; i < count; i++) {
+    snprintf(keys + i * KEY_LEN, KEY_LEN, "key:%ld", i);
+    snprintf(misses + i * KEY_LEN, KEY_LEN, "miss:%ld", i);
+  }
+
+  hmap_str_t *m = hmap_str_new(0);
+  long value, found = 0;
+
+  double start = now();
+  for (long i = 0; i < count; i++) {
+    hmap_str_put(m, keys + i * KEY_LEN, i);
+  }
+  report("str", "insert", count, now() - start);
+
+  start = now();
+  for (long i = 0; i < count; i++) {
+    found += hmap_str_get(m, keys + i * KEY_LEN, &value);
+  }
+  report("str", "hit", count, now() - start);
+
+  start = now();
+  for (long i = 0; i < count; i++) {
+    found += hmap_str_get(m, misses + i * KEY_LEN, &value);
+  }
+  report("str", "miss", count, now() - start);
+
+  start = now();
+  for (long i = 0; i < count; i++) {
+    found += hmap_str_remove(m, keys + i * KEY_LEN);
+  }
+  report("str", "remove", count, now() - start);
+
+  if (found != 2 * count) {
+    fprintf(stderr, "str map lost entries\n");
+    exit(1);
+  }
+  hmap_str_delete(m);
+  free(keys);
+  free(misses);
+}
+
+int main(int argc, char **argv) {
+  long count = argc > 1 ? atol(argv[1]) : DEFAULT_COUNT;
+  if (count <= 0) {
+    fprintf(stderr, "Usage: %s [count]\n", argv[0]);
+    return 1;
+  }
+
+  bench_int(count);
+  bench_str(count);
+  return 0;
+}
@@ -0,0 +1,241 @@
+/**
+ * Key-type-specialised Swiss-table hash map.
+ *
+ * Define these and include the file to generate struct HMAP_NAME and its
+ * HMAP_NAME_* functions (declared in hmap.h):
+ *
+ *   HMAP_NAME              prefix of the generated names (hmap_str)
+ *   HMAP_KEY               key type taken by the API (const char *)
+ *   HMAP_SLOT_KEY          key type stored in a slot (char *)
+ *   HMAP_SLOT_KEY_OUT      key type handed out by _next (const char *)
+ *   HMAP_HASH(k)           64-bit hash of an HMAP_KEY
+ *   HMAP_EQ(slot_key, k)   non-zero if a stored key equals an HMAP_KEY
+ *   HMAP_KEY_COPY(dst, k)  store k into the HMAP_SLOT_KEY dst, 0 or -1
+ *   HMAP_KEY_FREE(k)       release a stored key
+ *
+ * The group helpers (hmap_match, hmap_free_slots, ...) come from hmap.c.
+ * All the macros are #undef'd at the end so the file can be included again
+ * for the next key type.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "hmap.h"
+
+#define HMAP_CAT_(a, b) a##b
+#define HMAP_CAT(a, b) HMAP_CAT_(a, b)
+#define HMAP_FN(suffix) HMAP_CAT(HMAP_NAME, suffix)
+
+typedef struct {
+  HMAP_SLOT_KEY key;
+  long value;
+} HMAP_FN(_slot_t);
+
+struct HMAP_NAME {
+  int8_t *ctrl;              /* HMAP_EMPTY, HMAP_DELETED or the key's H2 */
+  HMAP_FN(_slot_t) *slots;
+  size_t capacity;           /* Power of two, multiple of HMAP_GROUP */
+  size_t size;               /* Live entries */
+  size_t deleted;            /* Tombstones */
+};
+
+/** Allocate empty ctrl and slot arrays for capacity slots. */
+static int HMAP_FN(_alloc)(struct HMAP_NAME *m, size_t capacity) {
+  int8_t *ctrl = aligned_alloc(HMAP_GROUP, capacity);
+  HMAP_FN(_slot_t) *slots = malloc(sizeof(HMAP_FN(_slot_t)) * capacity);
+  if (ctrl == NULL || slots == NULL) {
+    free(ctrl);
+    free(slots);
+    return -1;
+  }
+
+  memset(ctrl, HMAP_EMPTY, capacity);
+  m->ctrl = ctrl;
+  m->slots = slots;
+  m->capacity = capacity;
+  m->size = 0;
+  m->deleted = 0;
+  return 0;
+}
+
+/** Index of key's slot, or capacity if it is not in the map. */
+static size_t HMAP_FN(_find)(struct HMAP_NAME *m, HMAP_KEY key,
+                             uint64_t hash) {
+  size_t group_mask = m->capacity / HMAP_GROUP - 1;
+  size_t group = hmap_h1(hash) & group_mask;
+
+  for (size_t step = 1;; step++) {
+    const int8_t *ctrl = m->ctrl + group * HMAP_GROUP;
+    for (uint32_t bits = hmap_match(ctrl, hmap_h2(hash)); bits;
+         bits &= bits - 1) {
+      size_t i = group * HMAP_GROUP + __builtin_ctz(bits);
+      if (HMAP_EQ(m->slots[i].key, key)) {
+        return i;
+      }
+    }
+    // An empty slot ends every probe sequence that reaches this group
+    if (hmap_match(ctrl, HMAP_EMPTY)) {
+      return m->capacity;
+    }
+    group = (group + step) & group_mask;  // triangular: visits every group
+  }
+}
+
+/** Index of the first empty or deleted slot on hash's probe sequence. */
+static size_t HMAP_FN(_find_free)(struct HMAP_NAME *m, uint64_t hash) {
+  size_t group_mask = m->capacity / HMAP_GROUP - 1;
+  size_t group = hmap_h1(hash) & group_mask;
+
+  for (size_t step = 1;; step++) {
+    uint32_t bits = hmap_free_slots(m->ctrl + group * HMAP_GROUP);
+    if (bits) {
+      return group * HMAP_GROUP + __builtin_ctz(bits);
+    }
+    group = (group + step) & group_mask;
+  }
+}
+
+/** Move every entry into fresh arrays of the given capacity. */
+static int HMAP_FN(_rehash)(struct HMAP_NAME *m, size_t capacity) {
+  struct HMAP_NAME old = *m;
+  if (HMAP_FN(_alloc)(m, capacity) != 0) {
+    *m = old;
+    return -1;
+  }
+
+  for (size_t i = 0; i < old.capacity; i++) {
+    if (old.ctrl[i] >= 0) {
+      uint64_t hash = HMAP_HASH(old.slots[i].key);
+      size_t j = HMAP_FN(_find_free)(m, hash);
+      m->ctrl[j] = hmap_h2(hash);
+      m->slots[j] = old.slots[i];
+    }
+  }
+  m->size = old.size;
+
+  free(old.ctrl);
+  free(old.slots);
+  return 0;
+}
+
+struct HMAP_NAME *HMAP_FN(_new)(unsigned int capacity) {
+  struct HMAP_NAME *m = malloc(sizeof(struct HMAP_NAME));
+  if (m == NULL) {
+    return NULL;
+  }
+
+  if (HMAP_FN(_alloc)(m, hmap_capacity_for(capacity)) != 0) {
+    free(m);
+    return NULL;
+  }
+  return m;
+}
+
+void HMAP_FN(_delete)(struct HMAP_NAME *m) {
+  if (m == NULL) {
+    return;
+  }
+
+  for (size_t i = 0; i < m->capacity; i++) {
+    if (m->ctrl[i] >= 0) {
+      HMAP_KEY_FREE(m->slots[i].key);
+    }
+  }
+  free(m->ctrl);
+  free(m->slots);
+  free(m);
+}
+
+int HMAP_FN(_put)(struct HMAP_NAME *m, HMAP_KEY key, long value) {
+  uint64_t hash = HMAP_HASH(key);
+  size_t i = HMAP_FN(_find)(m, key, hash);
+  if (i < m->capacity) {
+    m->slots[i].value = value;
+    return 0;
+  }
+
+  if ((m->size + m->deleted + 1) * HMAP_MAX_LOAD_DEN
+      > m->capacity * HMAP_MAX_LOAD_NUM) {
+    // Mostly tombstones: clean up in place; otherwise double
+    size_t capacity = m->capacity;
+    if ((m->size + 1) * HMAP_MAX_LOAD_DEN * 2 > capacity * HMAP_MAX_LOAD_NUM) {
+      capacity *= 2;
+    }
+    if (HMAP_FN(_rehash)(m, capacity) != 0) {
+      return -1;
+    }
+  }
+
+  i = HMAP_FN(_find_free)(m, hash);
+  if (HMAP_KEY_COPY(m->slots[i].key, key) != 0) {
+    return -1;
+  }
+  if (m->ctrl[i] == HMAP_DELETED) {
+    m->deleted--;
+  }
+  m->ctrl[i] = hmap_h2(hash);
+  m->slots[i].value = value;
+  m->size++;
+  return 0;
+}
+
+int HMAP_FN(_get)(struct HMAP_NAME *m, HMAP_KEY key, long *value) {
+  size_t i = HMAP_FN(_find)(m, key, HMAP_HASH(key));
+  if (i == m->capacity) {
+    return 0;
+  }
+  if (value != NULL) {
+    *value = m->slots[i].value;
+  }
+  return 1;
+}
+
+int HMAP_FN(_remove)(struct HMAP_NAME *m, HMAP_KEY key) {
+  size_t i = HMAP_FN(_find)(m, key, HMAP_HASH(key));
+  if (i == m->capacity) {
+    return 0;
+  }
+
+  HMAP_KEY_FREE(m->slots[i].key);
+  // A group that still has an empty slot stops every probe anyway
+  const int8_t *group = m->ctrl + i / HMAP_GROUP * HMAP_GROUP;
+  if (hmap_match(group, HMAP_EMPTY)) {
+    m->ctrl[i] = HMAP_EMPTY;
+  } else {
+    m->ctrl[i] = HMAP_DELETED;
+    m->deleted++;
+  }
+  m->size--;
+  return 1;
+}
+
+unsigned int HMAP_FN(_size)(struct HMAP_NAME *m) {
+  return m->size;
+}
+
+int HMAP_FN(_next)(struct HMAP_NAME *m, unsigned int *pos,
+                   HMAP_SLOT_KEY_OUT *key, long *value) {
+  for (size_t i = *pos; i < m->capacity; i++) {
+    if (m->ctrl[i] >= 0) {
+      if (key != NULL) {
+        *key = m->slots[i].key;
+      }
+      if (value != NULL) {
+        *value = m->slots[i].value;
+      }
+      *pos = i + 1;
+      return 1;
+    }
+  }
+  *pos = m->capacity;
+  return 0;
+}
+
+#undef HMAP_NAME
+#undef HMAP_KEY
+#undef HMAP_SLOT_KEY
+#undef HMAP_SLOT_KEY_OUT
+#undef HMAP_HASH
+#undef HMAP_EQ
+#undef HMAP_KEY_COPY
+#undef HMAP_KEY_FREE
@@ -0,0 +1,190 @@
+/**
+ * Unit tests for the hash maps.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <munit.h>
+
+#include "hmap.h"
+
+#define MANY 100000
+
+/* Put, overwrite, get, remove with string keys */
+MunitResult test_str_basic(const MunitParameter params[], void *data) {
+  hmap_str_t *m = hmap_str_new(0);
+  long value;
+
+  munit_assert_uint(hmap_str_size(m), ==, 0);
+  munit_assert_false(hmap_str_get(m, "missing", &value));
+
+  char key[] = "hello";
+  munit_assert_int(hmap_str_put(m, key, 1), ==, 0);
+  munit_assert_int(hmap_str_put(m, "world", 2), ==, 0);
+  key[0] = 'j';  // the map has its own copy
+
+  munit_assert_true(hmap_str_get(m, "hello", &value));
+  munit_assert_long(value, ==, 1);
+  munit_assert_false(hmap_str_get(m, "jello", NULL));
+
+  munit_assert_int(hmap_str_put(m, "hello", 3), ==, 0);
+  munit_assert_uint(hmap_str_size(m), ==, 2);
+  munit_assert_true(hmap_str_get(m, "hello", &value));
+  munit_assert_long(value, ==, 3);
+
+  munit_assert_true(hmap_str_remove(m, "hello"));
+  munit_assert_false(hmap_str_remove(m, "hello"));
+  munit_assert_false(hmap_str_get(m, "hello", NULL));
+  munit_assert_true(hmap_str_get(m, "world", &value));
+  munit_assert_long(value, ==, 2);
+  munit_assert_uint(hmap_str_size(m), ==, 1);
+
+  munit_assert_int(hmap_str_put(m, "", 4), ==, 0);
+  munit_assert_true(hmap_str_get(m, "", &value));
+  munit_assert_long(value, ==, 4);
+
+  hmap_str_delete(m);
+  return MUNIT_OK;
+}
+
+/* Many string keys: growth keeps every entry */
+MunitResult test_str_many(const MunitParameter params[], void *data) {
+  hmap_str_t *m = hmap_str_new(0);
+  char buf[32];
+  long value;
+
+  for (long i = 0; i < MANY; i++) {
+    sprintf(buf, "key %ld", i);
+    munit_assert_int(hmap_str_put(m, buf, i), ==, 0);
+  }
+  munit_assert_uint(hmap_str_size(m), ==, MANY);
+
+  for (long i = 0; i < MANY; i++) {
+    sprintf(buf, "key %ld", i);
+    munit_assert_true(hmap_str_get(m, buf, &value));
+    munit_assert_long(value, ==, i);
+    sprintf(buf, "nokey %ld", i);
+    munit_assert_false(hmap_str_get(m, buf, NULL));
+  }
+
+  hmap_str_delete(m);
+  return MUNIT_OK;
+}
+
+/* Integer keys, with removals leaving tombstones that get reused */
+MunitResult test_int_churn(const MunitParameter params[], void *data) {
+  hmap_int_t *m = hmap_int_new(MANY);
+  long value;
+
+  for (int64_t i = 0; i < MANY; i++) {
+    munit_assert_int(hmap_int_put(m, i * 7919, i), ==, 0);
+  }
+  for (int64_t i = 1; i < MANY; i += 2) {
+    munit_assert_true(hmap_int_remove(m, i * 7919));
+  }
+  munit_assert_uint(hmap_int_size(m), ==, MANY / 2);
+
+  for (int64_t i = 0; i < MANY; i++) {
+    int found = hmap_int_get(m, i * 7919, &value);
+    munit_assert_int(found, ==, i % 2 == 0);
+    if (found) {
+      munit_assert_long(value, ==, i);
+    }
+  }
+
+  // Insert and remove different keys over and over: the table must not
+  // fill up with tombstones
+  for (int round = 0; round < 20; round++) {
+    for (int64_t i = 0; i < MANY / 2; i++) {
+      munit_assert_int(hmap_int_put(m, -(round * MANY + i) - 1, i), ==, 0);
+    }
+    for (int64_t i = 0; i < MANY / 2; i++) {
+      munit_assert_true(hmap_int_remove(m, -(round * MANY + i) - 1));
+    }
+  }
+  munit_assert_uint(hmap_int_size(m), ==, MANY / 2);
+  munit_assert_true(hmap_int_get(m, 0, &value));
+  munit_assert_long(value, ==, 0);
+  munit_assert_false(hmap_int_get(m, -1, NULL));
+
+  hmap_int_delete(m);
+  return MUNIT_OK;
+}
+
+/* Iteration visits each entry exactly once */
+MunitResult test_iteration(const MunitParameter params[], void *data) {
+  hmap_int_t *ints = hmap_int_new(0);
+  hmap_str_t *strs = hmap_str_new(0);
+  char buf[32];
+
+  unsigned int pos = 0;
+  munit_assert_false(hmap_int_next(ints, &pos, NULL, NULL));
+
+  for (int64_t i = 1; i <= 1000; i++) {
+    hmap_int_put(ints, i, -i);
+    sprintf(buf, "%ld", (long) i);
+    hmap_str_put(strs, buf, i);
+  }
+  hmap_int_remove(ints, 1000);
+
+  int64_t key, key_sum = 0;
+  long value, value_sum = 0, count = 0;
+  pos = 0;
+  while (hmap_int_next(ints, &pos, &key, &value)) {
+    munit_assert_long(value, ==, -key);
+    key_sum += key;
+    value_sum += value;
+    count++;
+  }
+  munit_assert_long(count, ==, 999);
+  munit_assert_long(key_sum, ==, 999 * 1000 / 2);
+  munit_assert_long(value_sum, ==, -key_sum);
+
+  const char *str;
+  count = 0;
+  value_sum = 0;
+  pos = 0;
+  while (hmap_str_next(strs, &pos, &str, &value)) {
+    munit_assert_long(strtol(str, NULL, 10), ==, value);
+    value_sum += value;
+    count++;
+  }
+  munit_assert_long(count, ==, 1000);
+  munit_assert_long(value_sum, ==, 1000 * 1001 / 2);
+
+  hmap_int_delete(ints);
+  hmap_str_delete(strs);
+  return MUNIT_OK;
+}
+
+#define MUNIT_SIMPLE(name, test_func, params) \
+  { \
+    name, /* name */ \
+    test_func, /* test */ \
+    NULL, /* setup */ \
+    NULL, /* tear_down */ \
+    MUNIT_TEST_OPTION_NONE, /* options */ \
+    params /* parameters */ \
+  }
+
+#define MUNIT_TESTS_END MUNIT_SIMPLE(NULL, NULL, NULL)
+
+MunitTest tests[] = {
+  MUNIT_SIMPLE("/String keys", test_str_basic, NULL),
+  MUNIT_SIMPLE("/Many string keys", test_str_many, NULL),
+  MUNIT_SIMPLE("/Integer keys with churn", test_int_churn, NULL),
+  MUNIT_SIMPLE("/Iteration", test_iteration, NULL),
+  MUNIT_TESTS_END
+};
+
+static const MunitSuite suite = {
+  "/hmap", /* name */
+  tests, /* tests */
+  NULL, /* suites */
+  1, /* iterations */
+  MUNIT_SUITE_OPTION_NONE /* options */
+};
+
+int main(int argc, char **argv) {
+  return munit_suite_main(&suite, NULL, argc, argv);
+}
@@ -0,0 +1,238 @@
+/*
+ * Blocking queue implementation.
+ *
+ * A queue_t guarded by one mutex, with a condition variable per direction
+ * (on Linux both sleep on futexes). The item count is mirrored in an atomic
+ * so waiters can spin on it without taking the lock, and wakeups are only
+ * signalled when somebody is actually asleep on the other side.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bqueue.h"
+#include "queue.h"
+
+struct bqueue {
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;  /* Signalled when an item arrives */
+  pthread_cond_t not_full;   /* Signalled when an item leaves */
+  unsigned int pop_waiters;  /* Consumers asleep on not_empty */
+  unsigned int push_waiters; /* Producers asleep on not_full */
+  unsigned int capacity;
+  int closed;
+  _Atomic unsigned int count; /* queue_size(items), readable without lock */
+  queue_t *items;
+};
+
+/** The clock the condition variables time out against. */
+#if defined(__linux__)
+#define BQUEUE_CLOCK CLOCK_MONOTONIC
+#else
+#define BQUEUE_CLOCK CLOCK_REALTIME
+#endif
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+/** Absolute deadline timeout_ms from now on BQUEUE_CLOCK. */
+static struct timespec deadline_in(unsigned int timeout_ms) {
+  struct timespec ts;
+  clock_gettime(BQUEUE_CLOCK, &ts);
+  ts.tv_sec += timeout_ms / 1000;
+  ts.tv_nsec += (long) (timeout_ms % 1000) * 1000000;
+  if (ts.tv_nsec >= 1000000000) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
+  }
+  return ts;
+}
+
+/**
+ * Poll count (without the lock) until it differs from value, the queue is
+ * closed, or BQUEUE_SPIN polls have passed.
+ */
+static void spin_while(bqueue_t *q, unsigned int value) {
+  for (int i = 0; i < BQUEUE_SPIN; i++) {
+    if (atomic_load_explicit(&q->count, memory_order_relaxed) != value) {
+      return;
+    }
+    cpu_relax();
+  }
+}
+
+/**
+ * Sleep on cond until woken or deadline passes (NULL: no deadline).
+ *
+ * Returns BQUEUE_OK, or BQUEUE_TIMEOUT once the deadline has passed.
+ */
+static int wait_on(pthread_cond_t *cond, pthread_mutex_t *lock,
+                   const struct timespec *deadline) {
+  if (deadline == NULL) {
+    pthread_cond_wait(cond, lock);
+    return BQUEUE_OK;
+  }
+  if (pthread_cond_timedwait(cond, lock, deadline) == ETIMEDOUT) {
+    return BQUEUE_TIMEOUT;
+  }
+  return BQUEUE_OK;
+}
+
+bqueue_t *bqueue_new(unsigned int capacity) {
+  bqueue_t *q = malloc(sizeof(bqueue_t));
+  if (q == NULL) {
+    return NULL;
+  }
+
+  q->items = queue_new(capacity);
+  if (q->items == NULL) {
+    free(q);
+    return NULL;
+  }
+
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+#if defined(__linux__)
+  pthread_condattr_setclock(&attr, BQUEUE_CLOCK);
+#endif
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->not_empty, &attr);
+  pthread_cond_init(&q->not_full, &attr);
+  pthread_condattr_destroy(&attr);
+
+  q->pop_waiters = 0;
+  q->push_waiters = 0;
+  q->capacity = capacity;
+  q->closed = 0;
+  atomic_init(&q->count, 0);
+
+  return q;
+}
+
+/** Push with an optional deadline (see bqueue_push). */
+static int push(bqueue_t *q, long item, const struct timespec *deadline) {
+  assert(q != NULL);
+
+  spin_while(q, q->capacity);
+
+  pthread_mutex_lock(&q->lock);
+  int rv = BQUEUE_OK;
+  while (!q->closed && queue_full(q->items) && rv == BQUEUE_OK) {
+    q->push_waiters++;
+    rv = wait_on(&q->not_full, &q->lock, deadline);
+    q->push_waiters--;
+  }
+
+  if (q->closed) {
+    rv = BQUEUE_CLOSED;
+  } else if (!queue_full(q->items)) {
+    // Room may have appeared just as the wait timed out
+    queue_enqueue(q->items, item);
+    atomic_store_explicit(&q->count, queue_size(q->items),
+                          memory_order_relaxed);
+    if (q->pop_waiters > 0) {
+      pthread_cond_signal(&q->not_empty);
+    }
+    rv = BQUEUE_OK;
+  }
+  pthread_mutex_unlock(&q->lock);
+
+  return rv;
+}
+
+/** Pop with an optional deadline (see bqueue_pop). */
+static int pop(bqueue_t *q, long *item, const struct timespec *deadline) {
+  assert(q != NULL);
+  assert(item != NULL);
+
+  spin_while(q, 0);
+
+  pthread_mutex_lock(&q->lock);
+  int rv = BQUEUE_OK;
+  while (!q->closed && queue_empty(q->items) && rv == BQUEUE_OK) {
+    q->pop_waiters++;
+    rv = wait_on(&q->not_empty, &q->lock, deadline);
+    q->pop_waiters--;
+  }
+
+  if (!queue_empty(q->items)) {
+    // Closed queues still hand out what they hold
+    *item = queue_dequeue(q->items);
+    atomic_store_explicit(&q->count, queue_size(q->items),
+                          memory_order_relaxed);
+    if (q->push_waiters > 0) {
+      pthread_cond_signal(&q->not_full);
+    }
+    rv = BQUEUE_OK;
+  } else if (q->closed) {
+    rv = BQUEUE_CLOSED;
+  }
+  pthread_mutex_unlock(&q->lock);
+
+  return rv;
+}
+
+int bqueue_push(bqueue_t *q, long item) {
+  return push(q, item, NULL);
+}
+
+int bqueue_pop(bqueue_t *q, long *item) {
+  return pop(q, item, NULL);
+}
+
+int bqueue_push_timed(bqueue_t *q, long item, unsigned int timeout_ms) {
+  struct timespec deadline = deadline_in(timeout_ms);
+  return push(q, item, &deadline);
+}
+
+int bqueue_pop_timed(bqueue_t *q, long *item, unsigned int timeout_ms) {
+  struct timespec deadline = deadline_in(timeout_ms);
+  return pop(q, item, &deadline);
+}
+
+unsigned int bqueue_drain(bqueue_t *q, long *items, unsigned int n) {
+  assert(q != NULL);
+
+  pthread_mutex_lock(&q->lock);
+  unsigned int got = queue_dequeue_n(q->items, items, n);
+  atomic_store_explicit(&q->count, queue_size(q->items), memory_order_relaxed);
+  if (got > 0 && q->push_waiters > 0) {
+    pthread_cond_broadcast(&q->not_full);
+  }
+  pthread_mutex_unlock(&q->lock);
+
+  return got;
+}
+
+void bqueue_close(bqueue_t *q) {
+  assert(q != NULL);
+
+  pthread_mutex_lock(&q->lock);
+  q->closed = 1;
+  pthread_cond_broadcast(&q->not_empty);
+  pthread_cond_broadcast(&q->not_full);
+  pthread_mutex_unlock(&q->lock);
+}
+
+unsigned int bqueue_size(bqueue_t *q) {
+  assert(q != NULL);
+
+  return atomic_load_explicit(&q->count, memory_order_relaxed);
+}
+
+void bqueue_delete(bqueue_t *q) {
+  assert(q != NULL);
+
+  pthread_cond_destroy(&q->not_full);
+  pthread_cond_destroy(&q->not_empty);
+  pthread_mutex_destroy(&q->lock);
+  queue_delete(q->items);
+  free(q);
+}
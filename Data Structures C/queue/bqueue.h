@@ -0,0 +1,67 @@
+/**
+ * Blocking bounded queue of longs, for handing work between pipeline stages.
+ *
+ * A thread-safe wrapper around queue_t: pushing to a full queue waits for
+ * room, popping from an empty one waits for an item. Waiters spin briefly
+ * before going to sleep on a condition variable, so a busy pipeline rarely
+ * pays for a sleep/wakeup.
+ *
+ * Closing the queue lets the consumers drain what is left: pushes fail from
+ * then on, pops keep succeeding until the queue is empty and then fail too.
+ *
+ * The blocking calls return one of the BQUEUE_* status codes below.
+ */
+#ifndef _BQUEUE_H
+#define _BQUEUE_H
+
+/** Blocking queue (fields are hidden). */
+typedef struct bqueue bqueue_t;
+
+/* Status codes. */
+#define BQUEUE_OK 0
+#define BQUEUE_CLOSED 1   /* The queue was closed (and, for pops, is empty) */
+#define BQUEUE_TIMEOUT 2  /* The timed variant gave up */
+
+/**
+ * Construct a new empty blocking queue holding up to capacity items.
+ *
+ * Returns NULL on error.
+ */
+bqueue_t *bqueue_new(unsigned int capacity);
+
+/** Push an item, waiting while the queue is full. */
+int bqueue_push(bqueue_t *q, long item);
+
+/** Pop an item into *item, waiting while the queue is empty. */
+int bqueue_pop(bqueue_t *q, long *item);
+
+/** Like bqueue_push, but wait at most timeout_ms milliseconds. */
+int bqueue_push_timed(bqueue_t *q, long item, unsigned int timeout_ms);
+
+/** Like bqueue_pop, but wait at most timeout_ms milliseconds. */
+int bqueue_pop_timed(bqueue_t *q, long *item, unsigned int timeout_ms);
+
+/**
+ * Pop up to n items into items[0..n) without waiting.
+ *
+ * Returns the number of items popped.
+ */
+unsigned int bqueue_drain(bqueue_t *q, long *items, unsigned int n);
+
+/**
+ * Close the queue and wake every waiting thread.
+ *
+ * Items already in the queue can still be popped.
+ */
+void bqueue_close(bqueue_t *q);
+
+/** Number of items currently in the queue (a snapshot). */
+unsigned int bqueue_size(bqueue_t *q);
+
+/** Delete the queue. No other thread may be using it. */
+void bqueue_delete(bqueue_t *q);
+
+/* Queue configuration. */
+#define BQUEUE_SPIN 128   /* Polls before a waiter goes to sleep */
+
+#endif /* ifndef _BQUEUE_H */
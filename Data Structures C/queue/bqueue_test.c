@@ -0,0 +1,191 @@
+/**
+ * Unit tests for the blocking queue.
+ *
+ * Besides the single-threaded behaviour, these check that waiting threads
+ * are woken by pushes, pops and close, and that a small pipeline hands every
+ * item over exactly once.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <munit.h>
+
+#include "bqueue.h"
+
+#define PIPELINE_ITEMS 100000
+#define PIPELINE_THREADS 3
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Push, pop and drain without waiting
+MunitResult test_basic(const MunitParameter params[], void *data) {
+  bqueue_t *q = bqueue_new(4);
+  long item, items[8];
+
+  for (long i = 0; i < 4; i++) {
+    munit_assert_int(bqueue_push(q, i), ==, BQUEUE_OK);
+  }
+  munit_assert_uint(bqueue_size(q), ==, 4);
+
+  munit_assert_int(bqueue_pop(q, &item), ==, BQUEUE_OK);
+  munit_assert_long(item, ==, 0);
+
+  munit_assert_uint(bqueue_drain(q, items, 8), ==, 3);
+  munit_assert_long(items[0], ==, 1);
+  munit_assert_long(items[2], ==, 3);
+  munit_assert_uint(bqueue_size(q), ==, 0);
+  munit_assert_uint(bqueue_drain(q, items, 8), ==, 0);
+
+  bqueue_delete(q);
+  return MUNIT_OK;
+}
+
+// Timed variants give up on an empty/full queue
+MunitResult test_timeout(const MunitParameter params[], void *data) {
+  bqueue_t *q = bqueue_new(1);
+  long item;
+
+  double start = now();
+  munit_assert_int(bqueue_pop_timed(q, &item, 20), ==, BQUEUE_TIMEOUT);
+  munit_assert_double(now() - start, >=, 0.019);
+
+  munit_assert_int(bqueue_push_timed(q, 1, 20), ==, BQUEUE_OK);
+  start = now();
+  munit_assert_int(bqueue_push_timed(q, 2, 20), ==, BQUEUE_TIMEOUT);
+  munit_assert_double(now() - start, >=, 0.019);
+
+  munit_assert_int(bqueue_pop_timed(q, &item, 20), ==, BQUEUE_OK);
+  munit_assert_long(item, ==, 1);
+
+  bqueue_delete(q);
+  return MUNIT_OK;
+}
+
+static void *pop_one(void *ref) {
+  bqueue_t *q = ref;
+  static long item;
+  int rv = bqueue_pop(q, &item);
+  return rv == BQUEUE_OK ? &item : NULL;
+}
+
+// Close wakes a blocked consumer; later pops drain, then report closed
+MunitResult test_close(const MunitParameter params[], void *data) {
+  bqueue_t *q = bqueue_new(4);
+  long item;
+  void *got;
+
+  pthread_t consumer;
+  pthread_create(&consumer, NULL, pop_one, q);
+  bqueue_close(q);
+  pthread_join(consumer, &got);
+  munit_assert_null(got);
+  munit_assert_int(bqueue_push(q, 1), ==, BQUEUE_CLOSED);
+  bqueue_delete(q);
+
+  q = bqueue_new(4);
+  bqueue_push(q, 1);
+  bqueue_push(q, 2);
+  bqueue_close(q);
+  munit_assert_int(bqueue_push(q, 3), ==, BQUEUE_CLOSED);
+  munit_assert_int(bqueue_pop(q, &item), ==, BQUEUE_OK);
+  munit_assert_long(item, ==, 1);
+  munit_assert_int(bqueue_pop_timed(q, &item, 1000), ==, BQUEUE_OK);
+  munit_assert_long(item, ==, 2);
+  munit_assert_int(bqueue_pop(q, &item), ==, BQUEUE_CLOSED);
+  munit_assert_int(bqueue_pop_timed(q, &item, 1000), ==, BQUEUE_CLOSED);
+  bqueue_delete(q);
+
+  return MUNIT_OK;
+}
+
+typedef struct {
+  bqueue_t *q;
+  long sum;   /* Sum of the items a consumer got */
+  long count; /* Number of items a consumer got */
+} pipeline_arg_t;
+
+static void *pipeline_producer(void *ref) {
+  bqueue_t *q = ref;
+  for (long i = 1; i <= PIPELINE_ITEMS; i++) {
+    bqueue_push(q, i);
+  }
+  bqueue_close(q);
+  return NULL;
+}
+
+static void *pipeline_consumer(void *ref) {
+  pipeline_arg_t *arg = ref;
+  long item;
+  while (bqueue_pop(arg->q, &item) == BQUEUE_OK) {
+    arg->sum += item;
+    arg->count++;
+  }
+  return NULL;
+}
+
+// One producer feeding several consumers through a small queue
+MunitResult test_pipeline(const MunitParameter params[], void *data) {
+  bqueue_t *q = bqueue_new(16);
+  pthread_t producer, consumers[PIPELINE_THREADS];
+  pipeline_arg_t args[PIPELINE_THREADS];
+
+  for (int i = 0; i < PIPELINE_THREADS; i++) {
+    args[i] = (pipeline_arg_t){q, 0, 0};
+    pthread_create(&consumers[i], NULL, pipeline_consumer, &args[i]);
+  }
+  pthread_create(&producer, NULL, pipeline_producer, q);
+
+  long sum = 0, count = 0;
+  pthread_join(producer, NULL);
+  for (int i = 0; i < PIPELINE_THREADS; i++) {
+    pthread_join(consumers[i], NULL);
+    sum += args[i].sum;
+    count += args[i].count;
+  }
+
+  long n = PIPELINE_ITEMS;
+  munit_assert_long(count, ==, n);
+  munit_assert_long(sum, ==, n * (n + 1) / 2);
+  munit_assert_uint(bqueue_size(q), ==, 0);
+
+  bqueue_delete(q);
+  return MUNIT_OK;
+}
+
+#define MUNIT_SIMPLE(name, test_func, params) \
+  { \
+    name, /* name */ \
+    test_func, /* test */ \
+    NULL, /* setup */ \
+    NULL, /* tear_down */ \
+    MUNIT_TEST_OPTION_NONE, /* options */ \
+    params /* parameters */ \
+  }
+
+#define MUNIT_TESTS_END MUNIT_SIMPLE(NULL, NULL, NULL)
+
+MunitTest tests[] = {
+  MUNIT_SIMPLE("/Push, pop, drain", test_basic, NULL),
+  MUNIT_SIMPLE("/Timed push and pop", test_timeout, NULL),
+  MUNIT_SIMPLE("/Close wakes waiters and drains", test_close, NULL),
+  MUNIT_SIMPLE("/Producer and consumer threads", test_pipeline, NULL),
+  MUNIT_TESTS_END
+};
+
+static const MunitSuite suite = {
+  "/bqueue", /* name */
+  tests, /* tests */
+  NULL, /* suites */
+  1, /* iterations */
+  MUNIT_SUITE_OPTION_NONE /* options */
+};
+
+int main(int argc, char **argv) {
+  return munit_suite_main(&suite, NULL, argc, argv);
+}
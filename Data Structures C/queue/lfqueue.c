@@ -0,0 +1,246 @@
+/*
+ * Lock-free queue implementations.
+ *
+ * Both queues use free-running 64-bit head/tail counters (they never wrap in
+ * practice) and find the slot with counter & mask. Counters written by
+ * different threads live on separate cache lines so producers and consumers
+ * don't invalidate each other's lines on every operation.
+ */
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lfqueue.h"
+
+/** The SPSC ring: the consumer owns head, the producer owns tail. */
+struct spsc_queue {
+  _Alignas(LFQUEUE_CACHE_LINE)
+  _Atomic uint64_t head;   /* Next slot to dequeue (written by the consumer) */
+  uint64_t cached_tail;    /* Consumer's last view of tail */
+
+  _Alignas(LFQUEUE_CACHE_LINE)
+  _Atomic uint64_t tail;   /* Next free slot (written by the producer) */
+  uint64_t cached_head;    /* Producer's last view of head */
+
+  _Alignas(LFQUEUE_CACHE_LINE)
+  uint64_t mask;           /* capacity - 1 */
+  long *data;              /* The data our queue holds */
+};
+
+/** An MPMC slot; seq says whose turn it is (Vyukov's bounded queue). */
+typedef struct {
+  _Atomic uint64_t seq;    /* pos: free for the enqueue at pos,
+                            * pos + 1: full, for the dequeue at pos */
+  long data;
+} mpmc_cell_t;
+
+/** The MPMC ring. */
+struct mpmc_queue {
+  _Alignas(LFQUEUE_CACHE_LINE)
+  _Atomic uint64_t tail;   /* Next enqueue position */
+
+  _Alignas(LFQUEUE_CACHE_LINE)
+  _Atomic uint64_t head;   /* Next dequeue position */
+
+  _Alignas(LFQUEUE_CACHE_LINE)
+  uint64_t mask;           /* capacity - 1 */
+  mpmc_cell_t *cells;
+};
+
+/** Round capacity up to a power of two; 0 if it is 0 or too big. */
+static uint64_t round_capacity(unsigned int capacity) {
+  if (capacity == 0 || capacity > (1u << 31)) {
+    return 0;
+  }
+  uint64_t cap = 1;
+  while (cap < capacity) {
+    cap <<= 1;
+  }
+  return cap;
+}
+
+/** Allocate a zeroed, cache-line aligned struct. */
+static void *alloc_aligned(size_t size) {
+  // aligned_alloc wants a multiple of the alignment; sizeof already is one
+  void *p = aligned_alloc(LFQUEUE_CACHE_LINE, size);
+  if (p != NULL) {
+    memset(p, 0, size);
+  }
+  return p;
+}
+
+spsc_queue_t *spsc_queue_new(unsigned int capacity) {
+  uint64_t cap = round_capacity(capacity);
+  if (cap == 0) {
+    return NULL;
+  }
+
+  spsc_queue_t *q = alloc_aligned(sizeof(spsc_queue_t));
+  if (q == NULL) {
+    return NULL;
+  }
+
+  q->data = malloc(sizeof(long) * cap);
+  if (q->data == NULL) {
+    free(q);
+    return NULL;
+  }
+
+  atomic_init(&q->head, 0);
+  atomic_init(&q->tail, 0);
+  q->mask = cap - 1;
+
+  return q;
+}
+
+int spsc_queue_enqueue(spsc_queue_t *q, long item) {
+  uint64_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+  // Only re-read the consumer's counter when the cached one says "full"
+  if (tail - q->cached_head > q->mask) {
+    q->cached_head = atomic_load_explicit(&q->head, memory_order_acquire);
+    if (tail - q->cached_head > q->mask) {
+      return 0;
+    }
+  }
+
+  q->data[tail & q->mask] = item;
+  atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+  return 1;
+}
+
+int spsc_queue_dequeue(spsc_queue_t *q, long *item) {
+  uint64_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+  // Only re-read the producer's counter when the cached one says "empty"
+  if (head == q->cached_tail) {
+    q->cached_tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    if (head == q->cached_tail) {
+      return 0;
+    }
+  }
+
+  *item = q->data[head & q->mask];
+  atomic_store_explicit(&q->head, head + 1, memory_order_release);
+  return 1;
+}
+
+unsigned int spsc_queue_size(spsc_queue_t *q) {
+  uint64_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+  uint64_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+  return tail - head;
+}
+
+unsigned int spsc_queue_capacity(spsc_queue_t *q) {
+  return q->mask + 1;
+}
+
+void spsc_queue_delete(spsc_queue_t *q) {
+  free(q->data);
+  free(q);
+}
+
+mpmc_queue_t *mpmc_queue_new(unsigned int capacity) {
+  uint64_t cap = round_capacity(capacity);
+  if (cap == 0) {
+    return NULL;
+  }
+
+  mpmc_queue_t *q = alloc_aligned(sizeof(mpmc_queue_t));
+  if (q == NULL) {
+    return NULL;
+  }
+
+  q->cells = malloc(sizeof(mpmc_cell_t) * cap);
+  if (q->cells == NULL) {
+    free(q);
+    return NULL;
+  }
+
+  for (uint64_t i = 0; i < cap; i++) {
+    atomic_init(&q->cells[i].seq, i);
+  }
+  atomic_init(&q->head, 0);
+  atomic_init(&q->tail, 0);
+  q->mask = cap - 1;
+
+  return q;
+}
+
+int mpmc_queue_enqueue(mpmc_queue_t *q, long item) {
+  uint64_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  mpmc_cell_t *cell;
+
+  for (;;) {
+    cell = &q->cells[pos & q->mask];
+    uint64_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+    int64_t diff = (int64_t)(seq - pos);
+
+    if (diff == 0) {
+      // Slot is free for pos; claim pos (on failure pos is reloaded)
+      if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // Slot still holds the item from one lap ago: full
+      return 0;
+    } else {
+      // Another producer claimed pos already
+      pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    }
+  }
+
+  cell->data = item;
+  atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+  return 1;
+}
+
+int mpmc_queue_dequeue(mpmc_queue_t *q, long *item) {
+  uint64_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+  mpmc_cell_t *cell;
+
+  for (;;) {
+    cell = &q->cells[pos & q->mask];
+    uint64_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+    int64_t diff = (int64_t)(seq - (pos + 1));
+
+    if (diff == 0) {
+      // Slot is full for pos; claim pos (on failure pos is reloaded)
+      if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // Nothing enqueued at pos yet: empty
+      return 0;
+    } else {
+      // Another consumer claimed pos already
+      pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    }
+  }
+
+  *item = cell->data;
+  // Free the slot for the enqueue one lap later
+  atomic_store_explicit(&cell->seq, pos + q->mask + 1, memory_order_release);
+  return 1;
+}
+
+unsigned int mpmc_queue_size(mpmc_queue_t *q) {
+  uint64_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+  uint64_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+  // Claimed-but-unfinished operations can make head pass tail briefly
+  return tail > head ? tail - head : 0;
+}
+
+unsigned int mpmc_queue_capacity(mpmc_queue_t *q) {
+  return q->mask + 1;
+}
+
+void mpmc_queue_delete(mpmc_queue_t *q) {
+  free(q->cells);
+  free(q);
+}
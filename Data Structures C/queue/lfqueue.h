@@ -0,0 +1,87 @@
+/**
+ * Lock-free bounded queues of longs, for handing work between threads.
+ *
+ * - spsc_queue_t: wait-free, exactly one producer and one consumer thread
+ * - mpmc_queue_t: lock-free, any number of producers and consumers
+ *
+ * Both mirror queue_t's interface, except that enqueue and dequeue can fail
+ * (another thread may fill or drain the queue between a check and the
+ * operation), so they report whether they succeeded instead of asserting.
+ *
+ * Capacities are rounded up to a power of two so slots are found with a mask.
+ * Sizes are snapshots: with other threads running they may be stale as soon
+ * as they are returned.
+ */
+#ifndef _LFQUEUE_H
+#define _LFQUEUE_H
+
+/** Single-producer/single-consumer queue (fields are hidden). */
+typedef struct spsc_queue spsc_queue_t;
+
+/** Multi-producer/multi-consumer queue (fields are hidden). */
+typedef struct mpmc_queue mpmc_queue_t;
+
+/**
+ * Construct a new empty SPSC queue holding at least capacity items.
+ *
+ * Returns NULL on error.
+ */
+spsc_queue_t *spsc_queue_new(unsigned int capacity);
+
+/**
+ * Enqueue an item. Must only be called from the producer thread.
+ *
+ * Returns a non-0 value on success, 0 if the queue is full.
+ */
+int spsc_queue_enqueue(spsc_queue_t *q, long item);
+
+/**
+ * Dequeue an item into *item. Must only be called from the consumer thread.
+ *
+ * Returns a non-0 value on success, 0 if the queue is empty.
+ */
+int spsc_queue_dequeue(spsc_queue_t *q, long *item);
+
+/** Number of items currently in the queue. */
+unsigned int spsc_queue_size(spsc_queue_t *q);
+
+/** Maximum number of items the queue can hold. */
+unsigned int spsc_queue_capacity(spsc_queue_t *q);
+
+/** Delete the queue. No other thread may be using it. */
+void spsc_queue_delete(spsc_queue_t *q);
+
+/**
+ * Construct a new empty MPMC queue holding at least capacity items.
+ *
+ * Returns NULL on error.
+ */
+mpmc_queue_t *mpmc_queue_new(unsigned int capacity);
+
+/**
+ * Enqueue an item. Safe to call from any thread.
+ *
+ * Returns a non-0 value on success, 0 if the queue is full.
+ */
+int mpmc_queue_enqueue(mpmc_queue_t *q, long item);
+
+/**
+ * Dequeue an item into *item. Safe to call from any thread.
+ *
+ * Returns a non-0 value on success, 0 if the queue is empty.
+ */
+int mpmc_queue_dequeue(mpmc_queue_t *q, long *item);
+
+/** Number of items currently in the queue. */
+unsigned int mpmc_queue_size(mpmc_queue_t *q);
+
+/** Maximum number of items the queue can hold. */
+unsigned int mpmc_queue_capacity(mpmc_queue_t *q);
+
+/** Delete the queue. No other thread may be using it. */
+void mpmc_queue_delete(mpmc_queue_t *q);
+
+/* Queue configuration. */
+#define LFQUEUE_CACHE_LINE 64
+
+#endif /* ifndef _LFQUEUE_H */
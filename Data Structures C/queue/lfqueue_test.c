@@ -0,0 +1,225 @@
+/**
+ * Unit tests for the lock-free queues.
+ *
+ * The single-threaded tests mirror queue_test.c; the threaded ones hand a
+ * stream of numbers through the queue and check nothing is lost, duplicated
+ * or (for SPSC) reordered. Waiting threads yield, so the tests also finish
+ * on machines with fewer cores than threads.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <munit.h>
+
+#include "lfqueue.h"
+
+#define STRESS_ITEMS 1000000
+#define MPMC_THREADS 4
+
+// Capacity is rounded up to a power of two
+MunitResult test_capacity(const MunitParameter params[], void *data) {
+  spsc_queue_t *s = spsc_queue_new(10);
+  mpmc_queue_t *m = mpmc_queue_new(16);
+
+  munit_assert_uint(spsc_queue_capacity(s), ==, 16);
+  munit_assert_uint(mpmc_queue_capacity(m), ==, 16);
+  munit_assert_null(spsc_queue_new(0));
+  munit_assert_null(mpmc_queue_new(0));
+
+  spsc_queue_delete(s);
+  mpmc_queue_delete(m);
+  return MUNIT_OK;
+}
+
+// Fill, overfill, drain, overdrain
+MunitResult test_spsc_full_empty(const MunitParameter params[], void *data) {
+  spsc_queue_t *q = spsc_queue_new(8);
+  long item;
+
+  munit_assert_false(spsc_queue_dequeue(q, &item));
+  for (long i = 0; i < 8; i++) {
+    munit_assert_true(spsc_queue_enqueue(q, i));
+    munit_assert_uint(spsc_queue_size(q), ==, i + 1);
+  }
+  munit_assert_false(spsc_queue_enqueue(q, 42));
+
+  for (long i = 0; i < 8; i++) {
+    munit_assert_true(spsc_queue_dequeue(q, &item));
+    munit_assert_long(item, ==, i);
+  }
+  munit_assert_false(spsc_queue_dequeue(q, &item));
+  munit_assert_uint(spsc_queue_size(q), ==, 0);
+
+  spsc_queue_delete(q);
+  return MUNIT_OK;
+}
+
+MunitResult test_mpmc_full_empty(const MunitParameter params[], void *data) {
+  mpmc_queue_t *q = mpmc_queue_new(8);
+  long item;
+
+  munit_assert_false(mpmc_queue_dequeue(q, &item));
+  for (long i = 0; i < 8; i++) {
+    munit_assert_true(mpmc_queue_enqueue(q, i));
+    munit_assert_uint(mpmc_queue_size(q), ==, i + 1);
+  }
+  munit_assert_false(mpmc_queue_enqueue(q, 42));
+
+  for (long i = 0; i < 8; i++) {
+    munit_assert_true(mpmc_queue_dequeue(q, &item));
+    munit_assert_long(item, ==, i);
+  }
+  munit_assert_false(mpmc_queue_dequeue(q, &item));
+  munit_assert_uint(mpmc_queue_size(q), ==, 0);
+
+  mpmc_queue_delete(q);
+  return MUNIT_OK;
+}
+
+// Multiple enqueues and dequeues, testing wraparound
+MunitResult test_wraparound(const MunitParameter params[], void *data) {
+  spsc_queue_t *s = spsc_queue_new(4);
+  mpmc_queue_t *m = mpmc_queue_new(4);
+  long next_in = 0, next_out = 0, item;
+
+  for (int round = 0; round < 100; round++) {
+    for (int i = 0; i < 3; i++, next_in++) {
+      munit_assert_true(spsc_queue_enqueue(s, next_in));
+      munit_assert_true(mpmc_queue_enqueue(m, next_in));
+    }
+    for (int i = 0; i < 3; i++, next_out++) {
+      munit_assert_true(spsc_queue_dequeue(s, &item));
+      munit_assert_long(item, ==, next_out);
+      munit_assert_true(mpmc_queue_dequeue(m, &item));
+      munit_assert_long(item, ==, next_out);
+    }
+  }
+
+  spsc_queue_delete(s);
+  mpmc_queue_delete(m);
+  return MUNIT_OK;
+}
+
+static void *spsc_producer(void *arg) {
+  spsc_queue_t *q = arg;
+  for (long i = 0; i < STRESS_ITEMS; i++) {
+    while (!spsc_queue_enqueue(q, i)) {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+// One producer, one consumer: everything arrives, in order
+MunitResult test_spsc_threads(const MunitParameter params[], void *data) {
+  spsc_queue_t *q = spsc_queue_new(64);
+  pthread_t producer;
+  pthread_create(&producer, NULL, spsc_producer, q);
+
+  long item;
+  for (long i = 0; i < STRESS_ITEMS; i++) {
+    while (!spsc_queue_dequeue(q, &item)) {
+      sched_yield();
+    }
+    munit_assert_long(item, ==, i);
+  }
+
+  pthread_join(producer, NULL);
+  munit_assert_uint(spsc_queue_size(q), ==, 0);
+  spsc_queue_delete(q);
+  return MUNIT_OK;
+}
+
+typedef struct {
+  mpmc_queue_t *q;
+  long sum;   /* Sum of the items a consumer got */
+  long count; /* Number of items a consumer got */
+} mpmc_arg_t;
+
+static void *mpmc_producer(void *ref) {
+  mpmc_arg_t *arg = ref;
+  for (long i = 1; i <= STRESS_ITEMS / MPMC_THREADS; i++) {
+    while (!mpmc_queue_enqueue(arg->q, i)) {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+static void *mpmc_consumer(void *ref) {
+  mpmc_arg_t *arg = ref;
+  long item;
+  while (arg->count < STRESS_ITEMS / MPMC_THREADS) {
+    if (mpmc_queue_dequeue(arg->q, &item)) {
+      arg->sum += item;
+      arg->count++;
+    } else {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+// Several producers and consumers: every item arrives exactly once
+MunitResult test_mpmc_threads(const MunitParameter params[], void *data) {
+  mpmc_queue_t *q = mpmc_queue_new(64);
+  pthread_t producers[MPMC_THREADS], consumers[MPMC_THREADS];
+  mpmc_arg_t args[MPMC_THREADS];
+
+  for (int i = 0; i < MPMC_THREADS; i++) {
+    args[i] = (mpmc_arg_t){q, 0, 0};
+    pthread_create(&consumers[i], NULL, mpmc_consumer, &args[i]);
+    pthread_create(&producers[i], NULL, mpmc_producer, &args[i]);
+  }
+
+  long sum = 0;
+  for (int i = 0; i < MPMC_THREADS; i++) {
+    pthread_join(producers[i], NULL);
+    pthread_join(consumers[i], NULL);
+    sum += args[i].sum;
+  }
+
+  // Each producer sent 1..n
+  long n = STRESS_ITEMS / MPMC_THREADS;
+  munit_assert_long(sum, ==, MPMC_THREADS * (n * (n + 1) / 2));
+  munit_assert_uint(mpmc_queue_size(q), ==, 0);
+
+  mpmc_queue_delete(q);
+  return MUNIT_OK;
+}
+
+#define MUNIT_SIMPLE(name, test_func, params) \
+  { \
+    name, /* name */ \
+    test_func, /* test */ \
+    NULL, /* setup */ \
+    NULL, /* tear_down */ \
+    MUNIT_TEST_OPTION_NONE, /* options */ \
+    params /* parameters */ \
+  }
+
+#define MUNIT_TESTS_END MUNIT_SIMPLE(NULL, NULL, NULL)
+
+MunitTest tests[] = {
+  MUNIT_SIMPLE("/Capacity rounding", test_capacity, NULL),
+  MUNIT_SIMPLE("/SPSC: full, empty", test_spsc_full_empty, NULL),
+  MUNIT_SIMPLE("/MPMC: full, empty", test_mpmc_full_empty, NULL),
+  MUNIT_SIMPLE("/Multiple en- and dequeues, wraparound", test_wraparound, NULL),
+  MUNIT_SIMPLE("/SPSC: producer and consumer threads", test_spsc_threads, NULL),
+  MUNIT_SIMPLE("/MPMC: producer and consumer threads", test_mpmc_threads, NULL),
+  MUNIT_TESTS_END
+};
+
+static const MunitSuite suite = {
+  "/lfqueue", /* name */
+  tests, /* tests */
+  NULL, /* suites */
+  1, /* iterations */
+  MUNIT_SUITE_OPTION_NONE /* options */
+};
+
+int main(int argc, char **argv) {
+  return munit_suite_main(&suite, NULL, argc, argv);
+}
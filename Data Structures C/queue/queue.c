@@ -8,6 +8,7 @@
  */
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "queue.h"
 
@@ -19,9 +20,105 @@ struct queue{
                            * (i.e. the front or head of the line) */
   unsigned int size;      /* How many total elements we currently have enqueued. */
   unsigned int capacity;  /* Maximum number of items the queue can hold */
+  unsigned int mask;      /* capacity - 1 if capacity is a power of two,
+                           * 0 otherwise (index with % capacity) */
+  unsigned int min_capacity; /* Growable queues: never shrink below this;
+                              * 0 for fixed-capacity queues */
   long *data;             /* The data our queue holds  */
 };
 
+/** Wrap a position in [0, 2 * capacity) back into [0, capacity). */
+static inline unsigned int queue_wrap(const queue_t *q, unsigned int pos) {
+  if (q->mask) {
+    return pos & q->mask;
+  }
+  return pos % q->capacity;
+}
+
+/** Mask for the given capacity (see struct queue). */
+static inline unsigned int queue_mask(unsigned int capacity) {
+  return (capacity & (capacity - 1)) == 0 ? capacity - 1 : 0;
+}
+
+/**
+ * Double a growable queue's ring.
+ *
+ * If the items wrap around the end of the old ring, the shorter of the two
+ * pieces is moved so they are contiguous (modulo the new capacity) again.
+ *
+ * Returns 0 on success, -1 if the ring cannot grow.
+ */
+static int queue_grow(queue_t *q) {
+  unsigned int cap = q->capacity;
+  if (cap >= (1u << 31)) {
+    return -1;
+  }
+
+  long *data = realloc(q->data, sizeof(long) * 2 * cap);
+  if (data == NULL) {
+    return -1;
+  }
+  q->data = data;
+
+  // Items are [front, cap) then, if they wrap, [0, back)
+  unsigned int head = cap - q->front;
+  if (q->size > head) {
+    unsigned int tail = q->size - head;
+    if (tail <= head) {
+      // Append the start of the old ring after its end
+      memcpy(data + cap, data, sizeof(long) * tail);
+    } else {
+      // Move the end of the old ring to the end of the new one
+      memcpy(data + q->front + cap, data + q->front, sizeof(long) * head);
+      q->front += cap;
+    }
+  }
+
+  q->capacity = 2 * cap;
+  q->mask = queue_mask(q->capacity);
+  q->back = queue_wrap(q, q->front + q->size);
+  return 0;
+}
+
+/**
+ * Halve a growable queue's ring while it is at most a quarter full.
+ *
+ * The quarter (rather than half) threshold keeps a queue hovering around a
+ * power of two from growing and shrinking on every other operation.
+ */
+static void queue_maybe_shrink(queue_t *q) {
+  unsigned int cap = q->capacity;
+  unsigned int new_cap = cap;
+  while (q->min_capacity != 0 && q->size <= new_cap / 4
+         && new_cap / 2 >= q->min_capacity) {
+    new_cap /= 2;
+  }
+  if (new_cap == cap) {
+    return;
+  }
+
+  unsigned int head = cap - q->front;
+  if (q->size <= head) {
+    // Contiguous: slide the items to the start
+    memmove(q->data, q->data + q->front, sizeof(long) * q->size);
+    q->front = 0;
+  } else {
+    // Wrapped: [0, back) stays, [front, cap) moves to the end of the new ring
+    memmove(q->data + new_cap - head, q->data + q->front, sizeof(long) * head);
+    q->front = new_cap - head;
+  }
+
+  // A failed shrink leaves the old (bigger) block, which is still fine
+  long *data = realloc(q->data, sizeof(long) * new_cap);
+  if (data != NULL) {
+    q->data = data;
+  }
+
+  q->capacity = new_cap;
+  q->mask = queue_mask(new_cap);
+  q->back = queue_wrap(q, q->front + q->size);
+}
+
 /** 
  * Construct a new empty queue.
  *
@@ -50,11 +147,46 @@ queue_t *queue_new(unsigned int capacity) {
   q->back = 0;
   q->front = 0;
   q->capacity =  capacity;
+  q->mask = queue_mask(capacity);
+  q->min_capacity = 0;
   q->size = 0;
 
   return q;
 }
 
+/**
+ * Construct a new empty queue whose capacity is rounded up to a power of two.
+ *
+ * Returns a pointer to a newly created queue.
+ * Return NULL on error (capacity 0 or above 2^31)
+ */
+queue_t *queue_new_pow2(unsigned int capacity) {
+  if (capacity == 0 || capacity > (1u << 31)) {
+    return NULL;
+  }
+
+  unsigned int cap = 1;
+  while (cap < capacity) {
+    cap <<= 1;
+  }
+
+  return queue_new(cap);
+}
+
+/**
+ * Construct a new empty growable queue.
+ *
+ * Returns a pointer to a newly created queue.
+ * Return NULL on error
+ */
+queue_t *queue_new_growable(unsigned int capacity) {
+  queue_t *q = queue_new(capacity);
+  if (q != NULL) {
+    q->min_capacity = capacity;
+  }
+  return q;
+}
+
 /**
  * Check if the given queue is empty.
  *
@@ -80,6 +212,9 @@ int queue_full(queue_t *q) {
   assert(q != NULL);
 
   /* [TODO] Complete the function */
+  if (q->min_capacity != 0 && q->capacity < (1u << 31)) {
+    return 0; //growable queues make room on enqueue
+  }
   if (q->capacity == q->size) {
     return 1; //if size reached max cap, return 1
   } else {
@@ -94,15 +229,15 @@ int queue_full(queue_t *q) {
  */
 void queue_enqueue(queue_t *q, long item) {
   assert(q != NULL);
-  assert(q->size < q->capacity);
+  assert(q->size < q->capacity || !queue_full(q));
 
   /* [TODO] Complete the function */
-  if (queue_full(q)) {
+  if (q->size == q->capacity && (q->min_capacity == 0 || queue_grow(q) != 0)) {
     return;
   }
 
   q->data[q->back] = item;  //add item to back
-  q->back = (q->back + 1) % q->capacity;  //update back
+  q->back = queue_wrap(q, q->back + 1);  //update back
   q->size++; //update size
 }
 
@@ -122,12 +257,85 @@ long queue_dequeue(queue_t *q) {
   /* [TODO] Complete the function */
   long item = q->data[q->front]; //get first item from queue
 
-  q->front = (q->front + 1) % q->capacity;  //update first item 
+  q->front = queue_wrap(q, q->front + 1);  //update first item
 
   q->size--;  //update size
+  queue_maybe_shrink(q);
   return item;
 }
 
+/**
+ * Enqueue up to n items.
+ *
+ * Copies items[0..n) to the back of the queue, stopping when it is full
+ * (growable queues grow to fit all n).
+ *
+ * Returns the number of items enqueued.
+ */
+unsigned int queue_enqueue_n(queue_t *q, const long *items, unsigned int n) {
+  assert(q != NULL);
+  assert(items != NULL || n == 0);
+
+  while (q->min_capacity != 0 && q->capacity - q->size < n) {
+    if (queue_grow(q) != 0) {
+      break;
+    }
+  }
+
+  unsigned int space = q->capacity - q->size;
+  if (n > space) {
+    n = space;
+  }
+  if (n == 0) {
+    return 0;
+  }
+
+  // The free span may wrap: fill up to the end of data, then from the start
+  unsigned int first = q->capacity - q->back;
+  if (first > n) {
+    first = n;
+  }
+  memcpy(q->data + q->back, items, sizeof(long) * first);
+  memcpy(q->data, items + first, sizeof(long) * (n - first));
+
+  q->back = queue_wrap(q, q->back + n);
+  q->size += n;
+  return n;
+}
+
+/**
+ * Dequeue up to n items.
+ *
+ * Moves items from the front of the queue into items[0..n), stopping when it
+ * is empty.
+ *
+ * Returns the number of items dequeued.
+ */
+unsigned int queue_dequeue_n(queue_t *q, long *items, unsigned int n) {
+  assert(q != NULL);
+  assert(items != NULL || n == 0);
+
+  if (n > q->size) {
+    n = q->size;
+  }
+  if (n == 0) {
+    return 0;
+  }
+
+  // The used span may wrap: read up to the end of data, then from the start
+  unsigned int first = q->capacity - q->front;
+  if (first > n) {
+    first = n;
+  }
+  memcpy(items, q->data + q->front, sizeof(long) * first);
+  memcpy(items + first, q->data, sizeof(long) * (n - first));
+
+  q->front = queue_wrap(q, q->front + n);
+  q->size -= n;
+  queue_maybe_shrink(q);
+  return n;
+}
+
 /** 
  * Queue size.
  *
@@ -140,6 +348,17 @@ unsigned int queue_size(queue_t *q) {
   return q->size; 
 }
 
+/**
+ * Queue capacity.
+ *
+ * Maximum number of items the queue can hold.
+ */
+unsigned int queue_capacity(queue_t *q) {
+  assert(q != NULL);
+
+  return q->capacity;
+}
+
 /** 
  * Delete queue.
  * 
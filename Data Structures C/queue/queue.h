@@ -19,6 +19,30 @@ typedef struct queue queue_t;
  */
 queue_t *queue_new(unsigned int capacity);
 
+/**
+ * Construct a new empty queue whose capacity is rounded up to a power of two.
+ *
+ * Power-of-two queues find slots with a mask instead of a modulo. (queue_new
+ * does the same when given a power of two.)
+ *
+ * Returns a pointer to a newly created queue.
+ * Return NULL on error (capacity 0 or above 2^31)
+ */
+queue_t *queue_new_pow2(unsigned int capacity);
+
+/**
+ * Construct a new empty growable queue.
+ *
+ * Instead of filling up, a growable queue doubles its capacity when an
+ * enqueue finds it full (amortized O(1) per item), and halves it again when
+ * it drops to a quarter full, but never below the initial capacity.
+ * queue_full only reports a growable queue full once it cannot grow further.
+ *
+ * Returns a pointer to a newly created queue.
+ * Return NULL on error
+ */
+queue_t *queue_new_growable(unsigned int capacity);
+
 /**
  * Check if the given queue is empty.
  *
@@ -51,6 +75,33 @@ void queue_enqueue(queue_t *q, long item);
  */
 long queue_dequeue(queue_t *q);
 
+/**
+ * Enqueue up to n items.
+ *
+ * Copies items[0..n) to the back of the queue, stopping when it is full
+ * (growable queues grow to fit all n).
+ *
+ * Returns the number of items enqueued.
+ */
+unsigned int queue_enqueue_n(queue_t *q, const long *items, unsigned int n);
+
+/**
+ * Dequeue up to n items.
+ *
+ * Moves items from the front of the queue into items[0..n), stopping when it
+ * is empty.
+ *
+ * Returns the number of items dequeued.
+ */
+unsigned int queue_dequeue_n(queue_t *q, long *items, unsigned int n);
+
+/**
+ * Queue capacity.
+ *
+ * Maximum number of items the queue can hold.
+ */
+unsigned int queue_capacity(queue_t *q);
+
 /** 
  * Queue size.
  *
@@ -0,0 +1,238 @@
+/**
+ * Benchmarks for the queues (see ../bench/bench.h).
+ *
+ *   make bench                       # all of them, into bench-results.csv
+ *   ./queue_bench /queue/batch       # just one, munit-style
+ *
+ * queue_t is timed at several capacities, the concurrent queues with 1..N
+ * producer/consumer pairs (on fewer cores than threads the waiting threads
+ * yield, so those numbers mostly measure scheduling).
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <sched.h>
+#include <bench.h>
+
+#include "queue.h"
+#include "lfqueue.h"
+#include "bqueue.h"
+
+#define BATCH 64
+
+// One enqueue + one dequeue per op, keeping the queue half full
+MunitResult bench_queue(const MunitParameter params[], void *data) {
+  unsigned int capacity = bench_param(params, "capacity", 1024);
+  unsigned long ops = bench_ops();
+  queue_t *q = queue_new(capacity);
+
+  for (unsigned int i = 0; i < capacity / 2; i++) {
+    queue_enqueue(q, i);
+  }
+
+  long sum = 0;
+  double start = bench_now();
+  for (unsigned long i = 0; i < ops; i++) {
+    queue_enqueue(q, i);
+    sum += queue_dequeue(q);
+  }
+  bench_report("/queue/enqueue+dequeue", params, ops, bench_now() - start);
+
+  munit_assert_long(sum, >=, 0);
+  queue_delete(q);
+  return MUNIT_OK;
+}
+
+// The same through the batch calls, BATCH items at a time
+MunitResult bench_queue_batch(const MunitParameter params[], void *data) {
+  unsigned int capacity = bench_param(params, "capacity", 1024);
+  unsigned long ops = bench_ops();
+  queue_t *q = queue_new(capacity);
+  long in[BATCH], out[BATCH];
+  unsigned int batch = capacity < BATCH ? capacity : BATCH;
+
+  for (int i = 0; i < BATCH; i++) {
+    in[i] = i;
+  }
+
+  double start = bench_now();
+  for (unsigned long i = 0; i < ops; i += batch) {
+    queue_enqueue_n(q, in, batch);
+    queue_dequeue_n(q, out, batch);
+  }
+  bench_report("/queue/batch", params, ops, bench_now() - start);
+
+  queue_delete(q);
+  return MUNIT_OK;
+}
+
+typedef struct {
+  void *q;
+  unsigned long items;  /* Items this thread moves */
+  long sum;
+} worker_t;
+
+static void *spsc_producer(void *ref) {
+  worker_t *w = ref;
+  for (unsigned long i = 0; i < w->items; i++) {
+    while (!spsc_queue_enqueue(w->q, i)) {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+static void *mpmc_producer(void *ref) {
+  worker_t *w = ref;
+  for (unsigned long i = 0; i < w->items; i++) {
+    while (!mpmc_queue_enqueue(w->q, i)) {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+static void *mpmc_consumer(void *ref) {
+  worker_t *w = ref;
+  long item;
+  for (unsigned long i = 0; i < w->items; i++) {
+    while (!mpmc_queue_dequeue(w->q, &item)) {
+      sched_yield();
+    }
+    w->sum += item;
+  }
+  return NULL;
+}
+
+static void *bqueue_producer(void *ref) {
+  worker_t *w = ref;
+  for (unsigned long i = 0; i < w->items; i++) {
+    bqueue_push(w->q, i);
+  }
+  return NULL;
+}
+
+static void *bqueue_consumer(void *ref) {
+  worker_t *w = ref;
+  long item;
+  for (unsigned long i = 0; i < w->items; i++) {
+    bqueue_pop(w->q, &item);
+    w->sum += item;
+  }
+  return NULL;
+}
+
+// One producer thread, the test thread consumes
+MunitResult bench_spsc(const MunitParameter params[], void *data) {
+  unsigned long ops = bench_ops();
+  spsc_queue_t *q = spsc_queue_new(bench_param(params, "capacity", 1024));
+  worker_t producer = {q, ops, 0};
+  pthread_t thread;
+
+  double start = bench_now();
+  pthread_create(&thread, NULL, spsc_producer, &producer);
+  long item;
+  for (unsigned long i = 0; i < ops; i++) {
+    while (!spsc_queue_dequeue(q, &item)) {
+      sched_yield();
+    }
+  }
+  pthread_join(thread, NULL);
+  bench_report("/spsc/transfer", params, ops, bench_now() - start);
+
+  spsc_queue_delete(q);
+  return MUNIT_OK;
+}
+
+/** Run threads producer/consumer pairs over q; returns seconds taken. */
+static double run_pairs(void *q, int threads, unsigned long ops,
+                        void *(*produce)(void *), void *(*consume)(void *)) {
+  pthread_t producers[threads], consumers[threads];
+  worker_t workers[threads];
+
+  double start = bench_now();
+  for (int i = 0; i < threads; i++) {
+    workers[i] = (worker_t){q, ops / threads, 0};
+    pthread_create(&consumers[i], NULL, consume, &workers[i]);
+    pthread_create(&producers[i], NULL, produce, &workers[i]);
+  }
+  for (int i = 0; i < threads; i++) {
+    pthread_join(producers[i], NULL);
+    pthread_join(consumers[i], NULL);
+  }
+  return bench_now() - start;
+}
+
+MunitResult bench_mpmc(const MunitParameter params[], void *data) {
+  int threads = bench_param(params, "threads", 1);
+  unsigned long ops = bench_ops() / threads * threads;
+  mpmc_queue_t *q = mpmc_queue_new(1024);
+
+  double secs = run_pairs(q, threads, ops, mpmc_producer, mpmc_consumer);
+  bench_report("/mpmc/transfer", params, ops, secs);
+
+  mpmc_queue_delete(q);
+  return MUNIT_OK;
+}
+
+MunitResult bench_bqueue(const MunitParameter params[], void *data) {
+  int threads = bench_param(params, "threads", 1);
+  unsigned long ops = bench_ops() / threads * threads;
+  bqueue_t *q = bqueue_new(1024);
+
+  double secs = run_pairs(q, threads, ops, bqueue_producer, bqueue_consumer);
+  bench_report("/bqueue/transfer", params, ops, secs);
+
+  bqueue_delete(q);
+  return MUNIT_OK;
+}
+
+static char *capacities[] = {
+  (char *) "16", (char *) "1024", (char *) "1048576", NULL
+};
+
+static char *thread_counts[] = {
+  (char *) "1", (char *) "2", (char *) "4", NULL
+};
+
+static MunitParameterEnum capacity_params[] = {
+  { (char *) "capacity", capacities },
+  { NULL, NULL },
+};
+
+static MunitParameterEnum thread_params[] = {
+  { (char *) "threads", thread_counts },
+  { NULL, NULL },
+};
+
+#define MUNIT_SIMPLE(name, test_func, params) \
+  { \
+    name, /* name */ \
+    test_func, /* test */ \
+    NULL, /* setup */ \
+    NULL, /* tear_down */ \
+    MUNIT_TEST_OPTION_NONE, /* options */ \
+    params /* parameters */ \
+  }
+
+#define MUNIT_TESTS_END MUNIT_SIMPLE(NULL, NULL, NULL)
+
+MunitTest tests[] = {
+  MUNIT_SIMPLE("/queue/enqueue+dequeue", bench_queue, capacity_params),
+  MUNIT_SIMPLE("/queue/batch", bench_queue_batch, capacity_params),
+  MUNIT_SIMPLE("/spsc/transfer", bench_spsc, capacity_params),
+  MUNIT_SIMPLE("/mpmc/transfer", bench_mpmc, thread_params),
+  MUNIT_SIMPLE("/bqueue/transfer", bench_bqueue, thread_params),
+  MUNIT_TESTS_END
+};
+
+static const MunitSuite suite = {
+  "", /* name */
+  tests, /* tests */
+  NULL, /* suites */
+  1, /* iterations */
+  MUNIT_SUITE_OPTION_NONE /* options */
+};
+
+int main(int argc, char **argv) {
+  return munit_suite_main(&suite, NULL, argc, argv);
+}
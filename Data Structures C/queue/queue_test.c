@@ -194,6 +194,146 @@ MunitResult test5(const MunitParameter params[], void *data) {
   return MUNIT_OK;
 }
 
+// Power-of-two capacities
+MunitResult test6(const MunitParameter params[], void *data) {
+  munit_assert_null(queue_new_pow2(0));
+
+  queue_t *test6 = queue_new_pow2(5);
+  munit_assert_uint(queue_capacity(test6), ==, 8);
+
+  // Go around the ring a few times so positions wrap through the mask
+  for (int i = 0; i < 20; i++) {
+    queue_enqueue(test6, i);
+    queue_enqueue(test6, i + 100);
+    munit_assert_long(queue_dequeue(test6), ==, i);
+    munit_assert_long(queue_dequeue(test6), ==, i + 100);
+  }
+  munit_assert_true(queue_empty(test6));
+
+  queue_delete(test6);
+
+  queue_t *one = queue_new_pow2(1);
+  munit_assert_uint(queue_capacity(one), ==, 1);
+  queue_enqueue(one, 7);
+  munit_assert_true(queue_full(one));
+  munit_assert_long(queue_dequeue(one), ==, 7);
+  queue_delete(one);
+
+  return MUNIT_OK;
+}
+
+// Batch en- and dequeues, with wraparound and partial transfers
+MunitResult test7(const MunitParameter params[], void *data) {
+  long in[16], out[16];
+  for (int i = 0; i < 16; i++) {
+    in[i] = i + 1;
+  }
+
+  // Non-power-of-two capacity uses the modulo path
+  queue_t *test7 = queue_new(10);
+
+  munit_assert_uint(queue_enqueue_n(test7, in, 7), ==, 7);
+  munit_assert_uint(queue_dequeue_n(test7, out, 5), ==, 5);
+  for (int i = 0; i < 5; i++) {
+    munit_assert_long(out[i], ==, i + 1);
+  }
+
+  // back is at 7: this span wraps, and only 8 of 16 fit
+  munit_assert_uint(queue_enqueue_n(test7, in + 7, 9), ==, 8);
+  munit_assert_true(queue_full(test7));
+  munit_assert_uint(queue_enqueue_n(test7, in, 3), ==, 0);
+
+  // Single-item operations see the batch items in order
+  munit_assert_long(queue_dequeue(test7), ==, 6);
+
+  // front is at 6: this span wraps, and only 9 are there
+  munit_assert_uint(queue_dequeue_n(test7, out, 16), ==, 9);
+  munit_assert_long(out[0], ==, 7);
+  for (int i = 1; i < 9; i++) {
+    munit_assert_long(out[i], ==, i + 7);
+  }
+  munit_assert_true(queue_empty(test7));
+  munit_assert_uint(queue_dequeue_n(test7, out, 4), ==, 0);
+
+  queue_delete(test7);
+
+  // Power-of-two capacity uses the mask path
+  queue_t *pow2 = queue_new_pow2(8);
+  for (int round = 0; round < 5; round++) {
+    munit_assert_uint(queue_enqueue_n(pow2, in, 5), ==, 5);
+    munit_assert_uint(queue_dequeue_n(pow2, out, 5), ==, 5);
+    munit_assert_memory_equal(sizeof(long) * 5, out, in);
+  }
+  queue_delete(pow2);
+
+  return MUNIT_OK;
+}
+
+// Growable queue: doubling with wrapped contents, then shrinking
+MunitResult test8(const MunitParameter params[], void *data) {
+  queue_t *test8 = queue_new_growable(4);
+  long next_in = 0, next_out = 0;
+
+  // Wrap the ring before it has to grow
+  for (int i = 0; i < 3; i++) {
+    queue_enqueue(test8, next_in++);
+  }
+  munit_assert_long(queue_dequeue(test8), ==, next_out++);
+  munit_assert_long(queue_dequeue(test8), ==, next_out++);
+
+  for (int i = 0; i < 1000; i++) {
+    munit_assert_false(queue_full(test8));
+    queue_enqueue(test8, next_in++);
+    munit_assert_uint(queue_size(test8), ==, next_in - next_out);
+    // Dequeue every third item so front keeps moving through the ring
+    if (i % 3 == 0) {
+      munit_assert_long(queue_dequeue(test8), ==, next_out++);
+    }
+  }
+  munit_assert_uint(queue_capacity(test8), >=, queue_size(test8));
+  munit_assert_uint(queue_capacity(test8), <, 4 * queue_size(test8));
+
+  while (!queue_empty(test8)) {
+    munit_assert_long(queue_dequeue(test8), ==, next_out++);
+    munit_assert_uint(queue_capacity(test8), >=, queue_size(test8));
+  }
+  munit_assert_long(next_out, ==, next_in);
+  munit_assert_uint(queue_capacity(test8), ==, 4);
+
+  queue_delete(test8);
+
+  return MUNIT_OK;
+}
+
+// Growable queue with a non-power-of-two capacity and batch operations
+MunitResult test9(const MunitParameter params[], void *data) {
+  long in[100], out[100];
+  for (int i = 0; i < 100; i++) {
+    in[i] = i;
+  }
+
+  queue_t *test9 = queue_new_growable(3);
+  munit_assert_uint(queue_enqueue_n(test9, in, 2), ==, 2);
+  munit_assert_uint(queue_dequeue_n(test9, out, 1), ==, 1);
+
+  // Wrapped and not full: the batch needs two doublings
+  munit_assert_uint(queue_enqueue_n(test9, in + 2, 9), ==, 9);
+  munit_assert_uint(queue_capacity(test9), ==, 12);
+  munit_assert_uint(queue_enqueue_n(test9, in + 11, 89), ==, 89);
+  munit_assert_uint(queue_size(test9), ==, 99);
+
+  munit_assert_uint(queue_dequeue_n(test9, out, 97), ==, 97);
+  munit_assert_memory_equal(sizeof(long) * 97, out, in + 1);
+  munit_assert_uint(queue_capacity(test9), ==, 6);
+  munit_assert_long(queue_dequeue(test9), ==, 98);
+  munit_assert_long(queue_dequeue(test9), ==, 99);
+  munit_assert_uint(queue_capacity(test9), ==, 3);
+
+  queue_delete(test9);
+
+  return MUNIT_OK;
+}
+
 
 #define MUNIT_SIMPLE(name, test_func, params) \
   { \
@@ -214,6 +354,10 @@ MunitTest tests[] = {
   MUNIT_SIMPLE("/10-element queue", test3, NULL),
   MUNIT_SIMPLE("/32-element queue", test4, NULL),
   MUNIT_SIMPLE("/Multiple en- and dequeues, wraparound", test5, NULL),
+  MUNIT_SIMPLE("/Power-of-two capacity", test6, NULL),
+  MUNIT_SIMPLE("/Batch en- and dequeues", test7, NULL),
+  MUNIT_SIMPLE("/Growable queue", test8, NULL),
+  MUNIT_SIMPLE("/Growable queue, batches", test9, NULL),
   MUNIT_TESTS_END
 };
 
@@ -0,0 +1,311 @@
+/**
+ * Concurrent vector implementation.
+ *
+ * Writers serialise on a mutex. Every block a writer unlinks (an outgrown
+ * array, a replaced or removed string) goes on a retired list tagged with a
+ * fresh value of the global epoch. Each reader publishes the epoch it last
+ * saw in cvect_quiescent; a retired block is freed once every registered
+ * reader has seen an epoch at least as new as its tag, since then no reader
+ * can still hold a snapshot from before the block was unlinked.
+ *
+ * A reader whose cvect_quiescent read an epoch at or after a block's tag
+ * reads the replacement from then on (the unlink happens before the epoch
+ * bump), and it was done with the old block before it published that
+ * epoch. The epoch and array pointer are sequentially consistent; on x86
+ * that only costs a reader a fence in cvect_quiescent, not in snapshots.
+ */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cvect.h"
+#include "vect.h"
+
+/** A backing array; never moves, only replaced by a bigger one. */
+typedef struct {
+  _Atomic unsigned int size;   /* Elements in use (grows in place) */
+  unsigned int capacity;
+  _Atomic(char *) data[];
+} cvect_array_t;
+
+/** A block waiting for the readers to move on. */
+typedef struct cvect_retired {
+  struct cvect_retired *next;
+  void *block;
+  uint64_t epoch;              /* Free once every reader has seen this */
+} cvect_retired_t;
+
+struct cvect_reader {
+  _Alignas(CVECT_CACHE_LINE)
+  _Atomic uint64_t seen;       /* Last epoch seen; 0 if the slot is free */
+  cvect_t *v;
+};
+
+struct cvect {
+  _Atomic(cvect_array_t *) array;
+  _Atomic uint64_t epoch;
+  pthread_mutex_t lock;        /* Serialises writers */
+  cvect_retired_t *retired;    /* Guarded by lock */
+  unsigned int pending;        /* Length of retired */
+  struct cvect_reader readers[CVECT_MAX_READERS];
+};
+
+/** Copy a string (NULL stays NULL); NULL on allocation failure. */
+static char *copy_string(const char *elt, int *failed) {
+  *failed = 0;
+  if (elt == NULL) {
+    return NULL;
+  }
+  size_t len = strlen(elt) + 1;
+  char *copy = malloc(len);
+  if (copy == NULL) {
+    *failed = 1;
+    return NULL;
+  }
+  memcpy(copy, elt, len);
+  return copy;
+}
+
+static cvect_array_t *array_new(unsigned int capacity) {
+  cvect_array_t *a = malloc(sizeof(cvect_array_t)
+                            + (size_t) capacity * sizeof(_Atomic(char *)));
+  if (a == NULL) {
+    return NULL;
+  }
+  atomic_init(&a->size, 0);
+  a->capacity = capacity;
+  return a;
+}
+
+/** Free retired blocks no reader can see any more. Call with lock held. */
+static void reclaim(cvect_t *v) {
+  uint64_t oldest = UINT64_MAX;
+  for (int i = 0; i < CVECT_MAX_READERS; i++) {
+    uint64_t seen = atomic_load(&v->readers[i].seen);
+    if (seen != 0 && seen < oldest) {
+      oldest = seen;
+    }
+  }
+
+  cvect_retired_t **link = &v->retired;
+  while (*link != NULL) {
+    cvect_retired_t *r = *link;
+    if (r->epoch <= oldest) {
+      *link = r->next;
+      free(r->block);
+      free(r);
+      v->pending--;
+    } else {
+      link = &r->next;
+    }
+  }
+}
+
+/** Retire a block that was just unlinked. Call with lock held. */
+static void retire(cvect_t *v, void *block) {
+  if (block == NULL) {
+    return;
+  }
+
+  cvect_retired_t *r = malloc(sizeof(cvect_retired_t));
+  if (r == NULL) {
+    // Can't track it, so it can never be freed safely: leak it
+    return;
+  }
+  r->block = block;
+  r->epoch = atomic_fetch_add(&v->epoch, 1) + 1;
+  r->next = v->retired;
+  v->retired = r;
+  v->pending++;
+
+  reclaim(v);
+}
+
+cvect_t *cvect_new() {
+  // malloc only guarantees 16-byte alignment; the reader slots need 64.
+  // aligned_alloc wants a multiple of the alignment (sizeof already is one)
+  size_t size = (sizeof(cvect_t) + CVECT_CACHE_LINE - 1) / CVECT_CACHE_LINE * CVECT_CACHE_LINE;
+  cvect_t *v = aligned_alloc(CVECT_CACHE_LINE, size);
+  if (v == NULL) {
+    return NULL;
+  }
+
+  cvect_array_t *a = array_new(VECT_INITIAL_CAPACITY);
+  if (a == NULL) {
+    free(v);
+    return NULL;
+  }
+
+  atomic_init(&v->array, a);
+  atomic_init(&v->epoch, 1);
+  pthread_mutex_init(&v->lock, NULL);
+  v->retired = NULL;
+  v->pending = 0;
+  for (int i = 0; i < CVECT_MAX_READERS; i++) {
+    atomic_init(&v->readers[i].seen, 0);
+    v->readers[i].v = v;
+  }
+  return v;
+}
+
+void cvect_delete(cvect_t *v) {
+  if (v == NULL) return; // for null
+
+  cvect_array_t *a = atomic_load(&v->array);
+  for (unsigned int i = 0; i < a->size; i++) {
+    free(atomic_load_explicit(&a->data[i], memory_order_relaxed));
+  }
+  free(a);
+
+  while (v->retired) {
+    cvect_retired_t *next = v->retired->next;
+    free(v->retired->block);
+    free(v->retired);
+    v->retired = next;
+  }
+
+  pthread_mutex_destroy(&v->lock);
+  free(v);
+}
+
+void cvect_add(cvect_t *v, const char *elt) {
+  if (!v) return; // for null
+
+  int failed;
+  char *copy = copy_string(elt, &failed);
+  if (failed) return; // for alloc fail
+
+  pthread_mutex_lock(&v->lock);
+  cvect_array_t *a = atomic_load_explicit(&v->array, memory_order_relaxed);
+  unsigned int size = atomic_load_explicit(&a->size, memory_order_relaxed);
+
+  if (size == a->capacity) {
+    // Copy on grow: readers keep using the old array until they move on
+    if (a->capacity > VECT_MAX_CAPACITY / VECT_GROWTH_FACTOR) {
+      pthread_mutex_unlock(&v->lock);
+      free(copy);
+      return; // for overflow
+    }
+    cvect_array_t *bigger = array_new(a->capacity * VECT_GROWTH_FACTOR);
+    if (bigger == NULL) {
+      pthread_mutex_unlock(&v->lock);
+      free(copy);
+      return; // for alloc fail
+    }
+    for (unsigned int i = 0; i < size; i++) {
+      atomic_init(&bigger->data[i],
+                  atomic_load_explicit(&a->data[i], memory_order_relaxed));
+    }
+    atomic_init(&bigger->size, size);
+
+    atomic_store(&v->array, bigger);
+    retire(v, a);
+    a = bigger;
+  }
+
+  // Fill the slot before making it visible
+  atomic_store_explicit(&a->data[size], copy, memory_order_relaxed);
+  atomic_store_explicit(&a->size, size + 1, memory_order_release);
+  pthread_mutex_unlock(&v->lock);
+}
+
+void cvect_set(cvect_t *v, unsigned int idx, const char *elt) {
+  if (!v) return; // for null
+
+  int failed;
+  char *copy = copy_string(elt, &failed);
+  if (failed) return; // for alloc fail
+
+  pthread_mutex_lock(&v->lock);
+  cvect_array_t *a = atomic_load_explicit(&v->array, memory_order_relaxed);
+  if (idx >= atomic_load_explicit(&a->size, memory_order_relaxed)) {
+    pthread_mutex_unlock(&v->lock);
+    free(copy);
+    return; // for out of bounds
+  }
+
+  char *old = atomic_exchange_explicit(&a->data[idx], copy,
+                                       memory_order_acq_rel);
+  retire(v, old);
+  pthread_mutex_unlock(&v->lock);
+}
+
+void cvect_remove_last(cvect_t *v) {
+  if (!v) return; // for null
+
+  pthread_mutex_lock(&v->lock);
+  cvect_array_t *a = atomic_load_explicit(&v->array, memory_order_relaxed);
+  unsigned int size = atomic_load_explicit(&a->size, memory_order_relaxed);
+  if (size > 0) {
+    atomic_store(&a->size, size - 1);
+    char *old = atomic_exchange_explicit(&a->data[size - 1], NULL,
+                                         memory_order_acq_rel);
+    retire(v, old);
+  }
+  pthread_mutex_unlock(&v->lock);
+}
+
+unsigned int cvect_size(cvect_t *v) {
+  if (!v) return 0; // for null
+
+  // Under the lock: the caller need not be a registered reader
+  pthread_mutex_lock(&v->lock);
+  cvect_array_t *a = atomic_load_explicit(&v->array, memory_order_relaxed);
+  unsigned int size = atomic_load_explicit(&a->size, memory_order_relaxed);
+  pthread_mutex_unlock(&v->lock);
+  return size;
+}
+
+unsigned int cvect_pending(cvect_t *v) {
+  if (!v) return 0; // for null
+
+  pthread_mutex_lock(&v->lock);
+  reclaim(v);
+  unsigned int pending = v->pending;
+  pthread_mutex_unlock(&v->lock);
+  return pending;
+}
+
+cvect_reader_t *cvect_reader_new(cvect_t *v) {
+  if (!v) return NULL; // for null
+
+  for (int i = 0; i < CVECT_MAX_READERS; i++) {
+    uint64_t free_slot = 0;
+    uint64_t now = atomic_load(&v->epoch);
+    if (atomic_compare_exchange_strong(&v->readers[i].seen, &free_slot, now)) {
+      return &v->readers[i];
+    }
+  }
+  return NULL;
+}
+
+void cvect_reader_delete(cvect_reader_t *r) {
+  if (!r) return; // for null
+
+  atomic_store(&r->seen, 0);
+}
+
+void cvect_quiescent(cvect_reader_t *r) {
+  atomic_store(&r->seen, atomic_load(&r->v->epoch));
+}
+
+cvect_snapshot_t cvect_snapshot(cvect_t *v) {
+  cvect_array_t *a = atomic_load(&v->array);
+  cvect_snapshot_t s = {
+    a, atomic_load_explicit(&a->size, memory_order_acquire)
+  };
+  return s;
+}
+
+unsigned int cvect_snapshot_size(const cvect_snapshot_t *s) {
+  return s->size;
+}
+
+const char *cvect_snapshot_get(const cvect_snapshot_t *s, unsigned int idx) {
+  if (idx >= s->size) return NULL; // for out of bounds
+
+  cvect_array_t *a = (cvect_array_t *) s->array;
+  return atomic_load_explicit(&a->data[idx], memory_order_acquire);
+}
@@ -0,0 +1,90 @@
+/**
+ * Concurrent read-mostly vector of strings.
+ *
+ * Any number of reader threads can look at the vector while writers change
+ * it. Readers work on snapshots: taking one is an atomic load of the current
+ * backing array (plus one of its size), and never blocks, writes shared
+ * memory or allocates. Writers take a lock, append into spare capacity, and
+ * when the array is full copy it into a bigger one and publish that instead.
+ * Arrays and strings that a writer replaces are retired, and only freed once
+ * every reader has passed a quiescent state (QSBR-style RCU):
+ *
+ *   cvect_reader_t *r = cvect_reader_new(v);   // once per reader thread
+ *   for (;;) {
+ *     cvect_snapshot_t s = cvect_snapshot(v);
+ *     for (unsigned int i = 0; i < cvect_snapshot_size(&s); i++) {
+ *       ... cvect_snapshot_get(&s, i) ...
+ *     }
+ *     cvect_quiescent(r);                      // s is dead from here on
+ *   }
+ *   cvect_reader_delete(r);
+ *
+ * A snapshot sees the elements that existed when it was taken; cvect_set on
+ * one of them may or may not be visible. Strings from a snapshot stay valid
+ * until the reader's next cvect_quiescent. A reader that holds no snapshot
+ * for a long time should still call cvect_quiescent now and then, or
+ * retired memory piles up.
+ */
+#ifndef _CVECT_H
+#define _CVECT_H
+
+/** Concurrent vector (fields are hidden). */
+typedef struct cvect cvect_t;
+
+/** A registered reader thread (fields are hidden). */
+typedef struct cvect_reader cvect_reader_t;
+
+/** A reader's view of the vector. */
+typedef struct {
+  const void *array;  /* The backing array at the time of the snapshot */
+  unsigned int size;  /* Elements visible in this snapshot */
+} cvect_snapshot_t;
+
+/** Construct a new empty vector. Returns NULL on error. */
+cvect_t *cvect_new();
+
+/** Delete the vector. No other thread may be using it. */
+void cvect_delete(cvect_t *v);
+
+/** Add a copy of elt to the back of the vector. Safe from any thread. */
+void cvect_add(cvect_t *v, const char *elt);
+
+/** Replace the element at the given index with a copy of elt. */
+void cvect_set(cvect_t *v, unsigned int idx, const char *elt);
+
+/** Remove the last element from the vector. */
+void cvect_remove_last(cvect_t *v);
+
+/** The number of items currently in the vector (takes the writer lock). */
+unsigned int cvect_size(cvect_t *v);
+
+/** Retired arrays and strings not freed yet. */
+unsigned int cvect_pending(cvect_t *v);
+
+/**
+ * Register the calling thread as a reader.
+ *
+ * Returns NULL if CVECT_MAX_READERS readers are already registered.
+ */
+cvect_reader_t *cvect_reader_new(cvect_t *v);
+
+/** Unregister a reader; its snapshots are dead from here on. */
+void cvect_reader_delete(cvect_reader_t *r);
+
+/** Announce that the reader holds no snapshot taken before this call. */
+void cvect_quiescent(cvect_reader_t *r);
+
+/** Take a snapshot (the calling thread must be a registered reader). */
+cvect_snapshot_t cvect_snapshot(cvect_t *v);
+
+/** The number of items in the snapshot. */
+unsigned int cvect_snapshot_size(const cvect_snapshot_t *s);
+
+/** The element at the given index of the snapshot (NULL if out of range). */
+const char *cvect_snapshot_get(const cvect_snapshot_t *s, unsigned int idx);
+
+/* Vector configuration. */
+#define CVECT_MAX_READERS 64
+#define CVECT_CACHE_LINE 64 /* Each reader slot gets a cache line of its own */
+
+#endif /* ifndef _CVECT_H */
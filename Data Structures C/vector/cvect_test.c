@@ -0,0 +1,194 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <munit.h>
+
+#include "cvect.h"
+
+#define WRITER_ITEMS 20000
+#define READER_THREADS 3
+
+/* Writer operations as seen through fresh snapshots */
+MunitResult test_cvect_basic(const MunitParameter params[], void *data) {
+  cvect_t *v = cvect_new();
+  cvect_reader_t *r = cvect_reader_new(v);
+
+  cvect_add(v, "hello");
+  cvect_add(v, NULL);
+  cvect_add(v, "CS3650");
+  munit_assert_uint(cvect_size(v), ==, 3);
+
+  cvect_snapshot_t s = cvect_snapshot(v);
+  munit_assert_uint(cvect_snapshot_size(&s), ==, 3);
+  munit_assert_string_equal(cvect_snapshot_get(&s, 0), "hello");
+  munit_assert_null(cvect_snapshot_get(&s, 1));
+  munit_assert_string_equal(cvect_snapshot_get(&s, 2), "CS3650");
+  munit_assert_null(cvect_snapshot_get(&s, 3));
+  cvect_quiescent(r);
+
+  cvect_set(v, 1, "world");
+  cvect_set(v, 5, "out of bounds");
+  cvect_remove_last(v);
+  s = cvect_snapshot(v);
+  munit_assert_uint(cvect_snapshot_size(&s), ==, 2);
+  munit_assert_string_equal(cvect_snapshot_get(&s, 1), "world");
+
+  cvect_reader_delete(r);
+  cvect_delete(v);
+  return MUNIT_OK;
+}
+
+/* Old snapshots survive growth and replacement until the reader moves on */
+MunitResult test_cvect_retire(const MunitParameter params[], void *data) {
+  cvect_t *v = cvect_new();
+  cvect_reader_t *r = cvect_reader_new(v);
+
+  cvect_add(v, "first");
+  cvect_snapshot_t old = cvect_snapshot(v);
+  const char *first = cvect_snapshot_get(&old, 0);
+
+  // Outgrow the snapshot's array a few times and replace its element
+  char buf[32];
+  for (int i = 0; i < 100; i++) {
+    sprintf(buf, "item %d", i);
+    cvect_add(v, buf);
+  }
+  cvect_set(v, 0, "replaced");
+  munit_assert_uint(cvect_pending(v), >, 0);
+
+  // Still readable (the test runs under valgrind/ASan to catch misuse)
+  munit_assert_uint(cvect_snapshot_size(&old), ==, 1);
+  munit_assert_string_equal(cvect_snapshot_get(&old, 0), "first");
+  munit_assert_string_equal(first, "first");
+
+  cvect_quiescent(r);
+  munit_assert_uint(cvect_pending(v), ==, 0);
+
+  cvect_snapshot_t s = cvect_snapshot(v);
+  munit_assert_uint(cvect_snapshot_size(&s), ==, 101);
+  munit_assert_string_equal(cvect_snapshot_get(&s, 0), "replaced");
+  munit_assert_string_equal(cvect_snapshot_get(&s, 100), "item 99");
+
+  // Without readers, retired blocks are freed right away
+  cvect_reader_delete(r);
+  cvect_set(v, 1, "again");
+  munit_assert_uint(cvect_pending(v), ==, 0);
+
+  cvect_delete(v);
+  return MUNIT_OK;
+}
+
+/* There is a fixed number of reader slots, and they can be reused */
+MunitResult test_cvect_readers(const MunitParameter params[], void *data) {
+  cvect_t *v = cvect_new();
+  cvect_reader_t *readers[CVECT_MAX_READERS];
+
+  for (int i = 0; i < CVECT_MAX_READERS; i++) {
+    readers[i] = cvect_reader_new(v);
+    munit_assert_not_null(readers[i]);
+  }
+  munit_assert_null(cvect_reader_new(v));
+
+  cvect_reader_delete(readers[7]);
+  readers[7] = cvect_reader_new(v);
+  munit_assert_not_null(readers[7]);
+
+  for (int i = 0; i < CVECT_MAX_READERS; i++) {
+    cvect_reader_delete(readers[i]);
+  }
+  cvect_delete(v);
+  return MUNIT_OK;
+}
+
+typedef struct {
+  cvect_t *v;
+  atomic_int *done;
+  long passes;  /* Snapshots the reader checked */
+} reader_arg_t;
+
+static void *reader(void *ref) {
+  reader_arg_t *arg = ref;
+  cvect_reader_t *r = cvect_reader_new(arg->v);
+  char buf[32];
+
+  while (!atomic_load(arg->done)) {
+    cvect_snapshot_t s = cvect_snapshot(arg->v);
+    for (unsigned int i = 0; i < cvect_snapshot_size(&s); i++) {
+      sprintf(buf, "item %u", i);
+      if (strcmp(cvect_snapshot_get(&s, i), buf) != 0) {
+        cvect_reader_delete(r);
+        return (void *) 1;
+      }
+    }
+    arg->passes++;
+    cvect_quiescent(r);
+  }
+
+  cvect_reader_delete(r);
+  return NULL;
+}
+
+/* Readers iterate snapshots while a writer appends */
+MunitResult test_cvect_threads(const MunitParameter params[], void *data) {
+  cvect_t *v = cvect_new();
+  atomic_int done = 0;
+  pthread_t readers[READER_THREADS];
+  reader_arg_t args[READER_THREADS];
+
+  for (int i = 0; i < READER_THREADS; i++) {
+    args[i] = (reader_arg_t){v, &done, 0};
+    pthread_create(&readers[i], NULL, reader, &args[i]);
+  }
+
+  char buf[32];
+  for (int i = 0; i < WRITER_ITEMS; i++) {
+    sprintf(buf, "item %d", i);
+    cvect_add(v, buf);
+  }
+  atomic_store(&done, 1);
+
+  for (int i = 0; i < READER_THREADS; i++) {
+    void *failed;
+    pthread_join(readers[i], &failed);
+    munit_assert_null(failed);
+  }
+  munit_assert_uint(cvect_size(v), ==, WRITER_ITEMS);
+  munit_assert_uint(cvect_pending(v), ==, 0);
+
+  cvect_delete(v);
+  return MUNIT_OK;
+}
+
+#define MUNIT_SIMPLE(name, test_func, params) { \
+  name,                   /* name */            \
+  test_func,              /* test */            \
+  NULL,                   /* setup */           \
+  NULL,                   /* tear_down */       \
+  MUNIT_TEST_OPTION_NONE, /* options */         \
+  params                  /* parameters */      \
+}
+
+#define MUNIT_TESTS_END MUNIT_SIMPLE(NULL, NULL, NULL)
+
+MunitTest tests[] = {
+  MUNIT_SIMPLE("/basic", test_cvect_basic, NULL),
+  MUNIT_SIMPLE("/retire", test_cvect_retire, NULL),
+  MUNIT_SIMPLE("/readers", test_cvect_readers, NULL),
+  MUNIT_SIMPLE("/threads", test_cvect_threads, NULL),
+  MUNIT_TESTS_END
+};
+
+static const MunitSuite suite = {
+  "/cvect",
+  tests,
+  NULL,
+  1,
+  MUNIT_SUITE_OPTION_NONE
+};
+
+int main(int argc, char **argv) {
+  return munit_suite_main(&suite, NULL, argc, argv);
+}
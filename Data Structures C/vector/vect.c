@@ -11,32 +11,246 @@
  */
 #define _GNU_SOURCE
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "vect.h"
 
+/**
+ * A vector slot (as stored in SSO mode, and as built by slot_store).
+ *
+ * The last byte tags the slot: VECT_SLOT_HEAP means ptr holds a string (or
+ * NULL) the vector must free, VECT_SLOT_ARENA one that lives in the arena;
+ * anything else means the string is stored inline in sso and the tag is the
+ * number of unused bytes. A full 15-character string thus has a tag of 0,
+ * which doubles as its terminating '\0'.
+ *
+ * Without SSO nothing is inline, so the vector stores just the pointer
+ * (8 bytes a slot instead of 16): arena strings start on even addresses
+ * and are stored with the low bit set (VECT_PTR_ARENA), heap strings (from
+ * malloc, so aligned) as they are.
+ */
+typedef union {
+  char *ptr;
+  char sso[VECT_SSO_SIZE];
+} vect_slot_t;
+
+#define VECT_SLOT_TAG (VECT_SSO_SIZE - 1)
+#define VECT_SLOT_HEAP ((char) 0xff)
+#define VECT_SLOT_ARENA ((char) 0xfe)
+#define VECT_PTR_ARENA ((uintptr_t) 1)
+
+/** A chunk of arena memory holding string bytes back to back. */
+typedef struct vect_chunk {
+  struct vect_chunk *next; /* Previously filled chunk */
+  size_t used;             /* Bytes handed out */
+  size_t size;             /* Bytes in bytes[] */
+  char bytes[];
+} vect_chunk_t;
+
 /** Main data structure for the vector. */
 struct vect {
-  char **data;             /* Array containing the actual data. */
+  void *data;              /* Array containing the actual data (vect_slot_t in SSO mode, else char *). */
   unsigned int size;       /* Number of items currently in the vector. */
   unsigned int capacity;   /* Maximum number of items the vector can hold before growing. */
+  unsigned int mode;       /* VECT_MODE_* flags */
+  vect_chunk_t *arena;     /* Current arena chunk (VECT_MODE_ARENA) */
 };
 
+/** Bytes per slot in the vector's data. */
+static inline size_t slot_size(const vect_t *v) {
+  return (v->mode & VECT_MODE_SSO) ? sizeof(vect_slot_t) : sizeof(char *);
+}
+
+/** The string stored in a slot. */
+static inline const char *slot_get(const vect_slot_t *slot) {
+  char tag = slot->sso[VECT_SLOT_TAG];
+  if (tag == VECT_SLOT_HEAP || tag == VECT_SLOT_ARENA) {
+    return slot->ptr;
+  }
+  return slot->sso;
+}
+
+/** The string at index idx. */
+static inline const char *slot_string(const vect_t *v, unsigned int idx) {
+  if (v->mode & VECT_MODE_SSO) {
+    return slot_get((const vect_slot_t *) v->data + idx);
+  }
+  return (const char *) ((uintptr_t) ((char **) v->data)[idx] & ~VECT_PTR_ARENA);
+}
+
+/** A copy of the slot at index idx. */
+static vect_slot_t slot_load(const vect_t *v, unsigned int idx) {
+  if (v->mode & VECT_MODE_SSO) {
+    return ((const vect_slot_t *) v->data)[idx];
+  }
+
+  uintptr_t bits = (uintptr_t) ((char **) v->data)[idx];
+  vect_slot_t slot;
+  slot.ptr = (char *) (bits & ~VECT_PTR_ARENA);
+  slot.sso[VECT_SLOT_TAG] = (bits & VECT_PTR_ARENA) ? VECT_SLOT_ARENA : VECT_SLOT_HEAP;
+  return slot;
+}
+
+/** Put slot at index idx. */
+static void slot_put(vect_t *v, unsigned int idx, const vect_slot_t *slot) {
+  if (v->mode & VECT_MODE_SSO) {
+    ((vect_slot_t *) v->data)[idx] = *slot;
+    return;
+  }
+
+  uintptr_t bits = (uintptr_t) slot->ptr;
+  if (slot->sso[VECT_SLOT_TAG] == VECT_SLOT_ARENA) {
+    bits |= VECT_PTR_ARENA;
+  }
+  ((char **) v->data)[idx] = (char *) bits;
+}
+
+/**
+ * Copy n bytes into the vector's arena, at an even address (see
+ * VECT_PTR_ARENA); NULL on allocation failure.
+ */
+static char *arena_copy(vect_t *v, const char *bytes, size_t n) {
+  vect_chunk_t *chunk = v->arena;
+  size_t need = (n + 1) & ~(size_t) 1; // keeps every chunk->used even
+
+  if (chunk == NULL || chunk->size - chunk->used < need) {
+    size_t size = VECT_ARENA_CHUNK;
+    if (chunk != NULL) {
+      size = chunk->size < VECT_ARENA_MAX_CHUNK ? chunk->size * 2 : chunk->size;
+    }
+    if (size < need) {
+      size = need;
+    }
+
+    vect_chunk_t *fresh = malloc(sizeof(vect_chunk_t) + size);
+    if (!fresh) return NULL; // for alloc fail
+    fresh->next = chunk;
+    fresh->used = 0;
+    fresh->size = size;
+    v->arena = chunk = fresh;
+  }
+
+  char *copy = chunk->bytes + chunk->used;
+  memcpy(copy, bytes, n);
+  chunk->used += need;
+  return copy;
+}
+
+/**
+ * Make slot hold a copy of elt (or NULL), per the vector's mode. slot is
+ * a local to be put in the vector afterwards, so elt may be a string
+ * stored inline in the vector.
+ *
+ * Returns 0 on success, -1 on allocation failure.
+ */
+static int slot_store(vect_t *v, vect_slot_t *slot, const char *elt) {
+  if (!elt) {
+    slot->ptr = NULL;
+    slot->sso[VECT_SLOT_TAG] = VECT_SLOT_HEAP;
+    return 0;
+  }
+
+  size_t len = strlen(elt);
+  if ((v->mode & VECT_MODE_SSO) && len < VECT_SSO_SIZE) {
+    memset(slot->sso, 0, VECT_SSO_SIZE);
+    memcpy(slot->sso, elt, len);
+    slot->sso[VECT_SLOT_TAG] = VECT_SLOT_TAG - len;
+    return 0;
+  }
+
+  char *copy;
+  char tag;
+  if (v->mode & VECT_MODE_ARENA) {
+    copy = arena_copy(v, elt, len + 1);
+    assert(!copy || ((uintptr_t) copy & VECT_PTR_ARENA) == 0);
+    tag = VECT_SLOT_ARENA;
+  } else {
+    copy = strdup(elt);
+    tag = VECT_SLOT_HEAP;
+  }
+  if (!copy) return -1; // for alloc fail
+
+  slot->ptr = copy;
+  slot->sso[VECT_SLOT_TAG] = tag;
+  return 0;
+}
+
+/** Store the heap string elt (or NULL) in slot as is, taking ownership. */
+static void slot_adopt(vect_slot_t *slot, char *elt) {
+  slot->ptr = elt;
+  slot->sso[VECT_SLOT_TAG] = VECT_SLOT_HEAP;
+}
+
+/** Free what a slot owns (only heap strings own memory of their own). */
+static void slot_release(vect_slot_t *slot) {
+  if (slot->sso[VECT_SLOT_TAG] == VECT_SLOT_HEAP) {
+    free(slot->ptr);
+  }
+}
+
+/**
+ * Grow the vector to hold at least min_capacity items. With geometric set,
+ * the capacity is multiplied by VECT_GROWTH_FACTOR until it is big enough.
+ * With old set, the old array is left for the caller to free (in *old, or
+ * NULL if the vector didn't grow), so strings inline in it stay readable.
+ *
+ * Returns 0 on success, -1 on allocation failure (the vector is unchanged).
+ */
+static int vect_grow(vect_t *v, unsigned int min_capacity, int geometric, void **old) {
+  if (old) *old = NULL;
+  if (min_capacity <= v->capacity) return 0;
+
+  unsigned int capacity = min_capacity;
+  if (geometric) {
+    capacity = v->capacity;
+    while (capacity < min_capacity) {
+      if (capacity > VECT_MAX_CAPACITY / VECT_GROWTH_FACTOR) {
+        capacity = VECT_MAX_CAPACITY; // for overflow
+        break;
+      }
+      capacity *= VECT_GROWTH_FACTOR;
+    }
+  }
+
+  void *newData;
+  if (old) {
+    newData = malloc((size_t) capacity * slot_size(v));
+    if (!newData) return -1; // for malloc error
+    memcpy(newData, v->data, (size_t) v->size * slot_size(v));
+    *old = v->data;
+  } else {
+    newData = realloc(v->data, (size_t) capacity * slot_size(v));
+    if (!newData) return -1; // for realloc error
+  }
+
+  v->data = newData;
+  v->capacity = capacity;
+  return 0;
+}
+
 /** Construct a new empty vector. */
 vect_t *vect_new() {
+  return vect_new_mode(0);
+}
+
+/** Construct a new empty vector with the given storage mode. */
+vect_t *vect_new_mode(unsigned int mode) {
 
   vect_t *v = malloc(sizeof(vect_t));
   if (!v) return NULL;  //malloc check
 
-  v->data = (char **) malloc(2 * sizeof(char *));
+  v->mode = mode;
+  v->data = malloc(VECT_INITIAL_CAPACITY * slot_size(v));
   if (!v->data) {  //malloc check
     free(v);
     return NULL;
   }
 
   v->size = 0;
-  v->capacity = 2;
+  v->capacity = VECT_INITIAL_CAPACITY;
+  v->arena = NULL;
 
   return v;
 }
@@ -46,8 +260,17 @@ void vect_delete(vect_t *v) {
 
   if (v == NULL) return; // for null
 
+  // Only heap strings (copies, or adopted ones) are freed one by one
   for (unsigned int i = 0; i < v->size; i++) {
-    free(v->data[i]);
+    vect_slot_t slot = slot_load(v, i);
+    slot_release(&slot);
+  }
+
+  // Arena strings go a few chunks at a time
+  while (v->arena) {
+    vect_chunk_t *next = v->arena->next;
+    free(v->arena);
+    v->arena = next;
   }
 
   free(v->data);
@@ -59,14 +282,15 @@ const char *vect_get(vect_t *v, unsigned int idx) {
 
   if (!v || idx >= v->size) return NULL; //for null
 
-  return v->data[idx];
+  return slot_string(v, idx);
 }
 
 /** Get a copy of the element at the given index. The caller is responsible
  *  for freeing the memory occupied by the copy. */
 char *vect_get_copy(vect_t *v, unsigned int idx) {
-  if (v == NULL || idx >= v->size || v->data[idx] == NULL) return NULL; // for NULL & out of bounds
-  char *copy = strdup(v->data[idx]);
+  const char *elt = vect_get(v, idx);
+  if (elt == NULL) return NULL; // for NULL & out of bounds
+  char *copy = strdup(elt);
   if (!copy) return NULL; // for mem alloc
   return copy;
 
@@ -74,47 +298,95 @@ char *vect_get_copy(vect_t *v, unsigned int idx) {
 /** Set the element at the given index. */
 void vect_set(vect_t *v, unsigned int idx, const char *elt) {
   if (!v || idx >= v->size) return; //for null
-  free(v->data[idx]);
 
-  if (elt) {
-    char *copy = strdup(elt);
-    if (!copy) return; // for alloc error
-    v->data[idx] = copy;
-  } else {
-    v->data[idx] = NULL;
+  vect_slot_t slot;
+  if (slot_store(v, &slot, elt) != 0) return; // for alloc error
+
+  vect_slot_t old = slot_load(v, idx);
+  slot_put(v, idx, &slot);
+  slot_release(&old);
+}
+
+/** Set the element at the given index to elt itself, taking ownership. */
+void vect_set_owned(vect_t *v, unsigned int idx, char *elt) {
+  if (!v || idx >= v->size) {  //for null
+    free(elt);
+    return;
   }
+  if (elt == slot_string(v, idx)) return;  // already there: releasing would free it
+
+  vect_slot_t slot = slot_load(v, idx);
+  slot_release(&slot);
+  slot_adopt(&slot, elt);
+  slot_put(v, idx, &slot);
 }
 
 /** Add an element to the back of the vector. */
 void vect_add(vect_t *v, const char *elt) {
   if (!v) return;  //for null
 
-  if (v->size == v->capacity) {
-    v->capacity *= 2;
-    char **newData = realloc(v->data, v->capacity * sizeof(char *));
-    if (!newData) return; // for realloc error
+  if (v->size == VECT_MAX_CAPACITY) return; // for overflow
 
-    v->data = newData;
+  // Copied before growing: elt may be inline in the array realloc frees
+  vect_slot_t slot;
+  if (slot_store(v, &slot, elt) != 0) return; // for alloc fail
+  if (vect_grow(v, v->size + 1, 1, NULL) != 0) { // for realloc error
+    slot_release(&slot);
+    return;
   }
 
-  if (elt) {
-    char *copy = strdup(elt);
-    if (!copy) return; // for alloc fail
-    v->data[v->size] = copy;
-  } else {
-    v->data[v->size] = NULL;
+  slot_put(v, v->size, &slot);
+  v->size++;
+
+}
+
+/** Add elt itself to the back of the vector, taking ownership. */
+void vect_add_owned(vect_t *v, char *elt) {
+  if (!v || v->size == VECT_MAX_CAPACITY || vect_grow(v, v->size + 1, 1, NULL) != 0) {
+    free(elt); // for null and realloc error
+    return;
   }
-  
+
+  vect_slot_t slot;
+  slot_adopt(&slot, elt);
+  slot_put(v, v->size, &slot);
   v->size++;
+}
+
+/** Make room for at least capacity items without further reallocation. */
+void vect_reserve(vect_t *v, unsigned int capacity) {
+  if (!v) return; // for null
+
+  vect_grow(v, capacity, 0, NULL);
+}
 
+/** Add copies of elts[0..n) to the back of the vector. */
+void vect_extend(vect_t *v, const char **elts, unsigned int n) {
+  if (!v || n == 0) return; // for null
+
+  if (n > VECT_MAX_CAPACITY - v->size) return; // for overflow
+
+  // Elements may be inline in the old array (SSO): keep it until copied
+  void *old = NULL;
+  if (vect_grow(v, v->size + n, 1, (v->mode & VECT_MODE_SSO) ? &old : NULL) != 0) {
+    return; // for realloc error
+  }
+
+  for (unsigned int i = 0; i < n; i++) {
+    vect_slot_t slot;
+    if (slot_store(v, &slot, elts[i]) != 0) break; // for alloc fail
+    slot_put(v, v->size, &slot);
+    v->size++;
+  }
+  free(old);
 }
 
 /** Remove the last element from the vector. */
 void vect_remove_last(vect_t *v) {
   if (!v || v->size == 0) return; // for null and size
 
-  free(v->data[v->size - 1]);
-  v->data[v->size - 1] = NULL; //check null post free
+  vect_slot_t slot = slot_load(v, v->size - 1);
+  slot_release(&slot);
   v->size--;
 }
 
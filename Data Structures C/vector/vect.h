@@ -9,6 +9,23 @@ typedef struct vect vect_t;
 /** Construct a new empty vector. */
 vect_t *vect_new();
 
+/**
+ * Construct a new empty vector with the given storage mode (VECT_MODE_*
+ * flags, or'ed together; 0 is the same as vect_new).
+ *
+ * - VECT_MODE_SSO: strings shorter than VECT_SSO_SIZE bytes (including the
+ *   terminating '\0') are stored inside the vector's slot itself. Slots
+ *   then take VECT_SSO_SIZE bytes each instead of a pointer's 8, which pays
+ *   off when most strings are short (each saves a separate allocation).
+ * - VECT_MODE_ARENA: all other strings are copied into a few large chunks
+ *   owned by the vector and freed together by vect_delete. Bytes of strings
+ *   replaced by vect_set or vect_remove_last are only reclaimed then.
+ *
+ * In SSO mode the pointer vect_get returns for a short string is only valid
+ * until the vector is next modified.
+ */
+vect_t *vect_new_mode(unsigned int mode);
+
 /** Delete the vector, freeing all memory it occupies. */
 void vect_delete(vect_t *v);
 
@@ -25,6 +42,26 @@ void vect_set(vect_t *v, unsigned int idx, const char *elt);
 /** Add an element to the back of the vector. */
 void vect_add(vect_t *v, const char *elt);
 
+/**
+ * Add a malloc'ed string to the back of the vector without copying it.
+ *
+ * The vector takes ownership of elt and frees it when it is replaced or
+ * removed (or right away, if it cannot be added).
+ */
+void vect_add_owned(vect_t *v, char *elt);
+
+/** Like vect_set, but adopts the malloc'ed elt (see vect_add_owned). */
+void vect_set_owned(vect_t *v, unsigned int idx, char *elt);
+
+/** Make room for at least capacity items, so adding them won't reallocate. */
+void vect_reserve(vect_t *v, unsigned int capacity);
+
+/**
+ * Add copies of elts[0..n) to the back of the vector, growing it at most
+ * once.
+ */
+void vect_extend(vect_t *v, const char **elts, unsigned int n);
+
 /** Remove the last element from the vector. */
 void vect_remove_last(vect_t *v);
 
@@ -41,4 +78,12 @@ unsigned int vect_current_capacity(vect_t *v);
 
 #define VECT_MAX_CAPACITY UINT_MAX
 
+/* Storage modes. */
+#define VECT_MODE_SSO 1
+#define VECT_MODE_ARENA 2
+
+#define VECT_SSO_SIZE 16            /* Bytes per slot */
+#define VECT_ARENA_CHUNK 4096       /* Size of the first arena chunk */
+#define VECT_ARENA_MAX_CHUNK (1 << 20) /* Chunks double up to this size */
+
 #endif /* ifndef _VECT_H */
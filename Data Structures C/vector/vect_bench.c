@@ -0,0 +1,243 @@
+/**
+ * Benchmarks for the vectors (see ../bench/bench.h).
+ *
+ *   make bench                       # all of them, into bench-results.csv
+ *   ./vect_bench /vect/get           # just one, munit-style
+ *
+ * Each vect_t operation is timed on its own in every storage mode, the typed
+ * vector alongside for comparison, and cvect_t snapshot reads with 1..N
+ * reader threads while a writer keeps replacing elements.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdatomic.h>
+#include <bench.h>
+
+#include "vect.h"
+#include "vect_typed.h"
+#include "cvect.h"
+
+VECT_DEFINE(long)
+
+/* Short enough for the SSO slots, like most strings in practice */
+#define ITEM "item 1234"
+
+static unsigned int mode_from_name(const char *name) {
+  if (name == NULL || strcmp(name, "heap") == 0) return 0;
+  if (strcmp(name, "sso") == 0) return VECT_MODE_SSO;
+  if (strcmp(name, "arena") == 0) return VECT_MODE_ARENA;
+  return VECT_MODE_SSO | VECT_MODE_ARENA;
+}
+
+/** A vector in the "mode" parameter's mode holding n copies of ITEM. */
+static vect_t *filled(const MunitParameter params[], unsigned long n) {
+  vect_t *v = vect_new_mode(mode_from_name(munit_parameters_get(params, "mode")));
+  for (unsigned long i = 0; i < n; i++) {
+    vect_add(v, ITEM);
+  }
+  return v;
+}
+
+MunitResult bench_vect_add(const MunitParameter params[], void *data) {
+  unsigned long ops = bench_ops();
+  vect_t *v = filled(params, 0);
+
+  double start = bench_now();
+  for (unsigned long i = 0; i < ops; i++) {
+    vect_add(v, ITEM);
+  }
+  bench_report("/vect/add", params, ops, bench_now() - start);
+
+  munit_assert_uint(vect_size(v), ==, ops);
+  vect_delete(v);
+  return MUNIT_OK;
+}
+
+MunitResult bench_vect_get(const MunitParameter params[], void *data) {
+  unsigned long ops = bench_ops();
+  vect_t *v = filled(params, 1024);
+
+  size_t len = 0;
+  double start = bench_now();
+  for (unsigned long i = 0; i < ops; i++) {
+    len += vect_get(v, i & 1023)[0];
+  }
+  bench_report("/vect/get", params, ops, bench_now() - start);
+
+  munit_assert_size(len, ==, ops * 'i');
+  vect_delete(v);
+  return MUNIT_OK;
+}
+
+MunitResult bench_vect_set(const MunitParameter params[], void *data) {
+  unsigned long ops = bench_ops();
+  vect_t *v = filled(params, 1024);
+
+  double start = bench_now();
+  for (unsigned long i = 0; i < ops; i++) {
+    vect_set(v, i & 1023, ITEM);
+  }
+  bench_report("/vect/set", params, ops, bench_now() - start);
+
+  vect_delete(v);
+  return MUNIT_OK;
+}
+
+MunitResult bench_vect_remove_last(const MunitParameter params[], void *data) {
+  unsigned long ops = bench_ops();
+  vect_t *v = filled(params, ops);
+
+  double start = bench_now();
+  for (unsigned long i = 0; i < ops; i++) {
+    vect_remove_last(v);
+  }
+  bench_report("/vect/remove_last", params, ops, bench_now() - start);
+
+  munit_assert_uint(vect_size(v), ==, 0);
+  vect_delete(v);
+  return MUNIT_OK;
+}
+
+MunitResult bench_typed_add_get(const MunitParameter params[], void *data) {
+  unsigned long ops = bench_ops();
+  vect_long_t v;
+  vect_long_init(&v);
+
+  double start = bench_now();
+  for (unsigned long i = 0; i < ops; i++) {
+    vect_long_add(&v, i);
+  }
+  bench_report("/vect_long/add", params, ops, bench_now() - start);
+
+  long sum = 0;
+  start = bench_now();
+  for (unsigned long i = 0; i < ops; i++) {
+    sum += vect_long_get(&v, i);
+  }
+  bench_report("/vect_long/get", params, ops, bench_now() - start);
+
+  munit_assert_long(sum, ==, (long) (ops * (ops - 1) / 2));
+  vect_long_delete(&v);
+  return MUNIT_OK;
+}
+
+typedef struct {
+  cvect_t *v;
+  unsigned long reads;  /* Elements this reader looks at */
+  size_t sum;
+} reader_arg_t;
+
+static void *reader(void *ref) {
+  reader_arg_t *arg = ref;
+  cvect_reader_t *r = cvect_reader_new(arg->v);
+
+  unsigned long done = 0;
+  while (done < arg->reads) {
+    cvect_snapshot_t s = cvect_snapshot(arg->v);
+    for (unsigned int i = 0; i < cvect_snapshot_size(&s) && done < arg->reads;
+         i++, done++) {
+      arg->sum += cvect_snapshot_get(&s, i)[0];
+    }
+    cvect_quiescent(r);
+  }
+
+  cvect_reader_delete(r);
+  return NULL;
+}
+
+typedef struct {
+  cvect_t *v;
+  atomic_int *done;
+} writer_arg_t;
+
+static void *writer(void *ref) {
+  writer_arg_t *arg = ref;
+  for (unsigned int i = 0; !atomic_load(arg->done); i++) {
+    cvect_set(arg->v, i & 1023, ITEM);
+  }
+  return NULL;
+}
+
+// ns per element read, summed over all readers
+MunitResult bench_cvect_read(const MunitParameter params[], void *data) {
+  int threads = bench_param(params, "threads", 1);
+  unsigned long ops = bench_ops() / threads * threads;
+  cvect_t *v = cvect_new();
+  for (int i = 0; i < 1024; i++) {
+    cvect_add(v, ITEM);
+  }
+
+  pthread_t readers[threads], writer_thread;
+  reader_arg_t args[threads];
+  atomic_int done = 0;
+  writer_arg_t writer_arg = {v, &done};
+
+  double start = bench_now();
+  pthread_create(&writer_thread, NULL, writer, &writer_arg);
+  for (int i = 0; i < threads; i++) {
+    args[i] = (reader_arg_t){v, ops / threads, 0};
+    pthread_create(&readers[i], NULL, reader, &args[i]);
+  }
+  for (int i = 0; i < threads; i++) {
+    pthread_join(readers[i], NULL);
+    munit_assert_size(args[i].sum, ==, ops / threads * 'i');
+  }
+  double secs = bench_now() - start;
+  atomic_store(&done, 1);
+  pthread_join(writer_thread, NULL);
+  bench_report("/cvect/snapshot_read", params, ops, secs);
+
+  cvect_delete(v);
+  return MUNIT_OK;
+}
+
+static char* storage_modes[] = {
+  (char*) "heap", (char*) "sso", (char*) "arena", (char*) "sso+arena", NULL
+};
+
+static char* thread_counts[] = {
+  (char*) "1", (char*) "2", (char*) "4", NULL
+};
+
+static MunitParameterEnum storage_mode_params[] = {
+  { (char*) "mode", storage_modes },
+  { NULL, NULL },
+};
+
+static MunitParameterEnum thread_params[] = {
+  { (char*) "threads", thread_counts },
+  { NULL, NULL },
+};
+
+#define MUNIT_SIMPLE(name, test_func, params) { \
+  name,                   /* name */            \
+  test_func,              /* test */            \
+  NULL,                   /* setup */           \
+  NULL,                   /* tear_down */       \
+  MUNIT_TEST_OPTION_NONE, /* options */         \
+  params                  /* parameters */      \
+}
+
+#define MUNIT_TESTS_END MUNIT_SIMPLE(NULL, NULL, NULL)
+
+MunitTest tests[] = {
+  MUNIT_SIMPLE("/vect/add", bench_vect_add, storage_mode_params),
+  MUNIT_SIMPLE("/vect/get", bench_vect_get, storage_mode_params),
+  MUNIT_SIMPLE("/vect/set", bench_vect_set, storage_mode_params),
+  MUNIT_SIMPLE("/vect/remove_last", bench_vect_remove_last, storage_mode_params),
+  MUNIT_SIMPLE("/vect_long/add+get", bench_typed_add_get, NULL),
+  MUNIT_SIMPLE("/cvect/snapshot_read", bench_cvect_read, thread_params),
+  MUNIT_TESTS_END
+};
+
+static const MunitSuite suite = {
+  "",
+  tests,
+  NULL,
+  1,
+  MUNIT_SUITE_OPTION_NONE
+};
+
+int main(int argc, char **argv) {
+  return munit_suite_main(&suite, NULL, argc, argv);
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -36,8 +37,16 @@ MunitResult test_add_after_delete(const MunitParameter params[], void *data) {
   return MUNIT_OK;
 }
 
+/* Storage mode names, as used by the "mode" test parameter */
+static unsigned int mode_from_name(const char *name) {
+  if (name == NULL || strcmp(name, "heap") == 0) return 0;
+  if (strcmp(name, "sso") == 0) return VECT_MODE_SSO;
+  if (strcmp(name, "arena") == 0) return VECT_MODE_ARENA;
+  return VECT_MODE_SSO | VECT_MODE_ARENA;
+}
+
 static void *vector_setup(const MunitParameter params[], void *data) {
-  vect_t *v1 = vect_new();
+  vect_t *v1 = vect_new_mode(mode_from_name(munit_parameters_get(params, "mode")));
 
   return v1;
 }
@@ -254,6 +263,158 @@ MunitResult test_stress(const MunitParameter params[], void *data) {
   return MUNIT_OK;
 }
 
+/* Strings at and around the inline size limit, and NULL, in every mode */
+MunitResult test_storage_modes(const MunitParameter params[], void *data) {
+  const char *elts[] = {
+    "", "a", "fourteen chars", "fifteen chars!!", "sixteen chars!!!",
+    NULL, "a rather longer string that never fits in a slot",
+  };
+  unsigned int n = sizeof(elts) / sizeof(elts[0]);
+  unsigned int modes[] = {
+    0, VECT_MODE_SSO, VECT_MODE_ARENA, VECT_MODE_SSO | VECT_MODE_ARENA
+  };
+
+  for (int m = 0; m < 4; m++) {
+    vect_t *v = vect_new_mode(modes[m]);
+
+    for (unsigned int i = 0; i < n; i++) {
+      vect_add(v, elts[i]);
+    }
+    for (unsigned int i = 0; i < n; i++) {
+      if (elts[i] == NULL) {
+        munit_assert_null(vect_get(v, i));
+      } else {
+        munit_assert_string_equal(vect_get(v, i), elts[i]);
+      }
+    }
+
+    // Swap long and short strings in place, then shrink
+    vect_set(v, 1, elts[n - 1]);
+    vect_set(v, n - 1, "short");
+    vect_set(v, 5, "no longer NULL");
+    munit_assert_string_equal(vect_get(v, 1), elts[n - 1]);
+    munit_assert_string_equal(vect_get(v, n - 1), "short");
+    munit_assert_string_equal(vect_get(v, 5), "no longer NULL");
+    munit_assert_string_equal(vect_get(v, 4), "sixteen chars!!!");
+
+    char *copy = vect_get_copy(v, 3);
+    munit_assert_string_equal(copy, "fifteen chars!!");
+    free(copy);
+
+    vect_remove_last(v);
+    vect_remove_last(v);
+    munit_assert_uint(vect_size(v), ==, n - 2);
+    munit_assert_string_equal(vect_get(v, 0), "");
+
+    vect_delete(v);
+  }
+
+  return MUNIT_OK;
+}
+
+/* Adopting caller-allocated strings */
+MunitResult test_owned(const MunitParameter params[], void *data) {
+  vect_t *v1 = data;
+
+  char *hello = strdup("hello");
+  vect_add_owned(v1, hello);
+  vect_add(v1, "world");
+  vect_add_owned(v1, NULL);
+  munit_assert_uint(vect_size(v1), ==, 3);
+  munit_assert_ptr_equal(vect_get(v1, 0), hello);
+  munit_assert_null(vect_get(v1, 2));
+
+  // Replacing owned and copied strings frees the old ones (checked by valgrind)
+  char *foo = strdup("Foo");
+  vect_set_owned(v1, 0, foo);
+  vect_set_owned(v1, 1, strdup("Bar"));
+  vect_set_owned(v1, 2, strdup("Baz"));
+  munit_assert_ptr_equal(vect_get(v1, 0), foo);
+  munit_assert_string_equal(vect_get(v1, 1), "Bar");
+  munit_assert_string_equal(vect_get(v1, 2), "Baz");
+
+  // Setting the string already stored at an index keeps it
+  vect_set_owned(v1, 1, (char *) vect_get(v1, 1));
+  munit_assert_string_equal(vect_get(v1, 1), "Bar");
+
+  vect_set(v1, 0, "copied");
+  munit_assert_string_equal(vect_get(v1, 0), "copied");
+
+  // Out of bounds: the string is freed, not leaked
+  vect_set_owned(v1, 10, strdup("lost"));
+  vect_add_owned(NULL, strdup("lost"));
+
+  vect_remove_last(v1);
+  munit_assert_uint(vect_size(v1), ==, 2);
+
+  return MUNIT_OK;
+}
+
+/* Reserving and bulk-appending */
+MunitResult test_reserve_extend(const MunitParameter params[], void *data) {
+  vect_t *v1 = data;
+  const char *elts[] = { "a", "bb", NULL, "dddd", "eeeee" };
+
+  vect_reserve(v1, 100);
+  munit_assert_uint(vect_current_capacity(v1), ==, 100);
+  vect_reserve(v1, 10);
+  munit_assert_uint(vect_current_capacity(v1), ==, 100);
+
+  for (int i = 0; i < 20; i++) {
+    vect_extend(v1, elts, 5);
+  }
+  munit_assert_uint(vect_size(v1), ==, 100);
+  munit_assert_uint(vect_current_capacity(v1), ==, 100);
+  munit_assert_string_equal(vect_get(v1, 98), "dddd");
+  munit_assert_null(vect_get(v1, 97));
+
+  // One more batch grows geometrically, once
+  vect_extend(v1, elts, 5);
+  munit_assert_uint(vect_current_capacity(v1), ==, 100 * VECT_GROWTH_FACTOR);
+  munit_assert_string_equal(vect_get(v1, 104), "eeeee");
+
+  vect_extend(v1, elts, 0);
+  vect_extend(NULL, elts, 5);
+  munit_assert_uint(vect_size(v1), ==, 105);
+
+  return MUNIT_OK;
+}
+
+/* Elements taken from the vector itself (inline in its slots in SSO mode) */
+MunitResult test_self_alias(const MunitParameter params[], void *data) {
+  vect_t *v1 = data;
+
+  vect_add(v1, "short");
+  vect_add(v1, "a string too long to be inline");
+  vect_set(v1, 0, vect_get(v1, 0));
+  vect_set(v1, 1, vect_get(v1, 1));
+  munit_assert_string_equal(vect_get(v1, 0), "short");
+  munit_assert_string_equal(vect_get(v1, 1), "a string too long to be inline");
+
+  // Adding grows the vector, moving the slot elt points into
+  for (int i = 0; i < 20; i++) {
+    vect_add(v1, vect_get(v1, i));
+  }
+  for (unsigned int i = 0; i < vect_size(v1); i++) {
+    munit_assert_string_equal(vect_get(v1, i),
+                              i % 2 ? "a string too long to be inline" : "short");
+  }
+
+  // So does extending a full vector
+  while (vect_size(v1) < vect_current_capacity(v1)) {
+    vect_add(v1, vect_size(v1) % 2 ? "a string too long to be inline" : "short");
+  }
+  const char *elts[] = { vect_get(v1, 0), vect_get(v1, 1), vect_get(v1, 2) };
+  unsigned int size = vect_size(v1);
+  vect_extend(v1, elts, 3);
+  munit_assert_uint(vect_size(v1), ==, size + 3);
+  munit_assert_string_equal(vect_get(v1, size), "short");
+  munit_assert_string_equal(vect_get(v1, size + 1), "a string too long to be inline");
+  munit_assert_string_equal(vect_get(v1, size + 2), "short");
+
+  return MUNIT_OK;
+}
+
 #define MUNIT_SIMPLE(name, test_func, params) { \
   name,                   /* name */            \
   test_func,              /* test */            \
@@ -282,8 +443,18 @@ static char* big_counts[] = {
   (char*) "1000000", (char*) "10000000", (char*) "100000000", NULL
 };
 
+static char* storage_modes[] = {
+  (char*) "heap", (char*) "sso", (char*) "arena", (char*) "sso+arena", NULL
+};
+
+static MunitParameterEnum storage_mode_params[] = {
+  { (char*) "mode", storage_modes },
+  { NULL, NULL },
+};
+
 static MunitParameterEnum small_count_params[] = {
   { (char*) "count", small_counts  },
+  { (char*) "mode", storage_modes },
   { NULL, NULL },
 };
 
@@ -348,6 +519,10 @@ MunitTest tests_basic[] = {
   VECTOR_FIXTURE("/null_vector", test_null_vector, NULL),
   VECTOR_FIXTURE("/vector_growth", test_vector_growth, NULL),
   VECTOR_FIXTURE("/boundary_check", test_boundary_check, NULL),
+  MUNIT_SIMPLE("/storage_modes", test_storage_modes, NULL),
+  VECTOR_FIXTURE("/owned", test_owned, storage_mode_params),
+  VECTOR_FIXTURE("/reserve_extend", test_reserve_extend, storage_mode_params),
+  VECTOR_FIXTURE("/self_alias", test_self_alias, storage_mode_params),
   MUNIT_TESTS_END
 };
 
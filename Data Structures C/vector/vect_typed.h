@@ -0,0 +1,165 @@
+/**
+ * Type-specialised vectors.
+ *
+ * VECT_DEFINE(type) generates a vector type vect_<type>_t that stores its
+ * elements by value in one contiguous array (no per-element allocation or
+ * pointer chasing), growing geometrically by VECT_GROWTH_FACTOR, plus static
+ * inline functions mirroring vect_t's interface:
+ *
+ *   VECT_DEFINE(long)
+ *
+ *   vect_long_t v;
+ *   vect_long_init(&v);
+ *   vect_long_add(&v, 42);
+ *   long x = vect_long_get(&v, 0);
+ *   vect_long_delete(&v);
+ *
+ * Types that aren't a single identifier (struct foo, char *) need a name for
+ * the generated identifiers: VECT_DEFINE_NAMED(foo, struct foo).
+ *
+ * Elements are copied with plain assignment; the vector never looks inside
+ * them, so freeing what they point to is up to the caller. Pointers from
+ * vect_<name>_at and vect_<name>_data are invalidated when the vector grows.
+ * Functions that may allocate return 0 on success and -1 on failure.
+ */
+#ifndef _VECT_TYPED_H
+#define _VECT_TYPED_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vect.h"
+
+#define VECT_DEFINE(type) VECT_DEFINE_NAMED(type, type)
+
+#define VECT_DEFINE_NAMED(name, type)                                         \
+                                                                              \
+/* Element type, so const applies to the whole type below */                 \
+typedef type vect_##name##_elt_t;                                             \
+                                                                              \
+typedef struct {                                                              \
+  type *data;            /* Elements, stored inline */                        \
+  unsigned int size;     /* Number of items currently in the vector */        \
+  unsigned int capacity; /* Items the vector can hold before growing */       \
+} vect_##name##_t;                                                            \
+                                                                              \
+/** Initialise an empty vector (nothing is allocated until the first add). */ \
+static inline void vect_##name##_init(vect_##name##_t *v) {                   \
+  v->data = NULL;                                                             \
+  v->size = 0;                                                                \
+  v->capacity = 0;                                                            \
+}                                                                             \
+                                                                              \
+/** Free the vector's array; it is empty (and reusable) afterwards. */        \
+static inline void vect_##name##_delete(vect_##name##_t *v) {                 \
+  free(v->data);                                                              \
+  vect_##name##_init(v);                                                      \
+}                                                                             \
+                                                                              \
+/** Grow to hold at least min_capacity items (geometrically, if set). */      \
+static inline int vect_##name##_grow(vect_##name##_t *v,                      \
+                                     unsigned int min_capacity,               \
+                                     int geometric) {                         \
+  if (min_capacity <= v->capacity) return 0;                                  \
+                                                                              \
+  unsigned int capacity = min_capacity;                                       \
+  if (geometric) {                                                            \
+    capacity = v->capacity ? v->capacity : VECT_INITIAL_CAPACITY;             \
+    while (capacity < min_capacity) {                                         \
+      if (capacity > VECT_MAX_CAPACITY / VECT_GROWTH_FACTOR) {                \
+        capacity = VECT_MAX_CAPACITY; /* for overflow */                      \
+        break;                                                                \
+      }                                                                       \
+      capacity *= VECT_GROWTH_FACTOR;                                         \
+    }                                                                         \
+  }                                                                           \
+                                                                              \
+  type *data = realloc(v->data, (size_t) capacity * sizeof(type));            \
+  if (!data) return -1; /* for realloc error */                               \
+                                                                              \
+  v->data = data;                                                             \
+  v->capacity = capacity;                                                     \
+  return 0;                                                                   \
+}                                                                             \
+                                                                              \
+/** Make room for at least capacity items without further reallocation. */    \
+static inline int vect_##name##_reserve(vect_##name##_t *v,                   \
+                                        unsigned int capacity) {              \
+  return vect_##name##_grow(v, capacity, 0);                                  \
+}                                                                             \
+                                                                              \
+/** Add an element to the back of the vector. */                              \
+static inline int vect_##name##_add(vect_##name##_t *v, type elt) {           \
+  if (v->size == v->capacity) {                                               \
+    if (v->size == VECT_MAX_CAPACITY) return -1; /* for overflow */           \
+    if (vect_##name##_grow(v, v->size + 1, 1) != 0) return -1;                \
+  }                                                                           \
+  v->data[v->size++] = elt;                                                   \
+  return 0;                                                                   \
+}                                                                             \
+                                                                              \
+/** Add copies of elts[0..n) to the back, growing at most once. */            \
+static inline int vect_##name##_extend(vect_##name##_t *v,                    \
+                                       const vect_##name##_elt_t *elts,       \
+                                       unsigned int n) {                      \
+  if (n == 0) return 0;                                                       \
+  if (n > VECT_MAX_CAPACITY - v->size) return -1; /* for overflow */          \
+                                                                              \
+  /* elts may point into the data, which growing can move */                  \
+  uintptr_t at = (uintptr_t) elts - (uintptr_t) v->data;                      \
+  int inside = v->data && at < (uintptr_t) v->size * sizeof(type);            \
+  if (vect_##name##_grow(v, v->size + n, 1) != 0) return -1;                  \
+  if (inside) elts = (const vect_##name##_elt_t *) ((char *) v->data + at);   \
+  memcpy(v->data + v->size, elts, (size_t) n * sizeof(type));                 \
+  v->size += n;                                                               \
+  return 0;                                                                   \
+}                                                                             \
+                                                                              \
+/** Get the element at the given index. */                                    \
+static inline type vect_##name##_get(const vect_##name##_t *v,                \
+                                     unsigned int idx) {                      \
+  assert(idx < v->size);                                                      \
+  return v->data[idx];                                                        \
+}                                                                             \
+                                                                              \
+/** Pointer to the element at the given index (NULL if out of bounds). */     \
+static inline type *vect_##name##_at(vect_##name##_t *v, unsigned int idx) {  \
+  return idx < v->size ? &v->data[idx] : NULL;                                \
+}                                                                             \
+                                                                              \
+/** Set the element at the given index. */                                    \
+static inline void vect_##name##_set(vect_##name##_t *v, unsigned int idx,    \
+                                     type elt) {                              \
+  assert(idx < v->size);                                                      \
+  v->data[idx] = elt;                                                         \
+}                                                                             \
+                                                                              \
+/** Remove the last element from the vector. */                               \
+static inline void vect_##name##_remove_last(vect_##name##_t *v) {            \
+  if (v->size > 0) v->size--;                                                 \
+}                                                                             \
+                                                                              \
+/** Remove all elements, keeping the capacity. */                             \
+static inline void vect_##name##_clear(vect_##name##_t *v) {                  \
+  v->size = 0;                                                                \
+}                                                                             \
+                                                                              \
+/** The elements, contiguous: data[0..size). */                               \
+static inline type *vect_##name##_data(vect_##name##_t *v) {                  \
+  return v->data;                                                             \
+}                                                                             \
+                                                                              \
+/** The number of items currently in the vector. */                           \
+static inline unsigned int vect_##name##_size(const vect_##name##_t *v) {     \
+  return v->size;                                                             \
+}                                                                             \
+                                                                              \
+/** The maximum number of items the vector can hold before it has to grow. */ \
+static inline unsigned int                                                    \
+vect_##name##_current_capacity(const vect_##name##_t *v) {                    \
+  return v->capacity;                                                         \
+}
+
+#endif /* ifndef _VECT_TYPED_H */
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <munit.h>
+
+#include "vect_typed.h"
+
+struct point {
+  int x, y;
+};
+
+VECT_DEFINE(long)
+VECT_DEFINE_NAMED(point, struct point)
+VECT_DEFINE_NAMED(str, char *)
+
+/* An initialised vector is empty and allocates nothing */
+MunitResult test_typed_empty(const MunitParameter params[], void *data) {
+  vect_long_t v;
+  vect_long_init(&v);
+
+  munit_assert_uint(vect_long_size(&v), ==, 0);
+  munit_assert_uint(vect_long_current_capacity(&v), ==, 0);
+  munit_assert_null(vect_long_data(&v));
+  munit_assert_null(vect_long_at(&v, 0));
+
+  vect_long_remove_last(&v);
+  vect_long_delete(&v);
+  return MUNIT_OK;
+}
+
+/* Growth follows VECT_INITIAL_CAPACITY and VECT_GROWTH_FACTOR */
+MunitResult test_typed_growth(const MunitParameter params[], void *data) {
+  vect_long_t v;
+  vect_long_init(&v);
+
+  unsigned int expected = VECT_INITIAL_CAPACITY;
+  for (long i = 0; i < 1000; i++) {
+    munit_assert_int(vect_long_add(&v, i * i), ==, 0);
+    if (i + 1 > expected) {
+      expected *= VECT_GROWTH_FACTOR;
+    }
+    munit_assert_uint(vect_long_current_capacity(&v), ==, expected);
+  }
+  munit_assert_uint(vect_long_size(&v), ==, 1000);
+
+  // Elements are contiguous, by value
+  long *nums = vect_long_data(&v);
+  for (long i = 0; i < 1000; i++) {
+    munit_assert_long(nums[i], ==, i * i);
+    munit_assert_long(vect_long_get(&v, i), ==, i * i);
+  }
+
+  vect_long_set(&v, 3, -1);
+  *vect_long_at(&v, 4) += 1;
+  munit_assert_long(vect_long_get(&v, 3), ==, -1);
+  munit_assert_long(vect_long_get(&v, 4), ==, 17);
+
+  vect_long_remove_last(&v);
+  munit_assert_uint(vect_long_size(&v), ==, 999);
+  vect_long_clear(&v);
+  munit_assert_uint(vect_long_size(&v), ==, 0);
+  munit_assert_uint(vect_long_current_capacity(&v), ==, expected);
+
+  vect_long_delete(&v);
+  munit_assert_uint(vect_long_current_capacity(&v), ==, 0);
+  return MUNIT_OK;
+}
+
+/* Struct elements, reserve and extend */
+MunitResult test_typed_struct(const MunitParameter params[], void *data) {
+  vect_point_t v;
+  vect_point_init(&v);
+
+  munit_assert_int(vect_point_reserve(&v, 10), ==, 0);
+  munit_assert_uint(vect_point_current_capacity(&v), ==, 10);
+
+  struct point pts[] = { {1, 2}, {3, 4}, {5, 6} };
+  for (int i = 0; i < 3; i++) {
+    munit_assert_int(vect_point_extend(&v, pts, 3), ==, 0);
+  }
+  munit_assert_uint(vect_point_size(&v), ==, 9);
+  munit_assert_uint(vect_point_current_capacity(&v), ==, 10);
+
+  munit_assert_int(vect_point_extend(&v, pts, 3), ==, 0);
+  munit_assert_uint(vect_point_current_capacity(&v), ==, 10 * VECT_GROWTH_FACTOR);
+  munit_assert_int(vect_point_get(&v, 11).x, ==, 5);
+  munit_assert_int(vect_point_at(&v, 10)->y, ==, 4);
+  munit_assert_null(vect_point_at(&v, 12));
+
+  // Extending with its own items, while it grows
+  munit_assert_int(vect_point_extend(&v, vect_point_at(&v, 0), 12), ==, 0);
+  munit_assert_uint(vect_point_size(&v), ==, 24);
+  munit_assert_uint(vect_point_current_capacity(&v), ==,
+                    10 * VECT_GROWTH_FACTOR * VECT_GROWTH_FACTOR);
+  munit_assert_int(vect_point_get(&v, 12).x, ==, 1);
+  munit_assert_int(vect_point_get(&v, 23).y, ==, 6);
+
+  vect_point_delete(&v);
+  return MUNIT_OK;
+}
+
+/* Pointer elements are stored as is */
+MunitResult test_typed_pointers(const MunitParameter params[], void *data) {
+  vect_str_t v;
+  vect_str_init(&v);
+
+  char hello[] = "hello";
+  char *words[] = { hello, NULL };
+  munit_assert_int(vect_str_extend(&v, words, 2), ==, 0);
+  munit_assert_ptr_equal(vect_str_get(&v, 0), hello);
+  munit_assert_null(vect_str_get(&v, 1));
+
+  vect_str_delete(&v);
+  return MUNIT_OK;
+}
+
+#define MUNIT_SIMPLE(name, test_func, params) { \
+  name,                   /* name */            \
+  test_func,              /* test */            \
+  NULL,                   /* setup */           \
+  NULL,                   /* tear_down */       \
+  MUNIT_TEST_OPTION_NONE, /* options */         \
+  params                  /* parameters */      \
+}
+
+#define MUNIT_TESTS_END MUNIT_SIMPLE(NULL, NULL, NULL)
+
+MunitTest tests[] = {
+  MUNIT_SIMPLE("/empty", test_typed_empty, NULL),
+  MUNIT_SIMPLE("/growth", test_typed_growth, NULL),
+  MUNIT_SIMPLE("/struct elements", test_typed_struct, NULL),
+  MUNIT_SIMPLE("/pointer elements", test_typed_pointers, NULL),
+  MUNIT_TESTS_END
+};
+
+static const MunitSuite suite = {
+  "/vect_typed",
+  tests,
+  NULL,
+  1,
+  MUNIT_SUITE_OPTION_NONE
+};
+
+int main(int argc, char **argv) {
+  return munit_suite_main(&suite, NULL, argc, argv);
+}
@@ -6,6 +6,7 @@
  */
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "bitmap.h"
 
@@ -13,24 +14,80 @@
 #define byte_index(n) ((n) / 8)
 #define bit_index(n) ((n) % 8)
 
-// Get the given bit from the bitmap.
+// Get the given bit from the bitmap (an atomic load of its byte, so it
+// may race with bitmap_put on a neighbouring bit).
 int bitmap_get(void *bm, int i) {
   uint8_t *base = (uint8_t *)bm;
 
-  return (base[byte_index(i)] >> bit_index(i)) & 1;
+  return (__atomic_load_n(&base[byte_index(i)], __ATOMIC_RELAXED) >> bit_index(i)) & 1;
 }
 
-// Set the given bit in the bitmap to the given value.
+// Set the given bit in the bitmap to the given value (an atomic
+// read-modify-write of its byte).
 void bitmap_put(void *bm, int i, int v) {
   uint8_t *base = (uint8_t *)bm;
 
-  long bit_mask = nth_bit_mask(bit_index(i));
+  uint8_t bit_mask = nth_bit_mask(bit_index(i));
 
   if (v) {
-    base[byte_index(i)] |= bit_mask;
+    __atomic_fetch_or(&base[byte_index(i)], bit_mask, __ATOMIC_RELAXED);
   } else {
     bit_mask = ~bit_mask;
-    base[byte_index(i)] &= bit_mask;
+    __atomic_fetch_and(&base[byte_index(i)], bit_mask, __ATOMIC_RELAXED);
+  }
+}
+
+// Load the 64-bit word holding bits 64 * w .. 64 * w + 63 (bit i at i % 64).
+static uint64_t load_word(void *bm, int w) {
+  uint64_t word;
+  memcpy(&word, (uint8_t *)bm + 8 * w, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  word = __builtin_bswap64(word);
+#endif
+  return word;
+}
+
+// Find the first bit equal to v in [start, size), else -1.
+static int find_first(void *bm, int start, int size, int v) {
+  if (start >= size) {
+    return -1;
+  }
+
+  int w = start / 64;
+  uint64_t word = load_word(bm, w) ^ (v ? 0 : ~0ULL);  // 1s where bit == v
+  word &= ~0ULL << (start % 64);
+
+  for (;;) {
+    if (word != 0) {
+      int i = 64 * w + __builtin_ctzll(word);
+      return i < size ? i : -1;
+    }
+    if (64 * ++w >= size) {
+      return -1;
+    }
+    word = load_word(bm, w) ^ (v ? 0 : ~0ULL);
+  }
+}
+
+// Find the first 0 bit at or after start.
+int bitmap_find_first_zero(void *bm, int start, int size) {
+  return find_first(bm, start, size, 0);
+}
+
+// Find the first run of count 0 bits at or after start.
+int bitmap_find_zero_run(void *bm, int start, int size, int count) {
+  for (;;) {
+    int first = find_first(bm, start, size, 0);
+    if (first < 0 || size - first < count) {
+      return -1;
+    }
+
+    // Run ends at the next 1 bit (or the end of the bitmap)
+    int end = find_first(bm, first, first + count, 1);
+    if (end < 0) {
+      return first;
+    }
+    start = end + 1;
   }
 }
 
@@ -14,6 +14,8 @@
  * @param i The bit index.
  *
  * @return The state of the given bit (0 or 1).
+ *
+ * Reads the bit atomically, so it needs no lock against bitmap_put.
  */
 int bitmap_get(void *bm, int i);
 
@@ -23,9 +25,37 @@ int bitmap_get(void *bm, int i);
  * @param bm Pointer to the start of the bitmap.
  * @param i Bit index.
  * @param v Value the bit should be set to (0 or 1).
+ *
+ * Changes the bit atomically; the other bits of its byte are untouched.
  */
 void bitmap_put(void *bm, int i, int v);
 
+/**
+ * Find the first 0 bit at or after start.
+ *
+ * Scans 64 bits at a time. The bitmap's storage must be a whole number of
+ * 8-byte words.
+ *
+ * @param bm Pointer to the start of the bitmap.
+ * @param start Bit index to start from.
+ * @param size The number of bits in the bitmap.
+ *
+ * @return Index of the first 0 bit in [start, size), or -1 if there is none.
+ */
+int bitmap_find_first_zero(void *bm, int start, int size);
+
+/**
+ * Find the first run of count 0 bits at or after start.
+ *
+ * @param bm Pointer to the start of the bitmap.
+ * @param start Bit index to start from.
+ * @param size The number of bits in the bitmap.
+ * @param count Length of the run.
+ *
+ * @return Index of the first bit of the run, or -1 if there is none.
+ */
+int bitmap_find_zero_run(void *bm, int start, int size, int count);
+
 /**
  * Pretty-print a bitmap.
  *
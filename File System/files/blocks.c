@@ -13,6 +13,9 @@
 #include <fcntl.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <pthread.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -21,19 +24,20 @@
 #include "bitmap.h"
 #include "blocks.h"
 #include "inode.h"
+#include "journal.h"
 
-const int BLOCK_COUNT = 256; // we split the "disk" into 256 blocks
 const int BLOCK_SIZE = 4096; // = 4K
-const int NUFS_SIZE = BLOCK_SIZE * BLOCK_COUNT; // = 1MB
-const int INODE_COUNT = 256;
 const int INODE_SIZE = sizeof(inode_t);
 
-const int BLOCK_BITMAP_SIZE = BLOCK_COUNT / 8;
-// Note: assumes block count is divisible by 8
-const int INODE_BITMAP_SIZE = INODE_COUNT / 8;
+int BLOCK_COUNT = 0;
+int INODE_COUNT = 0;
+int BLOCK_BITMAP_SIZE = 0;
+int INODE_BITMAP_SIZE = 0;
 
 static int blocks_fd = -1;
-static void *blocks_base = 0;
+static void *blocks_base = 0;  // private: metadata
+static void *blocks_data = 0;  // shared: file data
+static size_t blocks_mapped = 0; // bytes mapped (max_blocks worth)
 
 //==================================================================== bytes_to_blocks =//
 // Get the number of blocks needed to store the given number of bytes.
@@ -42,74 +46,232 @@ int bytes_to_blocks(int bytes) {
   return bytes % BLOCK_SIZE == 0 ? quo : quo + 1;
 } // REDO DONE
 
+//==================================================================== blocks_format =//
+// Write a superblock and empty bitmaps for the given geometry.
+int blocks_format(const char *image_path, int block_count, int inode_count,
+                  int max_blocks, int journal_blocks) {
+  if (max_blocks < block_count) max_blocks = block_count;
+  if (inode_count <= ROOT_INODE || max_blocks > (1 << 30)) return -1;
+  if (journal_blocks < 0 || journal_blocks > (1 << 20)) return -1;
+
+  superblock_t sb = {
+    .magic = NUFS_MAGIC,
+    .block_size = BLOCK_SIZE,
+    .block_count = block_count,
+    .max_blocks = max_blocks,
+    .inode_count = inode_count,
+  };
+
+  // layout: super, block bitmap, inode bitmap, inode table, journal, data
+  sb.block_bitmap = 1;
+  sb.inode_bitmap = sb.block_bitmap + bytes_to_blocks((max_blocks + 7) / 8);
+  sb.inode_table = sb.inode_bitmap + bytes_to_blocks((inode_count + 7) / 8);
+  long table_bytes = (long)inode_count * INODE_SIZE;
+  if (table_bytes > INT_MAX) return -1;
+  sb.journal = sb.inode_table + bytes_to_blocks(table_bytes);
+  sb.journal_blocks = journal_blocks;
+  sb.data_start = sb.journal + journal_blocks;
+  if (block_count <= sb.data_start) return -1; // no room for data
+
+  int fd = open(image_path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if (fd == -1) return -1;
+
+  // a fresh file reads as zeros, so only the used bits need writing
+  int rv = ftruncate(fd, (off_t)block_count * BLOCK_SIZE);
+  if (rv == 0 && pwrite(fd, &sb, sizeof(sb), 0) != sizeof(sb)) rv = -1;
+
+  uint8_t *bits = calloc(1, sb.data_start / 8 + 1);
+  for (int i = 0; i < sb.data_start; ++i) {
+    bitmap_put(bits, i, 1);
+  }
+  off_t bbm_offset = (off_t)sb.block_bitmap * BLOCK_SIZE;
+  if (rv == 0 && pwrite(fd, bits, sb.data_start / 8 + 1, bbm_offset) < 0) rv = -1;
+  free(bits);
+
+  if (close(fd) != 0) rv = -1;
+  return rv;
+}
+
 //==================================================================== blocks_init =//
 // Load and initialize the given disk image.
 void blocks_init(const char *image_path) {
   blocks_fd = open(image_path, O_CREAT | O_RDWR, 0644);
   assert(blocks_fd != -1);
 
-  // make sure the disk image is exactly 1MB
-  int rv = ftruncate(blocks_fd, NUFS_SIZE);
+  // format new images with the default geometry
+  struct stat st;
+  int rv = fstat(blocks_fd, &st);
+  assert(rv == 0);
+  if (st.st_size == 0) {
+    rv = blocks_format(image_path, DEFAULT_BLOCK_COUNT, DEFAULT_INODE_COUNT,
+                       DEFAULT_MAX_BLOCKS, DEFAULT_JOURNAL_BLOCKS);
+    assert(rv == 0);
+  }
+
+  superblock_t sb;
+  rv = pread(blocks_fd, &sb, sizeof(sb), 0);
+  assert(rv == sizeof(sb));
+  assert(sb.magic == NUFS_MAGIC && sb.block_size == BLOCK_SIZE);
+
+  // finish the operations of the last committed groups (this may change
+  // the superblock too)
+  rv = journal_recover(blocks_fd, &sb);
   assert(rv == 0);
+  rv = pread(blocks_fd, &sb, sizeof(sb), 0);
+  assert(rv == sizeof(sb));
 
-  // map image to memory
-  blocks_base =
-      mmap(0, NUFS_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, blocks_fd, 0);
+  // map all the image may grow to; blocks past the file end are never touched
+  blocks_mapped = (size_t)sb.max_blocks * BLOCK_SIZE;
+  blocks_base = mmap(0, blocks_mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                     blocks_fd, 0);
   assert(blocks_base != MAP_FAILED);
+  blocks_data = mmap(0, blocks_mapped, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     blocks_fd, 0);
+  assert(blocks_data != MAP_FAILED);
 
-  // block 0 stores the block bitmap
-  void *bbm = get_blocks_bitmap();
-  bitmap_put(bbm, 0, 1);
+  BLOCK_COUNT = sb.block_count;
+  INODE_COUNT = sb.inode_count;
+  BLOCK_BITMAP_SIZE = (sb.max_blocks + 7) / 8;
+  INODE_BITMAP_SIZE = (sb.inode_count + 7) / 8;
 
-  // block 1 stores the inode bitmap  // ADDED & CHECKED
-  bitmap_put(bbm, 1, 1);
+  journal_init(blocks_fd);
+}
 
-  // block 2-n stores the inode table   // ADDED & CHECKED
-  for (int i = 2; (i-2) * BLOCK_SIZE < INODE_COUNT * INODE_SIZE; ++i) {
-    bitmap_put(bbm, i, 1);
+//==================================================================== blocks_grow =//
+// Grow the image file to block_count blocks.
+int blocks_grow(int block_count) {
+  superblock_t *sb = get_superblock();
+  if (block_count > sb->max_blocks || block_count <= sb->block_count) {
+    return -1;
+  }
+  if (ftruncate(blocks_fd, (off_t)block_count * BLOCK_SIZE) != 0) {
+    return -1;
   }
+
+  sb->block_count = block_count;
+  journal_dirty(0);
+  BLOCK_COUNT = block_count;
+  return 0;
 }
 
 //==================================================================== blocks_free =//
 // Close the disk image.
 void blocks_free() {
-  int rv = munmap(blocks_base, NUFS_SIZE);
+  journal_shutdown();
+  int rv = munmap(blocks_base, blocks_mapped);
   assert(rv == 0);
+  rv = munmap(blocks_data, blocks_mapped);
+  assert(rv == 0);
+  close(blocks_fd);
+  blocks_fd = -1;
 }
 
 //==================================================================== blocks_get_block =//
 // Get the given block, returning a pointer to its start.
-void *blocks_get_block(int bnum) {return blocks_base + BLOCK_SIZE * bnum;}
+void *blocks_get_block(int bnum) {return blocks_base + (size_t)bnum * BLOCK_SIZE;}
+
+//==================================================================== blocks_get_data =//
+// Get the given block of file data, returning a pointer to its start.
+void *blocks_get_data(int bnum) {return blocks_data + (size_t)bnum * BLOCK_SIZE;}
+
+//==================================================================== blocks_sync_data =//
+// Write count blocks of file data back to the image (synchronously).
+int blocks_sync_data(int bnum, int count) {
+  return msync(blocks_get_data(bnum), (size_t)count * BLOCK_SIZE, MS_SYNC);
+}
+
+//==================================================================== get_superblock =//
+// Return a pointer to the superblock (block 0).
+superblock_t *get_superblock() {return blocks_get_block(0);}
 
 //==================================================================== get_bocks_bitmap =//
 // Return a pointer to the beginning of the block bitmap.
 // The size is BLOCK_BITMAP_SIZE bytes.
-void *get_blocks_bitmap() {return blocks_get_block(0);}
+void *get_blocks_bitmap() {return blocks_get_block(get_superblock()->block_bitmap);}
 
 //==================================================================== get_inode_bitmap =//
 // Return a pointer to the beginning of the inode table bitmap.
-// The inode bitmap is stored immediately after the block bitmap
-void *get_inode_bitmap() {return blocks_get_block(0) + BLOCK_BITMAP_SIZE;}
+// The size is INODE_BITMAP_SIZE bytes.
+void *get_inode_bitmap() {return blocks_get_block(get_superblock()->inode_bitmap);}
 
-//==================================================================== alloc_block =//
-// Allocate a new block and return its index.
-int alloc_block() {
+//==================================================================== alloc_blocks =//
+// Allocate up to count contiguous blocks, returning the first one's index.
+// Prefers a whole run, searching on from where the last allocation ended;
+// on a fragmented disk it settles for a shorter run, and only grows the
+// image (doubling, up to max_blocks) when every block is used.
+static int next_free = 0; // rotating hint
+
+// Serializes changes to the block bitmap (and growing the image)
+static pthread_mutex_t alloc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int alloc_blocks(int count, int *got) {
   void *bbm = get_blocks_bitmap();
+  superblock_t *sb = get_superblock();
+
+  pthread_mutex_lock(&alloc_lock);
+  for (;;) {
+    if (next_free < sb->data_start || next_free >= BLOCK_COUNT) {
+      next_free = sb->data_start;
+    }
+
+    // a whole run: after the hint, else anywhere
+    int first = bitmap_find_zero_run(bbm, next_free, BLOCK_COUNT, count);
+    if (first < 0) {
+      first = bitmap_find_zero_run(bbm, sb->data_start, BLOCK_COUNT, count);
+    }
+    int len = count;
+
+    // else the first free block and whatever free blocks follow it
+    if (first < 0) {
+      first = bitmap_find_first_zero(bbm, next_free, BLOCK_COUNT);
+      if (first < 0) {
+        first = bitmap_find_first_zero(bbm, sb->data_start, BLOCK_COUNT);
+      }
+      for (len = 1; first >= 0 && len < count && first + len < BLOCK_COUNT &&
+                    !bitmap_get(bbm, first + len); ++len);
+    }
 
-  for (int ii = 1; ii < BLOCK_COUNT; ++ii) {
-    if (!bitmap_get(bbm, ii)) {
-      bitmap_put(bbm, ii, 1);
-      printf("+ alloc_block() -> %d\n", ii);
-      return ii;
+    if (first >= 0) {
+      for (int ii = first; ii < first + len; ++ii) {
+        bitmap_put(bbm, ii, 1);
+      }
+      journal_dirty_ptr((uint8_t *)bbm + first / 8, (first + len - 1) / 8 - first / 8 + 1);
+      next_free = first + len;
+      *got = len;
+      pthread_mutex_unlock(&alloc_lock);
+      return first;
+    }
+
+    // only the new blocks are free after growing
+    next_free = BLOCK_COUNT;
+    int grown = BLOCK_COUNT > sb->max_blocks / 2 ? sb->max_blocks : BLOCK_COUNT * 2;
+    if (blocks_grow(grown) != 0) {
+      pthread_mutex_unlock(&alloc_lock);
+      return -1;  // disk full
     }
   }
-  return -1;
+}
+
+//==================================================================== alloc_block =//
+// Allocate a new block and return its index.
+int alloc_block() {
+  int got;
+  return alloc_blocks(1, &got);
 }
 
 //==================================================================== free_block =//
-// Deallocate the block with the given index.
+// Deallocate the block with the given index (once the journal allows).
 void free_block(int bnum) {
-  printf("+ free_block(%d)\n", bnum);
+  journal_free_block(bnum);
+}
+
+//==================================================================== blocks_release_freed =//
+// Mark blocks the journal is done with free in the block bitmap.
+void blocks_release_freed(const int *bnums, int count) {
   void *bbm = get_blocks_bitmap();
-  bitmap_put(bbm, bnum, 0);
+  pthread_mutex_lock(&alloc_lock);
+  for (int ii = 0; ii < count; ++ii) {
+    bitmap_put(bbm, bnums[ii], 0);
+  }
+  pthread_mutex_unlock(&alloc_lock);
 }
@@ -5,21 +5,53 @@
  * A block-based abstraction over a disk image file.
  *
  * The disk image is mmapped, so block data is accessed using pointers.
+ * It is mapped twice: metadata goes through a private mapping and reaches
+ * the image only by way of the journal (see journal.h), while file data
+ * goes through a shared mapping (blocks_get_data).
+ *
+ * Block 0 holds a superblock describing the layout of the image:
+ *
+ *   | super | block bitmap | inode bitmap | inode table | journal | data ... |
+ *
+ * The block bitmap has room for max_blocks blocks, so the image file can
+ * grow (when alloc_block runs out of blocks) up to that size while mounted.
  */
 #ifndef BLOCKS_H
 #define BLOCKS_H
 
 #include <stdio.h>
 
-extern const int BLOCK_COUNT; // we split the "disk" into blocks (default = 256)
-extern const int BLOCK_SIZE;  // default = 4K
-extern const int NUFS_SIZE;   // default = 1MB
+#define NUFS_MAGIC 0x5346554e  // "NUFS"
 
+#define DEFAULT_BLOCK_COUNT 512  // 2MB image
+#define DEFAULT_INODE_COUNT 256
+#define DEFAULT_MAX_BLOCKS (1 << 18)  // Grow up to 1GB
+#define DEFAULT_JOURNAL_BLOCKS 256  // 1MB (a group holds 127 blocks)
+
+// On-disk layout (block 0 of the image)
+typedef struct superblock {
+  int magic;        // NUFS_MAGIC
+  int block_size;   // BLOCK_SIZE when formatted
+  int block_count;  // Blocks in the image file now
+  int max_blocks;   // Blocks the image can grow to
+  int inode_count;  // Inodes in the inode table
+  int block_bitmap; // First block of the block bitmap
+  int inode_bitmap; // First block of the inode bitmap
+  int inode_table;  // First block of the inode table
+  int data_start;   // First data block
+  int journal;        // First block of the journal
+  int journal_blocks; // Blocks in the journal (0: not journaled)
+} superblock_t;
+
+extern const int BLOCK_SIZE;  // = 4K
 extern const int INODE_SIZE;  // sizeof(inode_t) = 64
-extern const int INODE_COUNT; // default = 256
 
-extern const int BLOCK_BITMAP_SIZE; // default = 256 / 8 = 32
-extern const int INODE_BITMAP_SIZE; // default = 32
+// Read from the superblock by blocks_init
+extern int BLOCK_COUNT; // we split the "disk" into blocks (default = 256)
+extern int INODE_COUNT; // default = 256
+
+extern int BLOCK_BITMAP_SIZE; // bytes, default = (1 << 18) / 8 = 32K
+extern int INODE_BITMAP_SIZE; // bytes, default = 256 / 8 = 32
 
 /**
  * Compute the number of blocks needed to store the given number of bytes.
@@ -30,15 +62,46 @@ extern const int INODE_BITMAP_SIZE; // default = 32
  */
 int bytes_to_blocks(int bytes);
 
+/**
+ * Create a disk image with the given geometry.
+ *
+ * Overwrites whatever the file held. Only block metadata is written; the
+ * root directory is created by the first storage_init.
+ *
+ * @param image_path Path to the disk image file.
+ * @param block_count Blocks in the new image.
+ * @param inode_count Inodes in the inode table.
+ * @param max_blocks Blocks the image may grow to (at least block_count).
+ * @param journal_blocks Blocks in the metadata journal (0 for none).
+ *
+ * @return 0 on success, -1 if the geometry doesn't fit or on I/O error.
+ */
+int blocks_format(const char *image_path, int block_count, int inode_count,
+                  int max_blocks, int journal_blocks);
+
 /**
  * Load and initialize the given disk image.
  *
+ * An empty (or new) file is first formatted with the default geometry.
+ * The journal is replayed before the image is mapped.
+ *
  * @param image_path Path to the disk image file.
  */
 void blocks_init(const char *image_path);
 
 /**
- * Close the disk image.
+ * Grow the mounted image to the given number of blocks.
+ *
+ * Block pointers stay valid: the mapping already spans max_blocks.
+ *
+ * @param block_count New number of blocks.
+ *
+ * @return 0 on success, -1 if past max_blocks or on I/O error.
+ */
+int blocks_grow(int block_count);
+
+/**
+ * Commit the journal and close the disk image.
  */
 void blocks_free();
 
@@ -51,6 +114,35 @@ void blocks_free();
  */
 void *blocks_get_block(int bnum);
 
+/**
+ * Get a data block of a regular file, returning a pointer to its start.
+ *
+ * Unlike blocks_get_block, writes through this pointer go straight to the
+ * image file and are not journaled.
+ *
+ * @param bnum Block number (index).
+ *
+ * @return Pointer to the beginning of the block in memory.
+ */
+void *blocks_get_data(int bnum);
+
+/**
+ * Write file data blocks back to the image and wait for them.
+ *
+ * @param bnum First block number.
+ * @param count Number of blocks.
+ *
+ * @return 0 on success, -1 on I/O error.
+ */
+int blocks_sync_data(int bnum, int count);
+
+/**
+ * Return a pointer to the superblock.
+ *
+ * @return A pointer to the superblock (block 0).
+ */
+superblock_t *get_superblock();
+
 /**
  * Return a pointer to the beginning of the block bitmap.
  *
@@ -68,17 +160,43 @@ void *get_inode_bitmap();
 /**
  * Allocate a new block and return its number.
  *
- * Grabs the first unused block and marks it as allocated.
+ * Grabs the first unused block and marks it as allocated, growing the
+ * image if all blocks are used.
  *
- * @return The index of the newly allocated block.
+ * @return The index of the newly allocated block, else -1 (disk full).
  */
 int alloc_block();
 
+/**
+ * Allocate up to count contiguous blocks.
+ *
+ * Returns a run of count blocks if there is one anywhere; on a fragmented
+ * disk the run may be shorter (but is at least one block). Like
+ * alloc_block and free_block, safe to call from several threads.
+ *
+ * @param count The number of blocks wanted.
+ * @param got Set to the number of blocks allocated.
+ *
+ * @return The index of the first block, else -1 (disk full).
+ */
+int alloc_blocks(int count, int *got);
+
 /**
  * Deallocate the block with the given number.
  *
+ * The block stays allocated until the journal says it may be reused
+ * (see journal_free_block).
+ *
  * @param bnun The block number to deallocate.
  */
 void free_block(int bnum);
 
+/**
+ * Make blocks freed earlier available again (called by the journal).
+ *
+ * @param bnums The block numbers.
+ * @param count The number of blocks.
+ */
+void blocks_release_freed(const int *bnums, int count);
+
 #endif
@@ -0,0 +1,130 @@
+#include <sched.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "dcache.h"
+#include "directory.h"
+
+// One cached name. Lookups don't lock: an entry is written between two
+// increments of seq, and a lookup that sees seq odd or changed while it
+// read the entry counts as a miss.
+typedef struct dcache_entry {
+  atomic_uint seq;             // Odd while the entry is being written
+  int pinum;                   // Parent directory (0 = slot unused)
+  int inum;                    // Inum, or negative if name doesn't exist
+  unsigned int hash;           // Hash of (pinum, name)
+  char name[DIR_NAME_LENGTH];  // Name in parent directory
+} dcache_entry_t;
+
+static dcache_entry_t dcache[DCACHE_SIZE];
+
+//============================================================== dcache_hash =//
+// FNV-1a hash of parent inum & name
+static unsigned int dcache_hash(int pinum, const char *name, int len) {
+  unsigned int h = (2166136261u ^ (unsigned int)pinum) * 16777619u;
+  for (int i = 0; i < len; i++) {
+    h = (h ^ (unsigned char)name[i]) * 16777619u;
+  }
+  return h;
+}
+
+//============================================================== dcache_slot_lock =//
+// Start writing an entry (waits for another writer of the same slot)
+static void dcache_slot_lock(dcache_entry_t *entry) {
+  for (;;) {
+    unsigned int seq = atomic_load_explicit(&entry->seq, memory_order_relaxed);
+    if (!(seq & 1) &&
+        atomic_compare_exchange_weak_explicit(&entry->seq, &seq, seq + 1,
+                                              memory_order_acquire,
+                                              memory_order_relaxed)) {
+      // The odd seq must be visible before any of the entry's new fields
+      atomic_thread_fence(memory_order_release);
+      return;
+    }
+    sched_yield();
+  }
+}
+
+//============================================================== dcache_slot_unlock =//
+// Finish writing an entry
+static void dcache_slot_unlock(dcache_entry_t *entry) {
+  atomic_fetch_add_explicit(&entry->seq, 1, memory_order_release);
+}
+
+//============================================================== dcache_clear =//
+// Forget all entries (before any other thread uses the cache)
+void dcache_clear() {
+  memset(dcache, 0, sizeof(dcache));
+}
+
+//============================================================== dcache_lookup =//
+// Look up a name in the cache
+// Args:
+// - pinum: Inum of parent directory
+// - name: Name within directory
+// - len: Length of name
+// - inum: Set to the cached inum (or negative) on a hit
+// Returns 1 on a hit, else 0
+int dcache_lookup(int pinum, const char *name, int len, int *inum) {
+  if (len >= DIR_NAME_LENGTH) {
+    return 0;  // Never cached
+  }
+
+  unsigned int hash = dcache_hash(pinum, name, len);
+  dcache_entry_t *entry = &dcache[hash & (DCACHE_SIZE - 1)];
+
+  unsigned int seq = atomic_load_explicit(&entry->seq, memory_order_acquire);
+  if (seq & 1) {
+    return 0;  // Being written: miss rather than wait
+  }
+  int hit = entry->pinum == pinum && entry->hash == hash &&
+            memcmp(entry->name, name, len) == 0 && entry->name[len] == '\0';
+  int cached = entry->inum;
+
+  atomic_thread_fence(memory_order_acquire);
+  if (!hit || atomic_load_explicit(&entry->seq, memory_order_relaxed) != seq) {
+    return 0;  // Miss (or rewritten while we read it)
+  }
+  *inum = cached;
+  return 1;  // Hit
+}
+
+//============================================================== dcache_put =//
+// Cache name -> inum in a directory (evicting the slot's old entry)
+// Args:
+// - pinum: Inum of parent directory
+// - name: Name within directory
+// - len: Length of name
+// - inum: Inum of name, or negative if it doesn't exist
+void dcache_put(int pinum, const char *name, int len, int inum) {
+  if (len >= DIR_NAME_LENGTH) {
+    return;  // Can't be in a directory anyway
+  }
+
+  unsigned int hash = dcache_hash(pinum, name, len);
+  dcache_entry_t *entry = &dcache[hash & (DCACHE_SIZE - 1)];
+
+  dcache_slot_lock(entry);
+  entry->pinum = pinum;
+  entry->inum = inum;
+  entry->hash = hash;
+  memcpy(entry->name, name, len);
+  entry->name[len] = '\0';
+  dcache_slot_unlock(entry);
+}
+
+//============================================================== dcache_forget_dir =//
+// Drop every entry of a directory, so a reused inum doesn't inherit them
+// Args:
+// - pinum: Inum of directory
+void dcache_forget_dir(int pinum) {
+  for (int i = 0; i < DCACHE_SIZE; i++) {
+    if (dcache[i].pinum == pinum) {
+      dcache_slot_lock(&dcache[i]);
+      if (dcache[i].pinum == pinum) {
+        dcache[i].pinum = 0;  // Recheck: may have been reused meanwhile
+      }
+      dcache_slot_unlock(&dcache[i]);
+    }
+  }
+}
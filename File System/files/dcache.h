@@ -0,0 +1,31 @@
+// Directory entry cache.
+//
+// Remembers (parent inum, name) -> inum for recent lookups, including
+// names that don't exist (negative entries), so walking a hot path costs
+// one hash probe per component instead of a directory block scan. The
+// directory code keeps it coherent: every put and delete updates the
+// entry for that name, and names are only cached while holding the
+// directory's inode lock. Lookups take no lock at all.
+
+#ifndef DCACHE_H
+#define DCACHE_H
+
+// Number of cached entries (power of 2); a new entry evicts whatever
+// was in its slot
+#define DCACHE_SIZE 4096
+
+// Forget all entries (for a newly loaded disk image)
+void dcache_clear();
+
+// Look up a name (len bytes, need not be NUL-terminated) in the cache
+// Returns 1 and sets *inum (negative if the name doesn't exist) on a hit,
+// else 0
+int dcache_lookup(int pinum, const char *name, int len, int *inum);
+
+// Record that name in directory pinum is inum (negative: doesn't exist)
+void dcache_put(int pinum, const char *name, int len, int inum);
+
+// Forget all entries of a directory (before its inode is freed)
+void dcache_forget_dir(int pinum);
+
+#endif // DCACHE_H
@@ -1,5 +1,202 @@
 #include "directory.h"
-#define TOTAL_DIRENTS BLOCK_SIZE / sizeof(dirent_t)
+#include "dcache.h"
+#include "path.h"
+#include "journal.h"
+// Entries per directory block (its last bytes link the next block of its
+// bucket, see dirent_link)
+#define TOTAL_DIRENTS ((BLOCK_SIZE - sizeof(int)) / sizeof(dirent_t))
+
+// Directories are linear hash tables: file block b of a directory is the
+// first block of bucket b, which chains overflow blocks of its own when it
+// fills. With n buckets and 2^level <= n < 2^(level+1), a name hashes to
+// bucket h mod 2^level, or h mod 2^(level+1) if that one has already been
+// split (n - 2^level buckets have). A put that finds its bucket full
+// splits the next bucket in line into a new block at the end, once, and
+// then takes an overflow block if its bucket is still full. So a put
+// changes a few blocks (within one operation's journal credits), and
+// lookups read a bucket's few blocks however large the directory grows.
+
+// Stop splitting here (pathological hash collisions)
+#define DIR_MAX_BUCKETS (1 << 20)
+
+// Longest chain a split moves entries out of (only a bucket of colliding
+// hashes gets longer, and is left to grow rather than split)
+#define DIR_SPLIT_BLOCKS 4
+
+//============================================================== dirent_hash =//
+// FNV-1a hash of an entry name
+static unsigned int dirent_hash(const char *name, int len) {
+  unsigned int h = 2166136261u;
+  for (int i = 0; i < len; i++) {
+    h = (h ^ (unsigned char)name[i]) * 16777619u;
+  }
+  return h;
+}
+
+//============================================================== dirent_matches =//
+// Check if a filled entry has the given name (len bytes, not NUL-terminated)
+static int dirent_matches(dirent_t *entry, unsigned int hash, const char *name,
+                          int len) {
+  return entry->filled == 1 && entry->hash == hash &&
+         memcmp(entry->name, name, len) == 0 && entry->name[len] == '\0';
+}
+
+//============================================================== dirent_link =//
+// Get the block number of the next block in a bucket's chain, kept after
+// the block's entries (0 = none)
+static int *dirent_link(dirent_t *block) {
+  return (int *)((char *)block + BLOCK_SIZE) - 1;
+}
+
+//============================================================== dirent_next =//
+// Get the next block in a bucket's chain, else NULL
+static dirent_t *dirent_next(dirent_t *block) {
+  int bnum = *dirent_link(block);
+  return bnum > 0 ? blocks_get_block(bnum) : NULL;
+}
+
+//============================================================== dirent_extend =//
+// Add an empty overflow block after the last block of a bucket's chain
+// Returns pointer to it, else NULL (disk full)
+static dirent_t *dirent_extend(dirent_t *last) {
+  int bnum = alloc_block();
+  if (bnum <= 0) {
+    return NULL;
+  }
+  dirent_t *block = blocks_get_block(bnum);
+  memset(block, 0, BLOCK_SIZE);
+  journal_dirty(bnum);
+  *dirent_link(last) = bnum;
+  journal_dirty_ptr(dirent_link(last), sizeof(int));
+  return block;
+}
+
+//============================================================== dirent_drop_empty =//
+// Free the overflow block after prev if it has no entries left
+// Returns 1 if it was freed, else 0
+static int dirent_drop_empty(dirent_t *prev) {
+  dirent_t *block = dirent_next(prev);
+  for (int i = 0; i < TOTAL_DIRENTS; i++) {
+    if (block[i].filled == 1) {
+      return 0;
+    }
+  }
+  int bnum = *dirent_link(prev);
+  *dirent_link(prev) = *dirent_link(block);
+  journal_dirty_ptr(dirent_link(prev), sizeof(int));
+  free_block(bnum);
+  return 1;
+}
+
+//============================================================== dirent_free_chain =//
+// Free the overflow blocks after block (which is freed along with them, so
+// its link is left as is)
+static void dirent_free_chain(dirent_t *block) {
+  for (int bnum = *dirent_link(block); bnum > 0; ) {
+    int next = *dirent_link(blocks_get_block(bnum));
+    free_block(bnum);
+    bnum = next;
+  }
+}
+
+//============================================================== directory_buckets =//
+// Number of buckets (blocks) of a directory
+static int directory_buckets(inode_t *dd) {
+  return dd->size / BLOCK_SIZE;
+}
+
+//============================================================== directory_bucket =//
+// Get the bucket an entry with the given hash belongs in
+// Args:
+// - dd: Pointer to inode (directory)
+// - hash: dirent_hash of the name
+// Returns pointer to the bucket's first block, else NULL (empty directory)
+static dirent_t *directory_bucket(inode_t *dd, unsigned int hash) {
+  int n = directory_buckets(dd);
+  if (n == 0) {
+    return NULL;
+  }
+
+  unsigned int low = 1;  // 2^level
+  while (low * 2 <= n) low *= 2;
+
+  unsigned int b = hash & (low - 1);
+  if (b < n - low) {
+    b = hash & (low * 2 - 1);  // Already split
+  }
+  return blocks_get_block(inode_get_bnum(dd, b));
+}
+
+//============================================================== directory_split =//
+// Add a bucket, moving over the entries of the bucket it splits
+// Args:
+// - dd: Pointer to inode (directory)
+// Returns 0 if successful, else negative (disk full, or the bucket in line
+// is too long to split in one operation)
+static int directory_split(inode_t *dd) {
+  int n = directory_buckets(dd);
+  if (n >= DIR_MAX_BUCKETS) {
+    return -ENOSPC;
+  }
+  if (n == 0) {
+    return grow_inode(dd, BLOCK_SIZE);  // First bucket (zeroed)
+  }
+
+  unsigned int low = 1;  // 2^level before the split
+  while (low * 2 <= n) low *= 2;
+  unsigned int mask = low * 2 - 1;
+
+  // Count the entries moving before changing anything
+  dirent_t* from = blocks_get_block(inode_get_bnum(dd, n - low));
+  int blocks = 0;
+  int moving = 0;
+  for (dirent_t* block = from; block; block = dirent_next(block)) {
+    blocks++;
+    for (int i = 0; i < TOTAL_DIRENTS; i++) {
+      moving += block[i].filled == 1 && (block[i].hash & mask) == n;
+    }
+  }
+  if (blocks > DIR_SPLIT_BLOCKS) {
+    return -ENOSPC;  // More than an operation may change
+  }
+
+  int rv = grow_inode(dd, BLOCK_SIZE);  // New bucket n (zeroed)
+  if (rv < 0) {
+    return rv;
+  }
+  dirent_t* to = blocks_get_block(inode_get_bnum(dd, n));
+  dirent_t* last = to;
+  for (int b = 1; b * TOTAL_DIRENTS < moving; b++) {
+    if ((last = dirent_extend(last)) == NULL) {
+      dirent_free_chain(to);  // Disk full: undo
+      shrink_inode(dd, BLOCK_SIZE);
+      return -ENOSPC;
+    }
+  }
+
+  int moved = 0;
+  for (dirent_t* block = from; block; block = dirent_next(block)) {
+    for (int i = 0; i < TOTAL_DIRENTS; i++) {
+      if (block[i].filled == 1 && (block[i].hash & mask) == n) {
+        if (moved == TOTAL_DIRENTS) {
+          to = dirent_next(to);
+          moved = 0;
+        }
+        to[moved++] = block[i];
+        memset(&block[i], 0, sizeof(dirent_t));
+        journal_dirty_ptr(&block[i], sizeof(dirent_t));
+      }
+    }
+  }
+
+  // Overflow blocks left empty go (the first block stays)
+  for (dirent_t* prev = from; dirent_next(prev); ) {
+    if (!dirent_drop_empty(prev)) {
+      prev = dirent_next(prev);
+    }
+  }
+  return 0;
+}
 
 //============================================================== directory_init =//
 // Initializes the root node directory
@@ -13,15 +210,15 @@ void directory_init() {
   }
 
   bitmap_put(ibm, i, 1);  // Mark used (root inode)
+  journal_dirty_ptr((char*)ibm + i / 8, 1);
   inode_t* new_dir_inode = get_inode(i);
+  journal_dirty_ptr(new_dir_inode, sizeof(inode_t));
 
 
   memset(new_dir_inode, 0, sizeof(inode_t));  // Init inode struct
   new_dir_inode->mode = 040755;  // Set dir permissions
   new_dir_inode->refs = 1;  // Init # references
-  new_dir_inode->size = 0;  // Init size
-  new_dir_inode->block = alloc_block();  // Alloc block for content (directory)
-  new_dir_inode->next_inode = -1;  // No inode (next)
+  new_dir_inode->size = 0;  // Init size (bucket allocated on first entry)
 
   new_dir_inode->atime = time(NULL);  // Set time accessed
   new_dir_inode->mtime = time(NULL);  // Set time modded
@@ -38,84 +235,212 @@ void directory_init() {
 // - name: Name of file/directory
 // Returns inum of file/directory if found, else -ENOENT
 int directory_lookup(inode_t* dd, const char* name) {
-  dirent_t* dir_contents = blocks_get_block(dd->block);
+  return directory_lookup_n(dd, name, strlen(name));
+}
 
-  for (int i = 0; i < TOTAL_DIRENTS; i++) {
-    if (strcmp(dir_contents[i].name, name) == 0) {
-      return dir_contents[i].inum;  // Found requested entry
+//============================================================== directory_lookup_n =//
+// Lookup file/directory within directory, by a name that is a span of a path
+// Args:
+// - dd: Pointer to inode (directory)
+// - name: Name of file/directory (need not be NUL-terminated)
+// - len: Length of name
+// Returns inum of file/directory if found, else -ENOENT
+int directory_lookup_n(inode_t* dd, const char* name, int len) {
+  if (len >= DIR_NAME_LENGTH) {
+    return -ENOENT;  // Too long to be in any directory
+  }
+
+  int pinum = inode_get_inum(dd);
+  int inum;
+  if (dcache_lookup(pinum, name, len, &inum)) {
+    return inum < 0 ? -ENOENT : inum;  // Cached (maybe as missing)
+  }
+
+  inum = -ENOENT;
+  unsigned int hash = dirent_hash(name, len);
+  for (dirent_t* block = directory_bucket(dd, hash); block && inum < 0;
+       block = dirent_next(block)) {
+    for (int i = 0; i < TOTAL_DIRENTS; i++) {
+      if (dirent_matches(&block[i], hash, name, len)) {
+        inum = block[i].inum;  // Found requested entry
+        break;
+      }
     }
   }
 
-  return -ENOENT;  // Entry not found
+  dcache_put(pinum, name, len, inum);
+  return inum;
 }
 
 //============================================================== tree_lookup =//
-// Recursively lookup inum of path
+// Lookup inum of path
 // Args:
 // - path: lookup path
 // Returns inum (last component in path), else -1 
 int tree_lookup(const char* path) {
-  slist_t* file_path = s_explode(path, '/');
-  slist_t* curr_file = file_path;
-  int inode_num = ROOT_INODE;
-  inode_t* root_inode = get_inode(inode_num);
+  return tree_lookup_n(path, strlen(path));
+}
 
+//============================================================== tree_lookup_n =//
+// Lookup inum of the first len bytes of path, component by component
+// (without copying them). Cached components cost no locking; otherwise
+// each directory is read locked while it is searched (one at a time).
+// Args:
+// - path: lookup path
+// - len: Length of path to look up (0 = root)
+// Returns inum (last component in path), else -1 
+int tree_lookup_n(const char* path, int len) {
+  const char* rest = path;
+  path_span_t part;
+  int inode_num = ROOT_INODE;
 
-  while (curr_file) {
-    if (strcmp(curr_file->data, "") != 0) {
-      inode_t* node = get_inode(inode_num);
-      inode_num = directory_lookup(node, curr_file->data);
+  while (path_next(&rest, path + len, &part)) {
+    int pinum = inode_num;
+    if (dcache_lookup(pinum, part.start, part.len, &inode_num)) {
       if (inode_num < 0) {
-        return -1;  // Componenet not found in path
+        return -1;  // Known to be missing
       }
+      continue;  // Only directories have cached entries
+    }
+
+    inode_read_lock(pinum);
+    inode_t* node = get_inode(pinum);
+    if (node == NULL || !S_ISDIR(node->mode)) {
+      inode_num = -1;  // Not a directory (or removed meanwhile)
+    } else {
+      inode_num = directory_lookup_n(node, part.start, part.len);
+    }
+    inode_unlock(pinum);
+
+    if (inode_num < 0) {
+      return -1;  // Componenet not found in path
     }
-    curr_file = curr_file->next;
   }
 
   return inode_num;
 }
 
+//============================================================== directory_free_entry =//
+// Find a free entry in the bucket an entry with the given hash belongs in
+// Args:
+// - dd: Pointer to inode (directory)
+// - hash: dirent_hash of the name
+// - last: Set to the last block of the bucket's chain (NULL if no buckets)
+// Returns pointer to the entry, else NULL (bucket full)
+static dirent_t *directory_free_entry(inode_t *dd, unsigned int hash,
+                                      dirent_t **last) {
+  *last = NULL;
+  for (dirent_t* block = directory_bucket(dd, hash); block;
+       block = dirent_next(block)) {
+    for (int i = 0; i < TOTAL_DIRENTS; i++) {
+      if (block[i].filled != 1) {
+        return &block[i];
+      }
+    }
+    *last = block;
+  }
+  return NULL;
+}
+
 //============================================================== directory_put =//
 // Add entry to directory
 // Args:
 // - dd: Pointer to inode (directory)
 // - name: Name of new entry.
 // - inum: Inum of new entry.
-// Returns 0 if successful, else -1 (directory full)
+// Returns 0 if successful, else negative (name too long, no space left)
 int directory_put(inode_t* dd, const char* name, int inum) {
-  dirent_t* dir_contents = blocks_get_block(dd->block);
+  if (strlen(name) >= DIR_NAME_LENGTH) {
+    return -ENAMETOOLONG;
+  }
+  unsigned int hash = dirent_hash(name, strlen(name));
 
-  for (int i = 0; i < TOTAL_DIRENTS; i++) {
-    if (dir_contents[i].filled != 1) {
-      dir_contents[i].inum = inum;
-      strcpy(dir_contents[i].name, name);
-      dir_contents[i].filled = 1;
-      return 0;  // Added entry
+  dirent_t* last;
+  dirent_t* entry = directory_free_entry(dd, hash, &last);
+  if (entry == NULL) {
+    // Bucket full: split the next one in line (which may be this one),
+    // then take an overflow block if there is still no room
+    directory_split(dd);
+    entry = directory_free_entry(dd, hash, &last);
+    if (entry == NULL && (last == NULL || (entry = dirent_extend(last)) == NULL)) {
+      return -ENOSPC;
     }
   }
-  return -1;  // No space left in directory
+
+  memset(entry, 0, sizeof(dirent_t));
+  strcpy(entry->name, name);
+  entry->inum = inum;
+  entry->hash = hash;
+  entry->filled = 1;
+  journal_dirty_ptr(entry, sizeof(dirent_t));
+  dcache_put(inode_get_inum(dd), name, strlen(name), inum);
+  return 0;  // Added entry
 }
 
 //============================================================== directory_delete =//
-// Delete entry from directory
+// Delete entry from directory (freeing the overflow block it empties)
 // Args:
 // - dd: Pointer to inode (directory)
 // - name: Name of entry
 // Returns 0 if successful, else -1 (entry not found)
 int directory_delete(inode_t* dd, const char* name) {
-  dirent_t* dir_contents = blocks_get_block(dd->block);  // Get contents of directory
+  int len = strlen(name);
+  if (len >= DIR_NAME_LENGTH) {
+    return -1;  // Name can't be in it
+  }
+  unsigned int hash = dirent_hash(name, len);
 
-  for (int i = 0; i < TOTAL_DIRENTS; i++) {
-    // Cmpare current name with target naem
-    if (strcmp(dir_contents[i].name, name) == 0) {
-      dir_contents[i].filled = 0; // Mark entry unfilled(deleted)
-      return 0;  // Deleted entry
+  dirent_t* prev = NULL;
+  for (dirent_t* block = directory_bucket(dd, hash); block;
+       prev = block, block = dirent_next(block)) {
+    for (int i = 0; i < TOTAL_DIRENTS; i++) {
+      // Cmpare current name with target naem
+      if (dirent_matches(&block[i], hash, name, len)) {
+        memset(&block[i], 0, sizeof(dirent_t)); // Mark entry unfilled(deleted)
+        journal_dirty_ptr(&block[i], sizeof(dirent_t));
+        dcache_put(inode_get_inum(dd), name, len, -ENOENT);
+        if (prev != NULL) {
+          dirent_drop_empty(prev);
+        }
+        return 0;  // Deleted entry
+      }
     }
   }
 
   return -1;  // Entry not found
 }
 
+//============================================================== directory_release =//
+// Free a directory's overflow blocks (before its inode is freed, which
+// frees the rest)
+// Args:
+// - dd: Pointer to inode (directory)
+void directory_release(inode_t* dd) {
+  for (int b = 0; b < directory_buckets(dd); b++) {
+    dirent_free_chain(blocks_get_block(inode_get_bnum(dd, b)));
+  }
+}
+
+//============================================================== directory_is_empty =//
+// Check if directory has no entries but "." and ".."
+// Args:
+// - dd: Pointer to inode (directory)
+// Returns 1 if empty, else 0
+int directory_is_empty(inode_t* dd) {
+  for (int b = 0; b < directory_buckets(dd); b++) {
+    dirent_t* bucket = blocks_get_block(inode_get_bnum(dd, b));
+    for (; bucket; bucket = dirent_next(bucket)) {
+      for (int i = 0; i < TOTAL_DIRENTS; i++) {
+        if (bucket[i].filled == 1 && strcmp(bucket[i].name, ".") != 0 &&
+            strcmp(bucket[i].name, "..") != 0) {
+          return 0;
+        }
+      }
+    }
+  }
+  return 1;
+}
+
 //============================================================== directory_list =//
 // List entries in directory
 // Args:
@@ -126,23 +451,28 @@ dirent_node_t *directory_list(const char* path, int inum) {
   if (path) inum = tree_lookup(path);  // If path, lookup inum
 
   inode_t* dd = get_inode(inum);  // Get inode of directory
-  dirent_t* dir_contents = blocks_get_block(dd->block);  // Get content of directory from inode
   dirent_node_t* dirents = NULL;  // Init head of list
 
-  // Each entry in directory
-  for (int i = 0; i < TOTAL_DIRENTS; i++) {
-    // Check entry filled
-    if (dir_contents[i].filled == 1) {
-      dirent_node_t* tmp = malloc(sizeof(dirent_node_t));  // Allocate mem for new 
-      tmp->entry = dir_contents[i];  // Copy entry into new
-
-      // IF first entry, init list
-      if (!dirents) {
-        dirents = tmp;
-        list_init(&dirents->dirent_list);
+  // Each entry in each bucket of directory
+  for (int b = 0; b < directory_buckets(dd); b++) {
+    dirent_t* dir_contents = blocks_get_block(inode_get_bnum(dd, b));
+
+    for (; dir_contents; dir_contents = dirent_next(dir_contents)) {
+      for (int i = 0; i < TOTAL_DIRENTS; i++) {
+        // Check entry filled
+        if (dir_contents[i].filled == 1) {
+          dirent_node_t* tmp = malloc(sizeof(dirent_node_t));  // Allocate mem for new 
+          tmp->entry = dir_contents[i];  // Copy entry into new
+
+          // IF first entry, init list
+          if (!dirents) {
+            dirents = tmp;
+            list_init(&dirents->dirent_list);
+          }
+          // add entry to list
+          else list_add_after(&dirents->dirent_list, &tmp->dirent_list);
+        }
       }
-      // add entry to list
-      else list_add_after(&dirents->dirent_list, &tmp->dirent_list);
     }
   }
 
@@ -154,14 +484,17 @@ dirent_node_t *directory_list(const char* path, int inum) {
 // Args:
 // - dd: Pointer to inode (directory).
 void print_directory(inode_t* dd) {
-  // Get contents fo directory from inode
-  dirent_t* dir_contents = blocks_get_block(dd->block);
+  // Go over each entry of each bucket of directory
+  for (int b = 0; b < directory_buckets(dd); b++) {
+    dirent_t* dir_contents = blocks_get_block(inode_get_bnum(dd, b));
 
-  // Go over each entry of directory
-  for (int i = 0; i < TOTAL_DIRENTS; i++) {
-    // If entry filled(exists) print name
-    if (dir_contents[i].filled == 1) {
-      printf("-%s\n", dir_contents[i].name);  // Print entry names
+    for (; dir_contents; dir_contents = dirent_next(dir_contents)) {
+      for (int i = 0; i < TOTAL_DIRENTS; i++) {
+        // If entry filled(exists) print name
+        if (dir_contents[i].filled == 1) {
+          printf("-%s\n", dir_contents[i].name);  // Print entry names
+        }
+      }
     }
   }
 }
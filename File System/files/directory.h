@@ -8,6 +8,7 @@
 #include <string.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 
 #include "list.h"
 #include "inode.h"
@@ -18,7 +19,8 @@
 typedef struct dirent {
   char name[DIR_NAME_LENGTH];  // Name of file/directory
   int inum;  		       // Inum (entry)
-  char _reserved[12];          // Reserved space
+  unsigned int hash;           // Hash of name (picks the bucket)
+  char _reserved[8];           // Reserved space
   int filled;                  // Flag (if entry used)
 } dirent_t;
 
@@ -28,22 +30,37 @@ typedef struct dirent_node {
   list_entry_t dirent_list;    // List entry (link nodes)
 } dirent_node_t;
 
+// Functions taking a directory inode expect the caller to hold its lock
+// (inode_read_lock to look up or list, inode_write_lock to put or delete).
+
 // Init root node directory
 void directory_init();
 
 // Find inum of file/directory within given inode dir
 int directory_lookup(inode_t *dd, const char *name);
 
+// Same, for a name of len bytes (need not be NUL-terminated)
+int directory_lookup_n(inode_t *dd, const char *name, int len);
+
 // Lookup inum for given path
 int tree_lookup(const char *path);
 
-// Add file/directory to directory inode
+// Lookup inum for the first len bytes of path (no allocation)
+int tree_lookup_n(const char *path, int len);
+
+// Add file/directory to directory inode (a hash table of dirent blocks)
 int directory_put(inode_t *dd, const char *name, int inum);
 
 // Delete fike/directory to directory inode
 int directory_delete(inode_t *dd, const char *name);
 
-// Create list of directory entry for path
+// Free the overflow blocks of a directory that is being freed
+void directory_release(inode_t *dd);
+
+// Check if directory has no entries but "." and ".."
+int directory_is_empty(inode_t *dd);
+
+// Create list of directory entry for path (or inum, if path is NULL)
 dirent_node_t *directory_list(const char *path, int inum);
 
 // Print content of direcotry inode (console)
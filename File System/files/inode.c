@@ -1,11 +1,13 @@
-#define SIZE 64
-
 #include "inode.h"
+#include "journal.h"
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <limits.h>
+#include <pthread.h>
 #include <assert.h>
 #include <stdint.h>
 #include <sys/mman.h>
@@ -17,7 +19,7 @@
 // - node: Pointer to inode
 void print_inode(inode_t *node) {
   printf("inode: refs: %d, mode: %d, size: %d, block: %d\n", node->refs,
-         node->mode, node->size, node->block);
+         node->mode, node->size, node->direct[0]);
 }
 
 // Get inode from inum
@@ -25,49 +27,122 @@ void print_inode(inode_t *node) {
 // - inum: (inode)
 // Returns pointer to inode, else NULL
 inode_t *get_inode(int inum) {
-  assert(inum < SIZE);  // inum within range
+  assert(inum < INODE_COUNT);  // inum within range
   void *ibm = get_inode_bitmap();
 
   if (bitmap_get(ibm, inum) == 0) {
     return NULL;  // Retunr NULL if inode not allocated
   }
 
-  printf("getting inode %d\n", inum);
-  inode_t *inode_ptr = (inode_t *)blocks_get_block(2);
+  inode_t *inode_ptr = (inode_t *)blocks_get_block(get_superblock()->inode_table);
 
   return inode_ptr + inum;  // Return inode pointers
 }
 
+// Get inum of inode (from its place in the inode table)
+// Args:
+// - node: Pointer to inode
+// Returns inum
+int inode_get_inum(inode_t *node) {
+  return node - (inode_t *)blocks_get_block(get_superblock()->inode_table);
+}
+
+// Lock of each inode (INODE_COUNT of them)
+static pthread_rwlock_t *inode_locks = NULL;
+static int inode_locks_count = 0;
+
+// Create the inode locks (for a newly loaded disk image)
+void inode_locks_init() {
+  for (int i = 0; i < inode_locks_count; i++) {
+    pthread_rwlock_destroy(&inode_locks[i]);
+  }
+  free(inode_locks);
+
+  inode_locks = malloc(INODE_COUNT * sizeof(pthread_rwlock_t));
+  assert(inode_locks != NULL);
+  for (int i = 0; i < INODE_COUNT; i++) {
+    pthread_rwlock_init(&inode_locks[i], NULL);
+  }
+  inode_locks_count = INODE_COUNT;
+}
+
+// Lock inode for reading (shared with other readers)
+// Args:
+// - inum: (inode)
+void inode_read_lock(int inum) {
+  assert(inum >= 0 && inum < inode_locks_count);
+  pthread_rwlock_rdlock(&inode_locks[inum]);
+}
+
+// Lock inode for writing (exclusive); the inode joins the current
+// journal group
+// Args:
+// - inum: (inode)
+void inode_write_lock(int inum) {
+  assert(inum >= 0 && inum < inode_locks_count);
+  pthread_rwlock_wrlock(&inode_locks[inum]);
+  journal_dirty(get_superblock()->inode_table + inum / (BLOCK_SIZE / INODE_SIZE));
+}
+
+// Lock inode for writing file data (exclusive), leaving the inode itself
+// out of the journal group (grow_inode & shrink_inode add it if they
+// change it)
+// Args:
+// - inum: (inode)
+void inode_data_lock(int inum) {
+  assert(inum >= 0 && inum < inode_locks_count);
+  pthread_rwlock_wrlock(&inode_locks[inum]);
+}
+
+// Release inode lock taken by inode_read_lock/inode_write_lock/inode_data_lock
+// Args:
+// - inum: (inode)
+void inode_unlock(int inum) {
+  pthread_rwlock_unlock(&inode_locks[inum]);
+}
+
+// Where the next search for a free inode starts (rotates through the table)
+static int next_inum = ROOT_INODE + 1;
+
+// Serializes searches & changes of the inode bitmap (get_inode reads it
+// without the lock: bitmap_get & bitmap_put are atomic)
+static pthread_mutex_t inum_lock = PTHREAD_MUTEX_INITIALIZER;
+
 // Allocates new inode & returns inum
 // Returns inum of allocated inode, else -1
 int alloc_inode() {
   void *ibm = get_inode_bitmap();
-  printf("trying to allocate\n");
-
-  // Loop through inode bitmap (find unallocated inode)
-  for (int i = ROOT_INODE + 1; i < SIZE; i++) {
-    if (bitmap_get(ibm, i) == 0) {  // Check inode = free
-      bitmap_put(ibm, i, 1);  // Mark inode = used
-      inode_t *node = get_inode(i);
-
-      // Init inode
-      memset(node, 0, sizeof(inode_t));
-      node->refs = 0;
-      node->mode = 010644;
-      node->size = 0;
-      node->block = alloc_block();
-      node->next_inode = -1;
-      node->atime = time(NULL);
-      node->mtime = time(NULL);
-
-      printf("allocating inode at %d\n", i);
-      return i;  // Return allocated inum
-    }
+  pthread_mutex_lock(&inum_lock);
+
+  // Find unallocated inode (after the last one handed out, else anywhere)
+  int i = bitmap_find_first_zero(ibm, next_inum, INODE_COUNT);
+  if (i < 0) {
+    i = bitmap_find_first_zero(ibm, ROOT_INODE + 1, INODE_COUNT);
+  }
+  if (i < 0) {
+    pthread_mutex_unlock(&inum_lock);
+    return -1;  // No free inode found
   }
-  return -1;  // No free inode found
+
+  bitmap_put(ibm, i, 1);  // Mark inode = used
+  journal_dirty_ptr((uint8_t *)ibm + i / 8, 1);
+  next_inum = i + 1;
+  pthread_mutex_unlock(&inum_lock);
+  inode_t *node = get_inode(i);
+  journal_dirty_ptr(node, sizeof(inode_t));
+
+  // Init inode (no blocks until it grows)
+  memset(node, 0, sizeof(inode_t));
+  node->refs = 0;
+  node->mode = 010644;
+  node->size = 0;
+  node->atime = time(NULL);
+  node->mtime = time(NULL);
+
+  return i;  // Return allocated inum
 }
 
-// Frees inode & marks as unallocated in bitmap.
+// Frees inode & marks as unallocated in bitmap (caller holds its write lock).
 // Args:
 // - inum: Inode number of the inode to free.
 void free_inode(int inum) {
@@ -75,14 +150,183 @@ void free_inode(int inum) {
   inode_t *node = get_inode(inum);
 
   assert(node->refs == 0);
-  printf("freeing inode at %d\n", inum);
 
-  // Shrink inode to 0
+  // Shrink inode to 0 (frees all its blocks)
   shrink_inode(node, node->size);
-  free_block(node->block);  // Free block
 
   memset(node, 0, sizeof(inode_t));  // Clear inode data
+  pthread_mutex_lock(&inum_lock);
   bitmap_put(ibm, inum, 0);  // Mark inode = free in bitmap
+  journal_dirty_ptr((uint8_t *)ibm + inum / 8, 1);
+  pthread_mutex_unlock(&inum_lock);
+}
+
+// Block numbers that fit in one indirect block
+static int ptrs_per_block() {
+  return BLOCK_SIZE / sizeof(int);
+}
+
+// Allocate a block and zero it
+// Returns block number, else -1 (disk full)
+static int alloc_zeroed_block() {
+  int bnum = alloc_block();
+  if (bnum > 0) {
+    memset(blocks_get_block(bnum), 0, BLOCK_SIZE);
+    journal_dirty(bnum);
+  }
+  return bnum;
+}
+
+// Get a block of a file's contents: directory blocks are metadata
+// (journaled), regular file blocks are data (see blocks.h)
+// Args:
+// - node: Pointer to inode
+// - bnum: Block number
+// Returns pointer to the block
+static char *contents_block(inode_t *node, int bnum) {
+  return S_ISDIR(node->mode) ? blocks_get_block(bnum) : blocks_get_data(bnum);
+}
+
+// Note a change to len bytes of a file's contents at ptr (from
+// contents_block)
+static void contents_dirty(inode_t *node, const void *ptr, size_t len) {
+  if (S_ISDIR(node->mode)) {
+    journal_dirty_ptr(ptr, len);
+  }
+}
+
+// Get the block of block numbers *bnum points to
+// Args:
+// - bnum: Pointer to its block number (0 = none yet)
+// - alloc: If set, allocate the block when there is none
+// Returns pointer to the block numbers, else NULL
+static int *get_table(int *bnum, int alloc) {
+  if (*bnum <= 0) {
+    if (!alloc) {
+      return NULL;
+    }
+    int new_bnum = alloc_zeroed_block();
+    if (new_bnum < 0) {
+      return NULL;
+    }
+    *bnum = new_bnum;
+    journal_dirty_ptr(bnum, sizeof(int));
+  }
+  return blocks_get_block(*bnum);
+}
+
+// Find where the block number of a file block is stored
+// Args:
+// - node: Pointer to inode
+// - file_bnum: Index of block within file
+// - alloc: If set, allocate missing indirect blocks on the way
+// Returns pointer to the block number, else NULL
+static int *get_slot(inode_t *node, int file_bnum, int alloc) {
+  int per_block = ptrs_per_block();
+
+  if (file_bnum < INODE_DIRECT) {
+    return &node->direct[file_bnum];
+  }
+  file_bnum -= INODE_DIRECT;
+
+  if (file_bnum < per_block) {
+    int *table = get_table(&node->indirect, alloc);
+    return table ? &table[file_bnum] : NULL;
+  }
+  file_bnum -= per_block;
+
+  if (file_bnum < per_block * per_block) {
+    int *outer = get_table(&node->dindirect, alloc);
+    if (outer == NULL) {
+      return NULL;
+    }
+    int *inner = get_table(&outer[file_bnum / per_block], alloc);
+    return inner ? &inner[file_bnum % per_block] : NULL;
+  }
+  return NULL;  // Past the largest file size
+}
+
+// Get block number of a file block
+// Args:
+// - node: Pointer to inode
+// - file_bnum: Index of block within file
+// Returns block number, else -1 (not allocated)
+int inode_get_bnum(inode_t *node, int file_bnum) {
+  int *slot = get_slot(node, file_bnum, 0);
+  return slot && *slot > 0 ? *slot : -1;
+}
+
+// Check if release_blocks(node, from, ...) frees the indirect block
+// holding the slot of file block i (a slot in a freed block needn't be
+// journaled, which keeps freeing a large file to a few dirty blocks)
+// Args:
+// - from: First file block freed
+// - i: File block
+// Returns 1 if so, else 0
+static int table_released(int from, int i) {
+  int per_block = ptrs_per_block();
+  if (i < INODE_DIRECT) {
+    return 0;  // In the inode
+  }
+  if (i < INODE_DIRECT + per_block) {
+    return from <= INODE_DIRECT;
+  }
+  int inner = (i - INODE_DIRECT - per_block) / per_block;
+  return from <= INODE_DIRECT + per_block + inner * per_block;
+}
+
+// Free data blocks [from, to) of a file, and indirect blocks
+// only needed by blocks from `from` on
+// Args:
+// - node: Pointer to inode
+// - from: First file block to free
+// - to: One past last file block to free
+static void release_blocks(inode_t *node, int from, int to) {
+  for (int i = from; i < to; i++) {
+    int *slot = get_slot(node, i, 0);
+    if (slot && *slot > 0) {
+      free_block(*slot);
+      *slot = 0;
+      if (!table_released(from, i)) {
+        journal_dirty_ptr(slot, sizeof(int));
+      }
+    }
+  }
+
+  int per_block = ptrs_per_block();
+  if (from <= INODE_DIRECT && node->indirect > 0) {
+    free_block(node->indirect);
+    node->indirect = 0;
+    journal_dirty_ptr(node, sizeof(inode_t));
+  }
+
+  if (node->dindirect > 0) {
+    int *outer = blocks_get_block(node->dindirect);
+    int first = INODE_DIRECT + per_block;  // First file block of outer[0]
+    for (int i = 0; i < per_block; i++, first += per_block) {
+      if (from <= first && outer[i] > 0) {
+        free_block(outer[i]);
+        outer[i] = 0;
+        if (from > INODE_DIRECT + per_block) {
+          journal_dirty_ptr(&outer[i], sizeof(int));  // Outer block stays
+        }
+      }
+    }
+    if (from <= INODE_DIRECT + per_block) {
+      free_block(node->dindirect);
+      node->dindirect = 0;
+      journal_dirty_ptr(node, sizeof(inode_t));
+    }
+  }
+}
+
+// Largest file size: what the block map can reach, capped at INT_MAX
+// (inode sizes are ints)
+// Returns size in bytes
+long inode_max_size() {
+  long per_block = ptrs_per_block();
+  long bytes = (INODE_DIRECT + per_block + per_block * per_block) * BLOCK_SIZE;
+  return bytes < INT_MAX ? bytes : INT_MAX;
 }
 
 // Grow inode size by size
@@ -91,24 +335,44 @@ void free_inode(int inum) {
 // - size: Size to increase
 // Returns 0 if successful, else negative
 int grow_inode(inode_t *node, int size) {
+  if (size < 0 || size > inode_max_size() - node->size) {
+    return -EFBIG;
+  }
   int target_size = node->size + size;  // Calculate new target size
 
-  printf("growing inode from %d to %d\n", node->size, target_size);
+  int have = bytes_to_blocks(node->size);
+  int need = bytes_to_blocks(target_size);
 
-  node->size = target_size;  // Update inode size
-  inode_t *pnode = node;  // Start with current inode
-
-  while (pnode->size > BLOCK_SIZE) {
-    // Check next inode expand?
-    if (pnode->next_inode == -1) {
-      pnode->next_inode = alloc_inode();  // Allocate new inode/link
+  // Map new blocks, as few contiguous runs as the disk allows (zeroed, so
+  // the new bytes read as 0)
+  for (int i = have; i < need;) {
+    int got;
+    int first = alloc_blocks(need - i, &got);
+    if (first < 0) {
+      release_blocks(node, have, i);  // Undo partial growth
+      return -ENOSPC;
     }
+    char *run = contents_block(node, first);
+    memset(run, 0, (size_t)got * BLOCK_SIZE);
+    contents_dirty(node, run, (size_t)got * BLOCK_SIZE);
 
-    // Update size of next node
-    int sz = pnode->size;
-    pnode = get_inode(pnode->next_inode);
-    pnode->size = sz - BLOCK_SIZE;
+    for (int j = 0; j < got; j++, i++) {
+      int *slot = get_slot(node, i, 1);
+      if (!slot) {
+        // No space for an indirect block: give back the rest of the run
+        for (; j < got; j++) {
+          free_block(first + j);
+        }
+        release_blocks(node, have, i);
+        return -ENOSPC;
+      }
+      *slot = first + j;
+      journal_dirty_ptr(slot, sizeof(int));
+    }
   }
+
+  node->size = target_size;  // Update inode size
+  journal_dirty_ptr(node, sizeof(inode_t));
   return 0;
 }
 
@@ -118,39 +382,22 @@ int grow_inode(inode_t *node, int size) {
 // - size: Size to decrease inode
 // Returns 0 if successful, else negative
 int shrink_inode(inode_t *node, int size) {
-  void *ibm = get_inode_bitmap();  // Disconnect chain from inode (deallocated)
-
-  inode_t *pnode = node;  // Start = Current inode
-  // Find inode that fits
-  while (size < pnode->size - BLOCK_SIZE) {
-    pnode = get_inode(pnode->next_inode);
-  }
-
-  // Determine inum to start deallocation
-  int inum_to_del = pnode->next_inode;
-  pnode->next_inode = -1;  // Disconnect
-
-  inode_t *to_del = get_inode(inum_to_del);
-  // deallocate inode/blocks (form inum_to_del)
-  while (inum_to_del > 0) {
-    bitmap_put(ibm, inum_to_del, 0);  // Mark inode = free
-    free_block(to_del->block);  // Free block (inode)
-    inum_to_del = to_del->next_inode;  // Move to next inode
-    memset(to_del, 0, sizeof(inode_t));  // Clear inode data
-  }
+  assert(size >= 0 && size <= node->size);
 
   // Calculate target size (after shrink)
   int target_size = node->size - size;
-  printf("shrinking inode from %d to %d\n", node->size, target_size);
 
-  // Update size of inodes
-  pnode = node;
-  pnode->size = target_size;
+  release_blocks(node, bytes_to_blocks(target_size), bytes_to_blocks(node->size));
 
-  // Update size of other inodes
-  while (pnode->next_inode != -1) {
-    pnode = get_inode(pnode->next_inode);
-    pnode->size -= size;
+  // Clear the cut-off tail of the last block (a later grow reads zeros)
+  int tail = target_size % BLOCK_SIZE;
+  if (tail != 0) {
+    char *last = contents_block(node, inode_get_bnum(node, target_size / BLOCK_SIZE));
+    memset(last + tail, 0, BLOCK_SIZE - tail);
+    contents_dirty(node, last + tail, BLOCK_SIZE - tail);
   }
+
+  node->size = target_size;  // Update inode size
+  journal_dirty_ptr(node, sizeof(inode_t));
   return 0;
 }
@@ -13,22 +13,42 @@
 
 #define ROOT_INODE 1
 
+// Block pointers held in the inode itself (first 24K of a file)
+#define INODE_DIRECT 6
+
+// Data blocks of a file are found through (block number 0 = none):
+// - direct[i] for file block i < INODE_DIRECT
+// - indirect, a block of BLOCK_SIZE / sizeof(int) block numbers, for the next 4MB
+// - dindirect, a block of indirect block numbers, for the rest
+// so any offset maps to its block with at most two extra block reads.
 typedef struct inode {
   int refs;   // reference count
   int mode;   // permission & type
   int size;   // bytes
-  int block;  // single block pointer (if max file size <= 4K)
-  int next_inode;  // Pointer to next inode (indirect block management)
+  int direct[INODE_DIRECT];  // first data blocks
+  int indirect;   // block of data block numbers
+  int dindirect;  // block of indirect block numbers
   time_t atime;  // Last time accessed
   time_t mtime;  // Last time modified
 } inode_t;
 
 void print_inode(inode_t *node);
 inode_t *get_inode(int inum);
+int inode_get_inum(inode_t *node);  // Inverse of get_inode
 int alloc_inode();
 void free_inode(int inum);
 int grow_inode(inode_t *node, int size);
 int shrink_inode(inode_t *node, int size);
-// indode_get_bnum not neeeded
+long inode_max_size();  // Largest file size (bytes)
+int inode_get_bnum(inode_t *node, int file_bnum);  // Block holding file block file_bnum, else -1
+
+// Per-inode reader/writer locks. Whoever reads an inode (or a file's or
+// directory's blocks) holds its read lock, whoever changes it the write
+// lock; several inodes are locked parent directory first.
+void inode_locks_init();  // Create locks for INODE_COUNT inodes
+void inode_read_lock(int inum);
+void inode_write_lock(int inum);
+void inode_data_lock(int inum);  // Write lock for changing file data only
+void inode_unlock(int inum);
 
 #endif
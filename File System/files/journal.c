@@ -0,0 +1,491 @@
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "bitmap.h"
+#include "journal.h"
+
+#define JOURNAL_MAGIC 0x4c4e524a  // "JRNL"
+
+// First block of each half of the journal: describes one group, whose
+// block images follow it
+typedef struct journal_header {
+  uint32_t magic;     // JOURNAL_MAGIC
+  uint32_t seq;       // Group number (written to half seq % 2)
+  uint32_t count;     // # block images
+  uint32_t checksum;  // FNV-1a of seq, home blocks & images
+  int32_t home[];     // Home block of each image
+} journal_header_t;
+
+// Blocks freed by one group
+typedef struct free_list {
+  int *bnums;
+  int count;
+  int cap;
+} free_list_t;
+
+static int journal_fd = -1;
+static int capacity = 0;       // Block images per group (0 = no journal)
+static uint32_t next_seq = 0;  // Number of the next group written
+
+// Dirty metadata blocks of the current group (a bit per block)
+static atomic_ullong *dirty = NULL;
+static int dirty_words = 0;
+static atomic_int dirty_count = 0;
+
+// Operations in progress, and whether a commit is waiting for them
+static pthread_mutex_t handle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t handle_cond = PTHREAD_COND_INITIALIZER;
+static int running = 0;
+static int committing = 0;
+
+// One commit at a time
+static pthread_mutex_t commit_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Freed by the current group, by the group being committed, and by the
+// group committed last (still marked used in the live bitmap)
+static pthread_mutex_t free_lock = PTHREAD_MUTEX_INITIALIZER;
+static free_list_t freeing, committed, waiting;
+
+// Copies of the group's blocks: a header block, then the images
+static char *stage = NULL;
+static int *homes = NULL;
+static int stage_cap = 0;
+
+// Background commits (started by the first operation, so after a
+// daemonizing fork)
+static pthread_mutex_t thread_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t thread_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t thread;
+static int thread_started = 0;
+static int stopping = 0;
+static int commit_interval = JOURNAL_COMMIT_INTERVAL;
+
+//============================================================== group_capacity =//
+// Block images a group can hold in half of a journal
+static int group_capacity(int journal_blocks) {
+  int slots = (BLOCK_SIZE - sizeof(journal_header_t)) / sizeof(int32_t);
+  int room = journal_blocks / 2 - 1;  // Less the header block
+  return room < slots ? room : slots;
+}
+
+//============================================================== half_offset =//
+// Byte offset of the half of the journal group seq is written to
+static off_t half_offset(const superblock_t *sb, uint32_t seq) {
+  return (off_t)(sb->journal + (seq % 2) * (sb->journal_blocks / 2)) * BLOCK_SIZE;
+}
+
+//============================================================== checksum =//
+// FNV-1a of a group's seq, home blocks and images
+static uint32_t checksum(const journal_header_t *h, const char *images) {
+  uint32_t sum = (2166136261u ^ h->seq) * 16777619u;
+  const unsigned char *p = (const unsigned char *)h->home;
+  for (size_t i = 0; i < h->count * sizeof(int32_t); i++) {
+    sum = (sum ^ p[i]) * 16777619u;
+  }
+  p = (const unsigned char *)images;
+  for (size_t i = 0; i < (size_t)h->count * BLOCK_SIZE; i++) {
+    sum = (sum ^ p[i]) * 16777619u;
+  }
+  return sum;
+}
+
+//============================================================== read_group =//
+// Read the group in one half of the journal, if it is complete
+// Args:
+// - buf: Room for a header & capacity images
+// Returns 1 if complete (header & images in buf), else 0
+static int read_group(int fd, const superblock_t *sb, int half, int capacity,
+                      char *buf) {
+  journal_header_t *h = (journal_header_t *)buf;
+  off_t at = half_offset(sb, half);
+
+  if (pread(fd, buf, BLOCK_SIZE, at) != BLOCK_SIZE ||
+      h->magic != JOURNAL_MAGIC || h->seq % 2 != half ||
+      h->count > capacity) {
+    return 0;
+  }
+  for (int i = 0; i < h->count; i++) {
+    if (h->home[i] < 0 || h->home[i] >= sb->max_blocks) {
+      return 0;
+    }
+  }
+
+  ssize_t len = (ssize_t)h->count * BLOCK_SIZE;
+  return pread(fd, buf + BLOCK_SIZE, len, at + BLOCK_SIZE) == len &&
+         checksum(h, buf + BLOCK_SIZE) == h->checksum;
+}
+
+//============================================================== journal_recover =//
+// Replay the complete groups in the journal, older first
+int journal_recover(int fd, const superblock_t *sb) {
+  int cap = group_capacity(sb->journal_blocks);
+  next_seq = 0;
+  if (cap <= 0) {
+    return 0;  // No journal
+  }
+
+  char *buf[2];
+  int complete[2];
+  for (int half = 0; half < 2; half++) {
+    buf[half] = malloc((size_t)(cap + 1) * BLOCK_SIZE);
+    assert(buf[half] != NULL);
+    complete[half] = read_group(fd, sb, half, cap, buf[half]);
+  }
+
+  journal_header_t *h0 = (journal_header_t *)buf[0];
+  journal_header_t *h1 = (journal_header_t *)buf[1];
+  int first = complete[0] && complete[1] && h1->seq < h0->seq ? 1 : 0;
+
+  int rv = 0;
+  for (int k = 0; k < 2; k++) {
+    int half = first ^ k;
+    journal_header_t *h = (journal_header_t *)buf[half];
+    if (!complete[half]) {
+      continue;
+    }
+    for (int i = 0; i < h->count && rv == 0; i++) {
+      char *image = buf[half] + (size_t)(i + 1) * BLOCK_SIZE;
+      if (pwrite(fd, image, BLOCK_SIZE, (off_t)h->home[i] * BLOCK_SIZE) != BLOCK_SIZE) {
+        rv = -1;
+      }
+    }
+    if (h->seq >= next_seq) {
+      next_seq = h->seq + 1;
+    }
+  }
+  if ((complete[0] || complete[1]) && fdatasync(fd) != 0) {
+    rv = -1;
+  }
+
+  free(buf[0]);
+  free(buf[1]);
+  return rv;
+}
+
+//============================================================== journal_init =//
+// Start journaling the mapped image
+void journal_init(int fd) {
+  superblock_t *sb = get_superblock();
+  journal_fd = fd;
+  capacity = group_capacity(sb->journal_blocks);
+  if (capacity < 0) {
+    capacity = 0;
+  }
+
+  free(dirty);
+  dirty_words = (sb->max_blocks + 63) / 64;
+  dirty = calloc(dirty_words, sizeof(atomic_ullong));
+  assert(dirty != NULL);
+  atomic_store(&dirty_count, 0);
+
+  freeing.count = committed.count = waiting.count = 0;
+  running = committing = 0;
+  stopping = 0;
+}
+
+//============================================================== journal_set_interval =//
+// Set how often the background commits happen
+void journal_set_interval(int seconds) {
+  pthread_mutex_lock(&thread_lock);
+  commit_interval = seconds > 0 ? seconds : JOURNAL_COMMIT_INTERVAL;
+  pthread_mutex_unlock(&thread_lock);
+}
+
+//============================================================== commit_thread =//
+// Commit every commit_interval seconds until shut down
+static void *commit_thread(void *arg) {
+  pthread_mutex_lock(&thread_lock);
+  while (!stopping) {
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += commit_interval;
+    pthread_cond_timedwait(&thread_cond, &thread_lock, &until);
+    if (stopping) {
+      break;
+    }
+
+    pthread_mutex_unlock(&thread_lock);
+    journal_commit();
+    pthread_mutex_lock(&thread_lock);
+  }
+  pthread_mutex_unlock(&thread_lock);
+  return NULL;
+}
+
+//============================================================== journal_shutdown =//
+// Commit what is left and stop journaling
+void journal_shutdown() {
+  pthread_mutex_lock(&thread_lock);
+  int started = thread_started;
+  stopping = 1;
+  thread_started = 0;
+  pthread_cond_signal(&thread_cond);
+  pthread_mutex_unlock(&thread_lock);
+  if (started) {
+    pthread_join(thread, NULL);
+  }
+
+  journal_commit();
+  journal_fd = -1;
+}
+
+//============================================================== group_has_room =//
+// Check if the current group has room for one more operation: what is
+// dirty already, plus the credits of those running and of the new one
+// (caller holds handle_lock)
+static int group_has_room() {
+  int dirty_now = atomic_load(&dirty_count);
+  if (capacity == 0 || (running == 0 && dirty_now == 0)) {
+    return 1;  // Not journaled, or an empty group (whatever its size)
+  }
+  return dirty_now + (running + 1) * JOURNAL_CREDITS <= capacity;
+}
+
+//============================================================== journal_start =//
+// Begin an operation, once the current group has room for it (waits while
+// a commit copies the current group)
+void journal_start() {
+  pthread_mutex_lock(&thread_lock);
+  if (!thread_started && !stopping) {
+    thread_started = pthread_create(&thread, NULL, commit_thread, NULL) == 0;
+  }
+  pthread_mutex_unlock(&thread_lock);
+
+  pthread_mutex_lock(&handle_lock);
+  for (;;) {
+    while (committing) {
+      pthread_cond_wait(&handle_cond, &handle_lock);
+    }
+    if (group_has_room()) {
+      break;
+    }
+    if (running > 0) {
+      pthread_cond_wait(&handle_cond, &handle_lock);  // For them to finish
+    } else {
+      pthread_mutex_unlock(&handle_lock);
+      journal_commit();  // Full: start a new group
+      pthread_mutex_lock(&handle_lock);
+    }
+  }
+  running++;
+  pthread_mutex_unlock(&handle_lock);
+}
+
+//============================================================== journal_stop =//
+// End an operation
+void journal_stop() {
+  pthread_mutex_lock(&handle_lock);
+  running--;
+  pthread_cond_broadcast(&handle_cond);  // A commit, or operations waiting for room
+  pthread_mutex_unlock(&handle_lock);
+}
+
+//============================================================== journal_dirty =//
+// Mark a metadata block as changed
+void journal_dirty(int bnum) {
+  uint64_t bit = 1ULL << (bnum % 64);
+  if (!(atomic_fetch_or(&dirty[bnum / 64], bit) & bit)) {
+    atomic_fetch_add(&dirty_count, 1);
+  }
+}
+
+//============================================================== journal_dirty_ptr =//
+// Mark the metadata blocks holding len bytes at ptr as changed
+void journal_dirty_ptr(const void *ptr, size_t len) {
+  const char *base = blocks_get_block(0);
+  int first = ((const char *)ptr - base) / BLOCK_SIZE;
+  int last = ((const char *)ptr + len - 1 - base) / BLOCK_SIZE;
+  for (int bnum = first; bnum <= last; bnum++) {
+    journal_dirty(bnum);
+  }
+}
+
+//============================================================== journal_free_block =//
+// Free a block once it is safe to reuse
+void journal_free_block(int bnum) {
+  pthread_mutex_lock(&free_lock);
+  if (freeing.count == freeing.cap) {
+    freeing.cap = freeing.cap ? freeing.cap * 2 : 64;
+    freeing.bnums = realloc(freeing.bnums, freeing.cap * sizeof(int));
+    assert(freeing.bnums != NULL);
+  }
+  freeing.bnums[freeing.count++] = bnum;
+  pthread_mutex_unlock(&free_lock);
+
+  // The group's copy of the bitmap shows it free (see clear_freed)
+  journal_dirty(get_superblock()->block_bitmap + bnum / (8 * BLOCK_SIZE));
+}
+
+//============================================================== stage_block =//
+// Copy a dirty block into the next stage slot
+static void stage_block(int count, int bnum) {
+  if (count == stage_cap) {
+    stage_cap = stage_cap ? stage_cap * 2 : 64;
+    stage = realloc(stage, (size_t)(stage_cap + 1) * BLOCK_SIZE);
+    homes = realloc(homes, stage_cap * sizeof(int));
+    assert(stage != NULL && homes != NULL);
+  }
+  memcpy(stage + (size_t)(count + 1) * BLOCK_SIZE, blocks_get_block(bnum), BLOCK_SIZE);
+  homes[count] = bnum;
+}
+
+//============================================================== clear_freed =//
+// Show freed blocks as free in the staged copies of the block bitmap
+// (the live bitmap keeps them used until they may be reused)
+static void clear_freed(free_list_t *list, int count) {
+  int first_bitmap = get_superblock()->block_bitmap;
+  int per_block = 8 * BLOCK_SIZE;
+
+  for (int i = 0; i < list->count; i++) {
+    int home = first_bitmap + list->bnums[i] / per_block;
+    for (int j = 0; j < count; j++) {
+      if (homes[j] == home) {
+        void *image = stage + (size_t)(j + 1) * BLOCK_SIZE;
+        bitmap_put(image, list->bnums[i] % per_block, 0);
+        break;
+      }
+    }
+  }
+}
+
+//============================================================== snapshot =//
+// Copy the current group's dirty blocks into the stage and start a new
+// group (no operation is in progress)
+// Returns # blocks staged
+static int snapshot() {
+  int count = 0;
+  for (int w = 0; w < dirty_words; w++) {
+    uint64_t word = atomic_exchange(&dirty[w], 0);
+    while (word != 0) {
+      stage_block(count++, w * 64 + __builtin_ctzll(word));
+      word &= word - 1;
+    }
+  }
+  atomic_store(&dirty_count, 0);
+
+  pthread_mutex_lock(&free_lock);
+  free_list_t tmp = committed;
+  committed = freeing;
+  freeing = tmp;
+  freeing.count = 0;
+  clear_freed(&committed, count);
+  clear_freed(&waiting, count);
+  pthread_mutex_unlock(&free_lock);
+
+  return count;
+}
+
+//============================================================== write_homes =//
+// Write staged blocks to their home blocks
+static int write_homes(int count) {
+  for (int i = 0; i < count; i++) {
+    char *image = stage + (size_t)(i + 1) * BLOCK_SIZE;
+    if (pwrite(journal_fd, image, BLOCK_SIZE, (off_t)homes[i] * BLOCK_SIZE) != BLOCK_SIZE) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+//============================================================== write_group =//
+// Write the staged group to the journal, then home (one fdatasync:
+// the next commit's makes the home blocks durable)
+static int write_group(int count) {
+  superblock_t *sb = get_superblock();
+  journal_header_t *h = (journal_header_t *)stage;
+
+  memset(stage, 0, BLOCK_SIZE);
+  h->magic = JOURNAL_MAGIC;
+  h->seq = next_seq;
+  h->count = count;
+  memcpy(h->home, homes, count * sizeof(int32_t));
+  h->checksum = checksum(h, stage + BLOCK_SIZE);
+
+  ssize_t len = (ssize_t)(count + 1) * BLOCK_SIZE;
+  if (pwrite(journal_fd, stage, len, half_offset(sb, next_seq)) != len ||
+      fdatasync(journal_fd) != 0) {
+    return -1;
+  }
+  next_seq++;
+  return write_homes(count);
+}
+
+//============================================================== write_unjournaled =//
+// Write a group too large for the journal (or with no journal) straight
+// home. Not atomic: only a safety net for a single operation changing
+// more blocks than a group holds, which handle credits and stepped growth
+// otherwise rule out.
+static int write_unjournaled(int count) {
+  superblock_t *sb = get_superblock();
+  if (capacity > 0) {
+    // Older groups must not be replayed over these blocks
+    char *zero = calloc(1, BLOCK_SIZE);
+    int bad = pwrite(journal_fd, zero, BLOCK_SIZE, half_offset(sb, 0)) != BLOCK_SIZE ||
+              pwrite(journal_fd, zero, BLOCK_SIZE, half_offset(sb, 1)) != BLOCK_SIZE ||
+              fdatasync(journal_fd) != 0;
+    free(zero);
+    if (bad) {
+      return -1;
+    }
+  }
+  return write_homes(count) == 0 && fdatasync(journal_fd) == 0 ? 0 : -1;
+}
+
+//============================================================== journal_commit =//
+// Commit the current group
+int journal_commit() {
+  pthread_mutex_lock(&commit_lock);
+  if (journal_fd < 0) {
+    pthread_mutex_unlock(&commit_lock);
+    return 0;
+  }
+
+  // Wait for operations in progress; new ones wait for the snapshot
+  pthread_mutex_lock(&handle_lock);
+  committing = 1;
+  while (running > 0) {
+    pthread_cond_wait(&handle_cond, &handle_lock);
+  }
+  int count = snapshot();
+  committing = 0;
+  pthread_cond_broadcast(&handle_cond);
+  pthread_mutex_unlock(&handle_lock);
+
+  int rv = 0;
+  if (count > 0) {
+    rv = count <= capacity ? write_group(count) : write_unjournaled(count);
+  }
+
+  pthread_mutex_lock(&free_lock);
+  if (count > 0 && rv == 0) {
+    // Blocks freed by the group before this one may be reused now
+    blocks_release_freed(waiting.bnums, waiting.count);
+    free_list_t tmp = waiting;
+    waiting = committed;
+    committed = tmp;
+  } else if (rv != 0) {
+    // Try again with the next group
+    perror("nufs: journal commit");
+    for (int i = 0; i < count; i++) {
+      journal_dirty(homes[i]);
+    }
+    for (int i = 0; i < committed.count; i++) {
+      pthread_mutex_unlock(&free_lock);
+      journal_free_block(committed.bnums[i]);
+      pthread_mutex_lock(&free_lock);
+    }
+  }
+  committed.count = 0;
+  pthread_mutex_unlock(&free_lock);
+
+  pthread_mutex_unlock(&commit_lock);
+  return rv;
+}
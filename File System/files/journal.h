@@ -0,0 +1,72 @@
+// Metadata journal.
+//
+// Metadata blocks (superblock, bitmaps, inode table, indirect blocks and
+// directory blocks) are changed in a private mapping of the image, so
+// nothing reaches the disk on its own. Changes made by the operations
+// between two commits form a transaction group: the commit copies the
+// group's dirty blocks into one half of the journal region, fdatasyncs
+// once, then writes them to their home blocks. On mount the last two
+// complete groups are replayed, so a crash leaves the image as of a
+// commit, never halfway through an operation.
+//
+// Each running operation holds JOURNAL_CREDITS blocks of the group's
+// capacity; an operation only starts when the group has room for it, else
+// the group is committed first. Growing a file by a lot is split into
+// steps of their own, shrinking one doesn't journal the indirect blocks
+// it frees, and a directory insert splits at most one bucket, so no
+// operation changes more. Only a group that overflows anyway (a single
+// operation changing more blocks than a group holds) is written home
+// without the journal.
+//
+// Blocks freed by a group can't be allocated again until the commit
+// after that group's own has completed, so replaying an older group never
+// overwrites a block that has since been reused for file data.
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "blocks.h"
+
+// Commit at least this often (seconds) while there are changes, unless
+// set otherwise by journal_set_interval
+#define JOURNAL_COMMIT_INTERVAL 5
+
+// Blocks of a group held by each running operation (most operations
+// change far fewer)
+#define JOURNAL_CREDITS 16
+
+// Replay the journal of an image that isn't mapped yet
+// Returns 0 if successful, else -1 (I/O error)
+int journal_recover(int fd, const superblock_t *sb);
+
+// Start journaling the mapped image (blocks_init)
+void journal_init(int fd);
+
+// Commit what is left and stop journaling (blocks_free)
+void journal_shutdown();
+
+// Commit every seconds seconds in the background (before the first
+// operation)
+void journal_set_interval(int seconds);
+
+// Bracket an operation that changes metadata (at most JOURNAL_CREDITS
+// blocks); commits wait for operations in progress, so a group holds only
+// whole operations
+void journal_start();
+void journal_stop();
+
+// Mark a metadata block as changed by the current group
+void journal_dirty(int bnum);
+
+// Mark the metadata blocks holding len bytes at ptr (in the private
+// mapping) as changed
+void journal_dirty_ptr(const void *ptr, size_t len);
+
+// Free a block once the current group has committed (see above)
+void journal_free_block(int bnum);
+
+// Commit the current group
+// Returns 0 if successful, else -1 (I/O error)
+int journal_commit();
+
+#endif // JOURNAL_H
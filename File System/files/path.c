@@ -0,0 +1,44 @@
+#include <string.h>
+
+#include "path.h"
+
+//============================================================== path_next =//
+// Get the next component of a path
+// Args:
+// - rest: Where to continue from; advanced past the component
+// - end: End of the path (exclusive)
+// - part: Set to the component
+// Returns 1 if there was a component, else 0 (end of path)
+int path_next(const char **rest, const char *end, path_span_t *part) {
+  const char *p = *rest;
+
+  while (p < end && *p == '/') p++;  // Skip separators
+  if (p == end) {
+    *rest = p;
+    return 0;  // No more components
+  }
+
+  part->start = p;
+  while (p < end && *p != '/') p++;
+  part->len = p - part->start;
+
+  *rest = p;
+  return 1;
+}
+
+//============================================================== path_split =//
+// Split path into parent & last component (no copying)
+// Args:
+// - path: Path to split
+// - parent_len: Set to length of parent part (0 = root)
+// Returns pointer to last component within path
+const char *path_split(const char *path, int *parent_len) {
+  const char *slash = strrchr(path, '/');
+
+  if (!slash) {
+    *parent_len = 0;
+    return path;  // Relative name (parent = root)
+  }
+  *parent_len = slash - path;
+  return slash + 1;
+}
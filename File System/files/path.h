@@ -0,0 +1,36 @@
+// Allocation-free path parsing.
+//
+// Components are spans over the original path string, so walking or
+// splitting a path never copies it:
+//
+//   const char *rest = path, *end = path + strlen(path);
+//   path_span_t part;
+//   while (path_next(&rest, end, &part)) {
+//     ... part.start[0 .. part.len - 1] ...
+//   }
+
+#ifndef PATH_H
+#define PATH_H
+
+// A path component: len bytes at start (not NUL-terminated)
+typedef struct path_span {
+  const char *start;
+  int len;
+} path_span_t;
+
+// Get the next component of a path, skipping empty ones ("//", trailing "/")
+// Args:
+// - rest: Where to continue from; advanced past the component
+// - end: End of the path (exclusive)
+// - part: Set to the component
+// Returns 1 if there was a component, else 0 (end of path)
+int path_next(const char **rest, const char *end, path_span_t *part);
+
+// Split a path at its last '/'
+// Args:
+// - path: Path to split, e.g. "/a/b/c"
+// - parent_len: Set to the length of the parent path ("/a/b" -> 4, "/" -> 0)
+// Returns the last component ("c"), a suffix of path
+const char *path_split(const char *path, int *parent_len);
+
+#endif // PATH_H
@@ -1,4 +1,49 @@
+#include <pthread.h>
+#include <stdatomic.h>
+
 #include "storage.h"
+#include "dcache.h"
+#include "journal.h"
+
+// Journaling: every operation that changes metadata is a journal handle
+// (journal_start before it locks anything, journal_stop after it unlocks
+// everything), so a commit never sees half an operation.
+//
+// Locking: every operation locks the inodes it touches (see inode.h),
+// parent directory before child. Renames lock two directories in no
+// particular order, so they take the namespace lock for writing, and the
+// other operations that lock a directory and a child take it for reading.
+static pthread_rwlock_t namespace_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+// References to each inode held by the kernel (see storage_lookup). An
+// unlinked inode is only freed once it has none, so an open file outlives
+// its last name.
+static atomic_int *lookups = NULL;
+
+// Writeback: file data is written through a shared mapping, so the kernel
+// writes it back whenever it likes. To bound how long it may stay in
+// memory, each inode records the bytes written since they were last
+// flushed (one range covering them all) and when the first of them was,
+// and the writeback thread flushes files dirty for writeback_age seconds.
+typedef struct dirty_range {
+  off_t start;   // First byte written
+  off_t end;     // One past the last
+  time_t since;  // When first written (0 = clean)
+} dirty_range_t;
+
+static pthread_mutex_t dirty_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dirty_cond = PTHREAD_COND_INITIALIZER;
+static dirty_range_t *dirty_data = NULL;
+static int dirty_files = 0;
+static int writeback_age = JOURNAL_COMMIT_INTERVAL;
+static pthread_t writeback;
+static int writeback_started = 0;  // Started by the first write
+static int writeback_stopping = 0;
+
+// Files grow by at most this much per journal handle, so growing one by
+// a lot never changes more metadata than a group holds (a step maps 1024
+// blocks: a few indirect & bitmap blocks)
+#define GROW_STEP (4L << 20)
 
 //=========================================================== storage_init =//
 // initialize storage
@@ -6,9 +51,254 @@
 // - path: Path to file (disk image/storage)
 void storage_init(const char *path) {
   blocks_init(path);  // Init block system
+  inode_locks_init();  // One lock per inode of this image
+  free(lookups);
+  lookups = calloc(INODE_COUNT, sizeof(atomic_int));
+  assert(lookups != NULL);
+  free(dirty_data);
+  dirty_data = calloc(INODE_COUNT, sizeof(dirty_range_t));
+  assert(dirty_data != NULL);
+  dirty_files = 0;
+  writeback_stopping = 0;
+  dcache_clear();  // Nothing cached from another image
   directory_init();  // Init root directory
 }
 
+//=========================================================== lock_node =//
+// Lock an inode & get it, unless it was freed since its inum was looked up
+// Args:
+// - inum: (object)
+// - write: 1 to lock for writing, 2 for writing file data only (see
+//   inode_data_lock), 0 for reading
+// Returns pointer to locked inode, else NULL (nothing locked)
+static inode_t *lock_node(int inum, int write) {
+  if (inum < 0) {
+    return NULL;
+  }
+
+  if (write == 2) {
+    inode_data_lock(inum);
+  } else if (write) {
+    inode_write_lock(inum);
+  } else {
+    inode_read_lock(inum);
+  }
+
+  inode_t *node = get_inode(inum);
+  if (node == NULL) {
+    inode_unlock(inum);
+  }
+  return node;
+}
+
+//=========================================================== release_node =//
+// Free an inode that has no links left, unless the kernel still has it
+// (then storage_forget frees it). Caller holds its write lock.
+// Args:
+// - inum: (object)
+// - node: Its inode
+static void release_node(int inum, inode_t *node) {
+  if (node->refs > 0 || atomic_load(&lookups[inum]) > 0) {
+    return;
+  }
+  if (S_ISDIR(node->mode)) {
+    dcache_forget_dir(inum);  // Its inum may be reused for a new directory
+    directory_release(node);  // Its overflow blocks (free_inode frees the rest)
+  }
+
+  pthread_mutex_lock(&dirty_lock);
+  if (dirty_data[inum].since != 0) {
+    dirty_files--;  // Nothing left to write back
+  }
+  memset(&dirty_data[inum], 0, sizeof(dirty_range_t));
+  pthread_mutex_unlock(&dirty_lock);
+
+  free_inode(inum);
+}
+
+//=========================================================== flush_data =//
+// Write back the data written to a file since it was last flushed
+// Args:
+// - inum: (file)
+// Returns 0 if successful, else -EIO
+static int flush_data(int inum) {
+  pthread_mutex_lock(&dirty_lock);
+  dirty_range_t range = dirty_data[inum];
+  if (range.since != 0) {
+    dirty_files--;
+  }
+  memset(&dirty_data[inum], 0, sizeof(dirty_range_t));
+  pthread_mutex_unlock(&dirty_lock);
+
+  if (range.since == 0) {
+    return 0;  // Clean
+  }
+  inode_t *node = lock_node(inum, 0);
+  if (node == NULL) {
+    return 0;  // Freed meanwhile
+  }
+
+  // Sync the range run by run of consecutive blocks
+  int rv = 0;
+  int last = bytes_to_blocks(range.end < node->size ? range.end : node->size);
+  for (int b = range.start / BLOCK_SIZE; b < last;) {
+    int first = inode_get_bnum(node, b);
+    int count = 1;
+    while (b + count < last && inode_get_bnum(node, b + count) == first + count) {
+      count++;
+    }
+    if (first > 0 && blocks_sync_data(first, count) != 0) {
+      rv = -EIO;
+    }
+    b += count;
+  }
+
+  inode_unlock(inum);
+  return rv;
+}
+
+//=========================================================== writeback_thread =//
+// Flush files once their data has been dirty for writeback_age seconds
+// (checking every half of that)
+static void *writeback_thread(void *arg) {
+  pthread_mutex_lock(&dirty_lock);
+  while (!writeback_stopping) {
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += (writeback_age + 1) / 2;
+    pthread_cond_timedwait(&dirty_cond, &dirty_lock, &until);
+
+    time_t now = time(NULL);
+    for (int inum = 0; inum < INODE_COUNT && dirty_files > 0 && !writeback_stopping; inum++) {
+      time_t since = dirty_data[inum].since;
+      if (since != 0 && now - since >= writeback_age) {
+        pthread_mutex_unlock(&dirty_lock);
+        flush_data(inum);
+        pthread_mutex_lock(&dirty_lock);
+      }
+    }
+  }
+  pthread_mutex_unlock(&dirty_lock);
+  return NULL;
+}
+
+//=========================================================== mark_dirty =//
+// Note data written to a file, for writeback
+// Args:
+// - inum: (file)
+// - start: First byte written
+// - end: One past the last
+static void mark_dirty(int inum, off_t start, off_t end) {
+  pthread_mutex_lock(&dirty_lock);
+  if (!writeback_started && !writeback_stopping) {
+    writeback_started = pthread_create(&writeback, NULL, writeback_thread, NULL) == 0;
+  }
+
+  dirty_range_t *range = &dirty_data[inum];
+  if (range->since == 0) {
+    range->start = start;
+    range->end = end;
+    range->since = time(NULL);
+    dirty_files++;
+  } else {
+    if (start < range->start) range->start = start;
+    if (end > range->end) range->end = end;
+  }
+  pthread_mutex_unlock(&dirty_lock);
+}
+
+//=========================================================== storage_set_writeback =//
+// Set how long written data & metadata may stay in memory
+// Args:
+// - age: Seconds
+void storage_set_writeback(int age) {
+  pthread_mutex_lock(&dirty_lock);
+  writeback_age = age > 0 ? age : JOURNAL_COMMIT_INTERVAL;
+  pthread_mutex_unlock(&dirty_lock);
+  journal_set_interval(age);
+}
+
+//=========================================================== storage_fsync =//
+// Make an object durable: its data written since the last flush, then
+// the metadata of every operation so far (one journal commit)
+// Args:
+// - path: Path to object. If null use inum
+// - inum: (object)
+// Returns 0 if successful, else negative
+int storage_fsync(const char *path, int inum) {
+  if (path) inum = tree_lookup(path);
+  if (inum < 0) {
+    return -ENOENT;
+  }
+
+  int rv = flush_data(inum);
+  if (journal_commit() != 0) {
+    rv = -EIO;
+  }
+  return rv;
+}
+
+//=========================================================== storage_free =//
+// Stop writeback & close storage (committing the journal)
+void storage_free() {
+  pthread_mutex_lock(&dirty_lock);
+  int started = writeback_started;
+  writeback_stopping = 1;
+  writeback_started = 0;
+  pthread_cond_signal(&dirty_cond);
+  pthread_mutex_unlock(&dirty_lock);
+  if (started) {
+    pthread_join(writeback, NULL);
+  }
+
+  blocks_free();  // Its final commit syncs the data too
+}
+
+//=========================================================== storage_lookup =//
+// Look up a name in a directory
+// Args:
+// - pinum: Parent directory inum
+// - name: Name within directory
+// - ref: If set, count a reference to the object (dropped by storage_forget)
+// Returns inum if found, else -ENOENT
+int storage_lookup(int pinum, const char *name, int ref) {
+  inode_t *directory_node = lock_node(pinum, 0);
+  if (directory_node == NULL) {
+    return -ENOENT;
+  }
+  if (!S_ISDIR(directory_node->mode)) {
+    inode_unlock(pinum);
+    return -ENOTDIR;
+  }
+
+  // Counted while the name still exists, so the object can't be freed
+  int inum = directory_lookup(directory_node, name);
+  if (inum >= 0 && ref) {
+    atomic_fetch_add(&lookups[inum], 1);
+  }
+
+  inode_unlock(pinum);
+  return inum;
+}
+
+//=========================================================== storage_forget =//
+// Drop references counted by storage_lookup, freeing the object if that
+// was all that kept it
+// Args:
+// - inum: (object)
+// - count: # references to drop
+void storage_forget(int inum, unsigned long count) {
+  journal_start();
+  inode_t *node = lock_node(inum, 1);
+  if (node != NULL) {
+    if (atomic_fetch_sub(&lookups[inum], (int)count) == (int)count) {
+      release_node(inum, node);
+    }
+    inode_unlock(inum);
+  }
+  journal_stop();
+}
+
 //=========================================================== storage_stat =//
 // Get status of file/directory (inum or path)
 // Args:
@@ -19,13 +309,12 @@ void storage_init(const char *path) {
 int storage_stat(const char *path, int inum, struct stat *st) {
   if(path) inum = tree_lookup(path);  // Lookup inum if path exists
 
-  if (inum < 0) {
+  inode_t *node = lock_node(inum, 0);  // Get inode (object)
+  if (node == NULL) {
     return -1;  // Object not found
   }
 
-  inode_t *node = get_inode(inum);  // Get inode (object)
-
-  memset(st, 0, sizeof(stat));  // Init stat struct
+  memset(st, 0, sizeof(struct stat));  // Init stat struct
   st->st_ino = inum;
   st->st_uid = getuid();        // Set user ID
   st->st_mode = node->mode;     // Set mode
@@ -34,6 +323,7 @@ int storage_stat(const char *path, int inum, struct stat *st) {
   if (S_ISREG(node->mode)) {
     st->st_size = node->size;  // Set size for normal files
   }
+  inode_unlock(inum);
   return 0;
 }
 
@@ -49,48 +339,68 @@ int storage_stat(const char *path, int inum, struct stat *st) {
 int storage_read(const char *path, int inum,  char *buf, size_t size, off_t offset) {
   if (path) inum = tree_lookup(path);  // Lookup inum if path provided
 
-  inode_t *node = get_inode(inum);  // Get inode (object)
+  inode_t *node = lock_node(inum, 0);  // Get inode (object)
+  if (node == NULL) {
+    return -ENOENT;
+  }
 
   assert(offset >= 0);
   assert(size >= 0);
 
-  if (size == 0) {
+  if (size == 0 || offset >= node->size) {
+    inode_unlock(inum);
     return 0;
-  } else {  // Handle reading datafrom inode (specified offset & size)
-    if (offset + size > node->size) {
-      size = node->size - offset;
-    }
-
-    inode_t* pnode = node;
+  }
+  if (offset + size > node->size) {
+    size = node->size - offset;
+  }
 
-    while (offset >= BLOCK_SIZE) {
-      pnode = get_inode(pnode->next_inode);
-      offset -= BLOCK_SIZE;
+  // Copy block by block; each block is found directly from the inode
+  size_t done = 0;
+  while (done < size) {
+    int within = (offset + done) % BLOCK_SIZE;  // Offset within block
+    size_t chunk = BLOCK_SIZE - within;
+    if (chunk > size - done) chunk = size - done;
+
+    int bnum = inode_get_bnum(node, (offset + done) / BLOCK_SIZE);
+    if (bnum < 0) {
+      inode_unlock(inum);
+      return -EIO;  // Block map doesn't cover the size
     }
+    memcpy(buf + done, (char *)blocks_get_data(bnum) + within, chunk);
+    done += chunk;
+  }
+  inode_unlock(inum);
+  return size;
+}
 
-    void *block_temp = blocks_get_block(pnode->block);
-    block_temp += offset;
-
-    if (size + offset > BLOCK_SIZE) {
-      memcpy(buf, block_temp, BLOCK_SIZE - offset);
-      int temp_sz = size;
-      temp_sz -= BLOCK_SIZE - offset;
-      buf += BLOCK_SIZE - offset;
-
-      while (temp_sz > BLOCK_SIZE) {
-        pnode = get_inode(pnode->next_inode);
-        block_temp = blocks_get_block(pnode->block);
-        memcpy(buf, block_temp, BLOCK_SIZE);
-        buf += BLOCK_SIZE;
-        temp_sz -= BLOCK_SIZE;
-      }
-      pnode = get_inode(pnode->next_inode);
-      block_temp = blocks_get_block(pnode->block);
-      memcpy(buf, block_temp, temp_sz);
-    } else {
-      memcpy(buf, block_temp, size);
+//=========================================================== grow_file =//
+// Grow a file to size, GROW_STEP at a time (each step an operation of its
+// own, so a crash can leave the file partly grown, never half a step)
+// Args:
+// - inum: (file)
+// - size: New file size (no more than inode_max_size())
+// Returns 0 if successful, else error
+static int grow_file(int inum, off_t size) {
+  for (;;) {
+    journal_start();
+    inode_t *node = lock_node(inum, 1);
+    if (node == NULL) {
+      journal_stop();
+      return -ENOENT;
+    }
+    off_t step = size - node->size;
+    if (step <= 0) {
+      inode_unlock(inum);  // Grown already (or by someone else)
+      journal_stop();
+      return 0;
+    }
+    int rv = grow_inode(node, step < GROW_STEP ? (int)step : (int)GROW_STEP);
+    inode_unlock(inum);
+    journal_stop();
+    if (rv < 0) {
+      return rv;
     }
-    return size;
   }
 }
 
@@ -102,133 +412,281 @@ int storage_read(const char *path, int inum,  char *buf, size_t size, off_t offs
 // - buf: Buffer containing data to write
 // - size: # bytes to write
 // - offset: Offset from start of object
-// Returns # bytes written
+// Returns # bytes written, else negative (no space left)
 int storage_write(const char *path, int inum, const char *buf, size_t size, off_t offset) {
   if (path) inum = tree_lookup(path);  // Lookup inum if path provided
-  assert(inum >= 0);
 
-  inode_t *node = get_inode(inum);  // Get inode (object
+  // Checked before anything is converted to int (inode sizes)
+  if (offset < 0 || offset > inode_max_size() || size > inode_max_size() - offset) {
+    return -EFBIG;
+  }
+
+  journal_start();
+  inode_t *node = lock_node(inum, 2);  // Get inode (object)
+  if (node == NULL) {
+    journal_stop();
+    return -ENOENT;
+  }
 
   assert(offset >= 0);
   assert(size >= 0);
 
-  if (size == 0) {
-    return 0;
-  } else {  // Handle writing data to inode (specified offset & size)
-    if (size + offset > node->size) {
-      if (grow_inode(node, size + offset - node->size) < 0) {
-        return -1;
-      }
-    }
-
-    inode_t* pnode = node;
-
-    while (offset >= BLOCK_SIZE) {
-      pnode = get_inode(pnode->next_inode);
-      offset -= BLOCK_SIZE;
-    }
+  int rv = 0;
+  if (size + offset > node->size + GROW_STEP) {
+    // Too much to grow in one operation: grow first, then write
+    inode_unlock(inum);
+    journal_stop();
+    rv = grow_file(inum, offset + size);
+    return rv < 0 ? rv : storage_write(NULL, inum, buf, size, offset);
+  }
+  if (size + offset > node->size) {
+    rv = grow_inode(node, size + offset - node->size);
+  }
+  if (size == 0 || rv < 0) {
+    inode_unlock(inum);
+    journal_stop();
+    return rv;
+  }
 
-    void *block_temp = blocks_get_block(pnode->block);
-    block_temp += offset;
-
-    if (size + offset > BLOCK_SIZE) {
-      memcpy(block_temp, buf, BLOCK_SIZE - offset);
-      int temp_sz = size;
-      temp_sz -= BLOCK_SIZE - offset;
-      buf += BLOCK_SIZE - offset;
-
-      while (temp_sz > 0) {
-        pnode = get_inode(pnode->next_inode);
-        block_temp = blocks_get_block(pnode->block);
-        memcpy(block_temp, buf, temp_sz > BLOCK_SIZE ? BLOCK_SIZE : temp_sz);
-        temp_sz -= BLOCK_SIZE;
-        buf += BLOCK_SIZE;
-      }
-    } else {
-      memcpy(block_temp, buf, size);
+  // Copy block by block; each block is found directly from the inode
+  size_t done = 0;
+  while (done < size) {
+    int within = (offset + done) % BLOCK_SIZE;  // Offset within block
+    size_t chunk = BLOCK_SIZE - within;
+    if (chunk > size - done) chunk = size - done;
+
+    int bnum = inode_get_bnum(node, (offset + done) / BLOCK_SIZE);
+    if (bnum < 0) {
+      rv = -EIO;  // Block map doesn't cover the size
+      break;
     }
-    return size;
+    memcpy((char *)blocks_get_data(bnum) + within, buf + done, chunk);
+    done += chunk;
   }
+  mark_dirty(inum, offset, offset + done);
+  inode_unlock(inum);
+  journal_stop();
+  return rv < 0 ? rv : (int)size;
 }
 
 //=========================================================== storage_truncate =//
 // Truncates file to specified size
 // Args:
-// - path: Path to file
+// - path: Path to file. If null use inum
+// - inum: (file)
 // - size: New file size
 // Returns 0 if successful, else error
-int storage_truncate(const char *path, off_t size) {
-  int inum = tree_lookup(path);  // Lookup inum for path
-  assert(inum >= 0);
-
-  inode_t *node = get_inode(inum);  // Get inode of file
+int storage_truncate(const char *path, int inum, off_t size) {
+  if (path) inum = tree_lookup(path);  // Lookup inum for path
+  if (size < 0) {
+    return -EINVAL;
+  }
+  if (size > inode_max_size()) {
+    return -EFBIG;  // Checked before converting to int (inode sizes)
+  }
+  journal_start();
+  inode_t *node = lock_node(inum, 1);  // Get inode of file
+  if (node == NULL) {
+    journal_stop();
+    return -ENOENT;
+  }
   int node_size = node->size;
 
-  // Grow/shrink inode to new size
+  // Grow/shrink inode to new size (shrinking changes a few blocks however
+  // much is freed; growing may take several steps)
+  int rv;
+  if (size > node_size + GROW_STEP) {
+    inode_unlock(inum);
+    journal_stop();
+    return grow_file(inum, size);
+  }
   if (size >= node->size) {
-    int rv = grow_inode(node, size - node_size);
-    return rv;
+    rv = grow_inode(node, size - node_size);
   }
   else {
-    int rv = shrink_inode(node, node_size - size);
-    return rv;
+    rv = shrink_inode(node, node_size - size);
+  }
+  inode_unlock(inum);
+  journal_stop();
+  return rv;
+}
+
+//=========================================================== storage_chmod =//
+// Change mode (permissions) of object
+// Args:
+// - path: Path to object. If null use inum
+// - inum: (object)
+// - mode: New mode
+// Returns 0 if successful, else -ENOENT
+int storage_chmod(const char *path, int inum, int mode) {
+  if (path) inum = tree_lookup(path);
+  journal_start();
+  inode_t *node = lock_node(inum, 1);
+  if (node == NULL) {
+    journal_stop();
+    return -ENOENT;
   }
+
+  node->mode = mode;
+  inode_unlock(inum);
+  journal_stop();
+  return 0;
+}
+
+//=========================================================== storage_set_time =//
+// Set time of last modification of object
+// Args:
+// - path: Path to object. If null use inum
+// - inum: (object)
+// - mtime: Time last modified
+// Returns 0 if successful, else -ENOENT
+int storage_set_time(const char *path, int inum, time_t mtime) {
+  if (path) inum = tree_lookup(path);
+  journal_start();
+  inode_t *node = lock_node(inum, 1);
+  if (node == NULL) {
+    journal_stop();
+    return -ENOENT;
+  }
+
+  node->mtime = mtime;
+  inode_unlock(inum);
+  journal_stop();
+  return 0;
 }
 
 //=========================================================== storage_mknod =//
-// Creates file/directory in filesystem.
+// Creates file/directory in filesystem. A new directory gets its "." and
+// ".." entries before it appears in its parent.
 // Args:
 // - path: Parent path (object is created). If null use pinum
 // - name: Name of new object
 // - pinum: Parent inum
 // - mode: Permissions of new object
-// Returns 0 if successful, else -EEXIST
+// Returns 0 if successful, else -EEXIST (or other negative errno)
 int storage_mknod(const char *path, const char *name, int pinum, int mode) {
   if (path) pinum = tree_lookup(path);  // Lookup parent inum
 
-  assert(pinum >= 0);
-  inode_t *directory_node = get_inode(pinum);  // Get inode of parent directory
+  journal_start();
+  pthread_rwlock_rdlock(&namespace_lock);
+  inode_t *directory_node = lock_node(pinum, 1);  // Get inode of parent directory
+  if (directory_node == NULL) {
+    pthread_rwlock_unlock(&namespace_lock);
+    journal_stop();
+    return -ENOENT;  // No parent directory
+  }
 
+  int rv = 0;
   int inum = directory_lookup(directory_node, name);  // Check if object already exists
   if (inum >= 0) {
-    return -EEXIST;
+    rv = -EEXIST;
+  }
+  else if ((inum = alloc_inode()) < 0) {  // Allocate new inode for object
+    rv = -ENOSPC;  // Out of inodes
+  }
+  else {
+    inode_write_lock(inum);
+    inode_t *node = get_inode(inum);  // Get new inode
+    node->refs = 1;
+    node->mode = mode;
+    node->size = 0;
+
+    if (S_ISDIR(mode)) {
+      rv = directory_put(node, ".", inum);  // Add entry (directory)
+      if (rv == 0) {
+        rv = directory_put(node, "..", pinum);  // Add entry (parent directory)
+      }
+    }
+    if (rv == 0) {
+      rv = directory_put(directory_node, name, inum);  // Add new object to parent directory
+    }
+    if (rv < 0) {
+      node->refs = 0;
+      release_node(inum, node);  // Disk or parent directory full
+    }
+    inode_unlock(inum);
   }
 
-  inum = alloc_inode();  // Allocate new inode for object
-  inode_t *node = get_inode(inum);  // Get new inode
-  node->refs = 1;
-  node->mode = mode;
-  node->size = 0;
-
-  directory_put(directory_node, name, inum);  // Add new object to parent directory
-
-  return 0;
+  inode_unlock(pinum);
+  pthread_rwlock_unlock(&namespace_lock);
+  journal_stop();
+  return rv;
 }
 
-//=========================================================== storage_unlink =//
-// Remove object from filesystem
+//=========================================================== remove_entry =//
+// Remove a name from a directory (the object goes once unused)
 // Args:
-// - path: Path to object. If null use pinum
 // - pinum: Parent inum
 // - name: Name of object
+// - dir: If set, the object must be an empty directory, else it must not
+//   be a directory
 // Returns 0 if successful, else error
-int storage_unlink(const char *path, int pinum, const char *name) {
-  if (path) pinum = tree_lookup(path);  // Lookup parent inum
-  inode_t *directory_node = get_inode(pinum);  // Get inode of parent directory
+static int remove_entry(int pinum, const char *name, int dir) {
+  journal_start();
+  pthread_rwlock_rdlock(&namespace_lock);
+  inode_t *directory_node = lock_node(pinum, 1);  // Get inode of parent directory
+  if (directory_node == NULL) {
+    pthread_rwlock_unlock(&namespace_lock);
+    journal_stop();
+    return -ENOENT;
+  }
 
   // Unlink child object from directory
   int inum = directory_lookup(directory_node, name);
+  if (inum < 0 || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+    inode_unlock(pinum);
+    pthread_rwlock_unlock(&namespace_lock);
+    journal_stop();
+    return inum < 0 ? -ENOENT : -EINVAL;  // Missing, or "." / ".."
+  }
+  inode_write_lock(inum);
   inode_t *node = get_inode(inum);
 
-  node->refs--;
-  int rv = directory_delete(directory_node, name);
-
-  if (node->refs <= 0) {
-    free_inode(inum);
+  // Checked under the lock, so nothing is added to a directory meanwhile
+  int rv = 0;
+  if (dir && !S_ISDIR(node->mode)) {
+    rv = -ENOTDIR;
+  } else if (dir && !directory_is_empty(node)) {
+    rv = -ENOTEMPTY;  // Its children would be lost
+  } else if (!dir && S_ISDIR(node->mode)) {
+    rv = -EISDIR;
+  } else {
+    node->refs--;
+    rv = directory_delete(directory_node, name);
+    release_node(inum, node);  // Unless still linked or open
   }
+
+  inode_unlock(inum);
+  inode_unlock(pinum);
+  pthread_rwlock_unlock(&namespace_lock);
+  journal_stop();
   return rv;
 }
 
+//=========================================================== storage_unlink =//
+// Remove file from filesystem
+// Args:
+// - path: Path to parent. If null use pinum
+// - pinum: Parent inum
+// - name: Name of object
+// Returns 0 if successful, else error (-EISDIR for a directory)
+int storage_unlink(const char *path, int pinum, const char *name) {
+  if (path) pinum = tree_lookup(path);  // Lookup parent inum
+  return remove_entry(pinum, name, 0);
+}
+
+//=========================================================== storage_rmdir =//
+// Remove empty directory from filesystem
+// Args:
+// - path: Path to parent. If null use pinum
+// - pinum: Parent inum
+// - name: Name of directory
+// Returns 0 if successful, else error (-ENOTDIR, -ENOTEMPTY, ...)
+int storage_rmdir(const char *path, int pinum, const char *name) {
+  if (path) pinum = tree_lookup(path);  // Lookup parent inum
+  return remove_entry(pinum, name, 1);
+}
+
 //=========================================================== storage_link =//
 // Creates link between 2 objects in filesystem
 // Args:
@@ -240,21 +698,134 @@ int storage_unlink(const char *path, int pinum, const char *name) {
 // Returns 0 if successful, else error
 int storage_link(const char *from, int from_inum, const char *to_parent, int to_pinum, const char *to_child) {
   if (from) from_inum = tree_lookup(from);  // Lookup source inum
-  assert(from_inum >= 0);
+  if (to_parent) to_pinum = tree_lookup(to_parent);  // Lookup parent destination
+  if (from_inum < 0 || to_pinum < 0) {
+    return -ENOENT;
+  }
+  inode_t *from_node = get_inode(from_inum);
+  if (from_node != NULL && S_ISDIR(from_node->mode)) {
+    return -EPERM;  // No links to directories (so parents lock before children)
+  }
 
-  inode_t *node = get_inode(from_inum);  // Get inod eof source object
-  node->refs++;
+  journal_start();
+  pthread_rwlock_rdlock(&namespace_lock);
+  inode_t *to_parent_node = lock_node(to_pinum, 1);  // Get inode of parent destination
+  inode_t *node = to_parent_node ? lock_node(from_inum, 1) : NULL;  // Get inode of source object
 
-  if (to_parent) to_pinum = tree_lookup(to_parent);  // Lookup parent destination
-  inode_t *to_parent_node = get_inode(to_pinum);  // Get inode of parent destination
+  int rv = -ENOENT;
+  if (node != NULL) {
+    rv = directory_put(to_parent_node, to_child, from_inum);  // Create link in destination directory
+    if (rv == 0) {
+      node->refs++;
+    }
+    inode_unlock(from_inum);
+  }
+  if (to_parent_node != NULL) {
+    inode_unlock(to_pinum);
+  }
+
+  pthread_rwlock_unlock(&namespace_lock);
+  journal_stop();
+  return rv;
+}
 
-  int rv = directory_put(to_parent_node, to_child, from_inum);  // Create link in destination directory
+//=========================================================== move_entry =//
+// Move an entry to another name, replacing what that name held. The caller
+// holds the namespace lock for writing (so no directory changes meanwhile)
+// and both parents' write locks.
+// Args:
+// - from_pnode: Source parent inode
+// - from_pinum: Source parent inum
+// - from_child: Source child object name
+// - to_pnode: Destination parent inode
+// - to_pinum: Destination parent inum
+// - to_child: Destination child object name
+// Returns 0 if successful, else error
+static int move_entry(inode_t *from_pnode, int from_pinum, const char *from_child,
+                      inode_t *to_pnode, int to_pinum, const char *to_child) {
+  if (strcmp(from_child, ".") == 0 || strcmp(from_child, "..") == 0 ||
+      strcmp(to_child, ".") == 0 || strcmp(to_child, "..") == 0) {
+    return -EINVAL;
+  }
+  int from_inum = directory_lookup(from_pnode, from_child);
+  if (from_inum < 0) {
+    return -ENOENT;
+  }
+  int to_inum = directory_lookup(to_pnode, to_child);
+  if (to_inum == from_inum) {
+    return 0;  // Same name, or two links to the same file: nothing to do
+  }
+  if (from_inum == to_pinum) {
+    return -EINVAL;  // A directory into itself (locked already)
+  }
+
+  inode_t *node = lock_node(from_inum, 1);
+  if (node == NULL) {
+    return -ENOENT;
+  }
+  int dir = S_ISDIR(node->mode);
+
+  int rv = 0;
+  if (dir) {
+    // Not into itself or its own subtree: walk up from the destination
+    for (int p = to_pinum; p != ROOT_INODE && rv == 0; ) {
+      if (p == from_inum) {
+        rv = -EINVAL;
+      } else if ((p = directory_lookup(get_inode(p), "..")) < 0) {
+        rv = -ENOENT;
+      }
+    }
+  }
 
+  // The object the destination name held, checked as rename(2) does
+  inode_t *to_node = NULL;
+  if (rv == 0 && to_inum == from_pinum) {
+    rv = dir ? -ENOTEMPTY : -EISDIR;  // An ancestor (locked already)
+  } else if (rv == 0 && to_inum >= 0) {
+    to_node = lock_node(to_inum, 1);
+    if (to_node == NULL) {
+      rv = -ENOENT;
+    } else if (S_ISDIR(to_node->mode) && !dir) {
+      rv = -EISDIR;
+    } else if (!S_ISDIR(to_node->mode) && dir) {
+      rv = -ENOTDIR;
+    } else if (S_ISDIR(to_node->mode) && !directory_is_empty(to_node)) {
+      rv = -ENOTEMPTY;
+    }
+  }
+
+  if (rv == 0) {
+    // Link object to new location, then unlink from old location (its link
+    // count ends up where it was). A replaced entry frees its slot first,
+    // so the put can't fail after anything has changed.
+    if (to_node != NULL) {
+      directory_delete(to_pnode, to_child);
+    }
+    rv = directory_put(to_pnode, to_child, from_inum);
+    if (rv == 0) {
+      directory_delete(from_pnode, from_child);
+      if (dir && to_pinum != from_pinum) {
+        directory_delete(node, "..");  // Its new parent
+        directory_put(node, "..", to_pinum);
+      }
+      if (to_node != NULL) {
+        to_node->refs--;
+        release_node(to_inum, to_node);  // Unless still linked or open
+      }
+    }
+  }
+
+  if (to_node != NULL) {
+    inode_unlock(to_inum);
+  }
+  inode_unlock(from_inum);
   return rv;
 }
 
 //=========================================================== storage_rename =//
-// Renames/moves object within filesystem
+// Renames/moves object within filesystem, replacing the destination if it
+// exists (an empty directory by a directory, else a non-directory by a
+// non-directory)
 // Args:
 // - from_parent: Source parent path. If null use from_pinum
 // - from_pinum: Source parent inum
@@ -262,20 +833,35 @@ int storage_link(const char *from, int from_inum, const char *to_parent, int to_
 // - to_parent: Destination parent path. If null use to_pinum
 // - to_pinum: Destination parent inum
 // - to_child: Destination child object name
-// Returns 0 if successful, else error
+// Returns 0 if successful, else error (-EINVAL for a directory moved into
+// its own subtree)
 int storage_rename(const char *from_parent, int from_pinum, const char *from_child, const char *to_parent, int to_pinum, const char *to_child) {
   if (from_parent) from_pinum = tree_lookup(from_parent);  // Lookup parent source inum
+  if (to_parent) to_pinum = tree_lookup(to_parent);  // Lookup parent destination
 
-  inode_t* from_pnode = get_inode(from_pinum);  // Get inode of parent source
-  int from_inum = directory_lookup(from_pnode, from_child);
-
-  // Link object to new location
-  storage_link(NULL, from_inum, to_parent, to_pinum, to_child);
+  // Only rename holds more than one directory lock, so any order will do
+  journal_start();
+  pthread_rwlock_wrlock(&namespace_lock);
+  inode_t* from_pnode = lock_node(from_pinum, 1);  // Get inode of parent source
+  inode_t* to_pnode = from_pnode;
+  if (from_pnode != NULL && to_pinum != from_pinum) {
+    to_pnode = lock_node(to_pinum, 1);  // Get inode of parent destination
+  }
 
-  // Unlink from old location
-  storage_unlink(from_parent, from_pinum, from_child);
+  int rv = -ENOENT;
+  if (from_pnode != NULL && to_pnode != NULL) {
+    rv = move_entry(from_pnode, from_pinum, from_child, to_pnode, to_pinum, to_child);
+  }
 
-  return 0;
+  if (to_pnode != NULL && to_pinum != from_pinum) {
+    inode_unlock(to_pinum);
+  }
+  if (from_pnode != NULL) {
+    inode_unlock(from_pinum);
+  }
+  pthread_rwlock_unlock(&namespace_lock);
+  journal_stop();
+  return rv;
 }
 
 //=========================================================== storage_list =//
@@ -286,32 +872,12 @@ int storage_rename(const char *from_parent, int from_pinum, const char *from_chi
 // - inum: inum of directory
 // Returns a linked list of dirent_node_t containing all the directory entries.
 dirent_node_t *storage_list(const char *path, int inum) {
-  return directory_list(path, inum);
-}
-
-//=========================================================== split_path =//
-// Splits given filesystem path into directory part filename / Seprate fullpath
-// Args:
-// - path: Full path
-// - directory: Char array (directory part is stored)
-// - name: Char array (name part is stored)
-// Note: 'directory' and 'name' should be pre-allocated with sufficient space.
-void split_path(const char *path, char *directory, char *name) {
-  strcpy(directory, path);  // Copy full path into directoory
-
-  int counter = 0;
-  int index = strlen(path) - 1;
-  while (path[index] != '/') {  // Oterate from end of path (find last '/')
-    counter++;
-    index--;
+  if (path) inum = tree_lookup(path);
+  if (lock_node(inum, 0) == NULL) {
+    return NULL;  // No such directory
   }
 
-  if (counter != strlen(path) - 1) {  // Split path at last '/'
-    directory[strlen(path) - counter - 1] = '\0';  // Terminate directory path
-    if (name) strcpy(name, &directory[strlen(path) - counter]);  // Copy name part
-  }
-  else {  // Handle cases (no parent directory)
-    directory[1] = '\0';
-    if (name) strcpy(name, &path[1]);
-  }
+  dirent_node_t *items = directory_list(NULL, inum);
+  inode_unlock(inum);
+  return items;
 }
@@ -1,5 +1,7 @@
 // Disk storage abstracttion.
 //
+// Safe to call from several threads at once (FUSE's multithreaded mode).
+//
 // Feel free to use as inspiration. Provided as-is.
 
 // based on cs3650 starter code
@@ -19,19 +21,27 @@
 #include "inode.h"
 #include "slist.h"
 #include "directory.h"
+#include "path.h"
 
 
 void storage_init(const char *path); // Init storage
+void storage_free();  // Write everything back & close storage
+void storage_set_writeback(int age);  // Write back changes at most age seconds old
+int storage_fsync(const char *path, int inum);  // Make object durable
 int storage_stat(const char *path, int inum, struct stat *st);  // Get stats from file/directory
 int storage_read(const char *path, int inum, char *buf, size_t size, off_t offset);  // Read data from file into buffer
 int storage_write(const char *path, int inum, const char *buf, size_t size, off_t offset);  // Write data to file from buffer
-int storage_truncate(const char *path, off_t size);  // Truncate file to size
+int storage_truncate(const char *path, int inum, off_t size);  // Truncate file to size
+int storage_chmod(const char *path, int inum, int mode);  // Change mode of object
+int storage_set_time(const char *path, int inum, time_t mtime);  // Set time object last modified
+int storage_lookup(int pinum, const char *name, int ref);  // Find name in directory (ref: count a reference)
+void storage_forget(int inum, unsigned long count);  // Drop references counted by storage_lookup
 int storage_mknod(const char *path, const char *name, int pinum, int mode);  // Create new file/directory
-int storage_unlink(const char *path, int pinum, const char *name);  // Delete object at path
+int storage_unlink(const char *path, int pinum, const char *name);  // Delete file at path
+int storage_rmdir(const char *path, int pinum, const char *name);  // Delete empty directory at path
 int storage_link(const char *from, int from_inum, const char *to_parent, int to_pinum, const char *to_child);  // Create hardlink between 2 paths
 // Rename/move object from path1 to path2
 int storage_rename(const char *from_parent, int from_pinum, const char *from_child, const char *to_parent, int to_pinum, const char *to_child);
 dirent_node_t *storage_list(const char *path, int inum);  // List objects at path
-void split_path(const char *path, char *directory, char *name);  // Split full path into directory & file parts
 
 #endif
@@ -1,9 +1,71 @@
+#include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #include "bitmap.h"
 
 #define SIZE 256
 
+// Set bits [from, to) to v
+static void put_range(void *bm, int from, int to, int v) {
+  for (int i = from; i < to; i++) {
+    bitmap_put(bm, i, v);
+  }
+}
+
+// Searches at the edges of the 64-bit words they scan
+static void test_find() {
+  uint64_t bm[SIZE / 64] = {0};
+
+  // Empty: the start bit itself, on either side of a word edge
+  assert(bitmap_find_first_zero(bm, 0, SIZE) == 0);
+  assert(bitmap_find_first_zero(bm, 63, SIZE) == 63);
+  assert(bitmap_find_first_zero(bm, 64, SIZE) == 64);
+  assert(bitmap_find_first_zero(bm, SIZE, SIZE) == -1);
+
+  // Hits on the first & last bits of a word
+  put_range(bm, 0, 64, 1);
+  assert(bitmap_find_first_zero(bm, 0, SIZE) == 64);
+  put_range(bm, 64, 127, 1);
+  assert(bitmap_find_first_zero(bm, 0, SIZE) == 127);
+  assert(bitmap_find_first_zero(bm, 128, SIZE) == 128);
+
+  // Full
+  put_range(bm, 0, SIZE, 1);
+  assert(bitmap_find_first_zero(bm, 0, SIZE) == -1);
+  assert(bitmap_find_zero_run(bm, 0, SIZE, 1) == -1);
+
+  // Size not a multiple of 64: the 0 bits past it don't count
+  assert(bitmap_find_first_zero(bm, 0, 100) == -1);
+  bitmap_put(bm, 99, 0);
+  assert(bitmap_find_first_zero(bm, 0, 100) == 99);
+  assert(bitmap_find_first_zero(bm, 0, 99) == -1);
+  put_range(bm, 90, 128, 0);
+  assert(bitmap_find_zero_run(bm, 0, 100, 10) == 90);
+  assert(bitmap_find_zero_run(bm, 0, 100, 11) == -1);
+
+  // Runs spanning words
+  put_range(bm, 0, SIZE, 1);
+  put_range(bm, 60, 71, 0);
+  assert(bitmap_find_zero_run(bm, 0, SIZE, 11) == 60);
+  assert(bitmap_find_zero_run(bm, 0, SIZE, 12) == -1);
+  assert(bitmap_find_zero_run(bm, 62, SIZE, 5) == 62);
+
+  // A run too short is skipped for a later one
+  put_range(bm, 10, 13, 0);
+  assert(bitmap_find_zero_run(bm, 0, SIZE, 3) == 10);
+  assert(bitmap_find_zero_run(bm, 0, SIZE, 4) == 60);
+
+  // A run covering a whole word, and one ending at the last bit
+  put_range(bm, 0, SIZE, 1);
+  put_range(bm, 32, 160, 0);
+  assert(bitmap_find_zero_run(bm, 0, SIZE, 128) == 32);
+  assert(bitmap_find_zero_run(bm, 0, SIZE, 129) == -1);
+  put_range(bm, 0, SIZE, 1);
+  put_range(bm, SIZE - 70, SIZE, 0);
+  assert(bitmap_find_zero_run(bm, 0, SIZE, 70) == SIZE - 70);
+}
+
 int main(int argc, char **argv) {
 
   long bm[SIZE / sizeof(long)] = {0};
@@ -26,6 +88,9 @@ int main(int argc, char **argv) {
   bitmap_put(bm, 255, 1);
   bitmap_print(bm, SIZE);
 
+  test_find();
+  printf("\nSearches: ok\n");
+
   return 0;
 }
 
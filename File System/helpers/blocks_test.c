@@ -18,7 +18,7 @@ int main(int argc, char **argv) {
   printf("Block bitmap after allocating:\n");
   bitmap_print(get_blocks_bitmap(), BLOCK_COUNT);
 
-  long *block = blocks_get_block(block_num);
+  long *block = blocks_get_data(block_num);
 
   for (int i = 0; i < 42; i++) {
     block[i] = i + 1;
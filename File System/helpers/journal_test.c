@@ -0,0 +1,189 @@
+// Crash recovery: build the images a crash in the middle of a commit can
+// leave (from copies of the image taken at two commits), mount each one
+// and check that it comes back as of one commit or the other.
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bitmap.h"
+#include "journal.h"
+#include "storage.h"
+
+#define TEST_NAME "journal_test.img"
+#define CRASH_NAME "journal_crash.img"
+
+// A copy of the image file
+typedef struct image {
+  char *bytes;
+  size_t size;
+} image_t;
+
+static image_t read_image(const char *path) {
+  int fd = open(path, O_RDONLY);
+  assert(fd >= 0);
+  struct stat st;
+  assert(fstat(fd, &st) == 0);
+  image_t img = {malloc(st.st_size), st.st_size};
+  assert(img.bytes != NULL);
+  assert(pread(fd, img.bytes, img.size, 0) == (ssize_t)img.size);
+  close(fd);
+  return img;
+}
+
+static void write_image(const char *path, image_t img) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  assert(fd >= 0);
+  assert(pwrite(fd, img.bytes, img.size, 0) == (ssize_t)img.size);
+  close(fd);
+}
+
+static char *block(image_t img, int bnum) {
+  return img.bytes + (size_t)bnum * BLOCK_SIZE;
+}
+
+// Every block of every file used once, and marked used
+static void check_blocks() {
+  superblock_t *sb = get_superblock();
+  char *seen = calloc(sb->max_blocks, 1);
+  for (int inum = 0; inum < INODE_COUNT; inum++) {
+    inode_t *node = get_inode(inum);
+    if (node == NULL) {
+      continue;
+    }
+    for (int i = 0; i < bytes_to_blocks(node->size); i++) {
+      int bnum = inode_get_bnum(node, i);
+      assert(bnum >= sb->data_start && bnum < sb->block_count);
+      assert(!seen[bnum]);
+      seen[bnum] = 1;
+      assert(bitmap_get(get_blocks_bitmap(), bnum));
+    }
+  }
+  free(seen);
+}
+
+// Mount an image and check it is as of the first commit (first) or the
+// second
+static void check_state(int first) {
+  storage_init(CRASH_NAME);
+  char buf[8] = {0};
+  assert(storage_read("/a1", -1, buf, 5, 0) == 5 && strcmp(buf, "hello") == 0);
+  assert(tree_lookup("/d") > 0);
+  if (first) {
+    assert(tree_lookup("/a2") > 0);
+    assert(tree_lookup("/a3") > 0);
+    assert(tree_lookup("/d/b1") < 0);
+    assert(tree_lookup("/d/b3") < 0);
+  } else {
+    assert(tree_lookup("/a2") < 0);
+    assert(tree_lookup("/a3") < 0);
+    assert(tree_lookup("/d/b1") > 0);
+    assert(tree_lookup("/d/b3") > 0);
+  }
+  check_blocks();
+
+  // Groups committed after recovery are replayed after the old ones
+  assert(storage_mknod("/", "after", -1, 0100644) == 0);
+  assert(journal_commit() == 0);
+  storage_free();
+  storage_init(CRASH_NAME);
+  assert(tree_lookup("/after") > 0);
+  storage_free();
+}
+
+int main(int argc, char **argv) {
+  remove(TEST_NAME);
+  assert(blocks_format(TEST_NAME, 1024, 64, 1 << 16, DEFAULT_JOURNAL_BLOCKS) == 0);
+  storage_init(TEST_NAME);
+
+  // First commit
+  assert(storage_mknod("/", "a1", -1, 0100644) == 0);
+  assert(storage_write("/a1", -1, "hello", 5, 0) == 5);
+  assert(storage_mknod("/", "a2", -1, 0100644) == 0);
+  assert(storage_mknod("/", "a3", -1, 0100644) == 0);
+  assert(storage_mknod("/", "d", -1, 040755) == 0);
+  assert(journal_commit() == 0);
+  image_t first = read_image(TEST_NAME);
+
+  // Second commit (metadata only)
+  assert(storage_unlink("/", -1, "a2") == 0);
+  assert(storage_mknod("/d", "b1", -1, 0100644) == 0);
+  assert(storage_rename("/", -1, "a3", "/d", -1, "b3") == 0);
+  assert(journal_commit() == 0);
+  image_t second = read_image(TEST_NAME);
+  storage_free();
+  assert(first.size == second.size);
+
+  // The second group's half of the journal: its header, then its images
+  superblock_t *sb = (superblock_t *)first.bytes;
+  int half = -1;
+  for (int h = 0; h < 2; h++) {
+    int at = sb->journal + h * (sb->journal_blocks / 2);
+    if (memcmp(block(first, at), block(second, at), BLOCK_SIZE) != 0) {
+      half = at;
+    }
+  }
+  assert(half >= 0);
+  uint32_t count = ((uint32_t *)block(second, half))[2];  // magic, seq, count
+  assert(count > 0);
+
+  // Home blocks the second commit changed
+  int homes[1024];
+  int nhomes = 0;
+  for (int bnum = 0; bnum < sb->block_count; bnum++) {
+    if (bnum >= sb->journal && bnum < sb->journal + sb->journal_blocks) {
+      continue;
+    }
+    if (memcmp(block(first, bnum), block(second, bnum), BLOCK_SIZE) != 0) {
+      assert(nhomes < 1024);
+      homes[nhomes++] = bnum;
+    }
+  }
+  assert(nhomes > 0);
+
+  image_t crash = {malloc(first.size), first.size};
+  assert(crash.bytes != NULL);
+
+  // Torn journal write: the header and all but the last image
+  memcpy(crash.bytes, first.bytes, first.size);
+  memcpy(block(crash, half), block(second, half), (size_t)count * BLOCK_SIZE);
+  memset(block(crash, half + count), 0xa5, BLOCK_SIZE);
+  write_image(CRASH_NAME, crash);
+  check_state(1);
+  printf("torn group: replayed up to the first commit\n");
+
+  // Torn journal write: the images but not the header
+  memcpy(crash.bytes, first.bytes, first.size);
+  memcpy(block(crash, half + 1), block(second, half + 1), (size_t)count * BLOCK_SIZE);
+  write_image(CRASH_NAME, crash);
+  check_state(1);
+  printf("no header: replayed up to the first commit\n");
+
+  // Journal written, home blocks not
+  memcpy(crash.bytes, first.bytes, first.size);
+  memcpy(block(crash, half), block(second, half), (size_t)(count + 1) * BLOCK_SIZE);
+  write_image(CRASH_NAME, crash);
+  check_state(0);
+  printf("no homes: replayed up to the second commit\n");
+
+  // Journal written, some home blocks
+  for (int i = 0; i < nhomes; i += 2) {
+    memcpy(block(crash, homes[i]), block(second, homes[i]), BLOCK_SIZE);
+  }
+  write_image(CRASH_NAME, crash);
+  check_state(0);
+  printf("some homes: replayed up to the second commit\n");
+
+  free(first.bytes);
+  free(second.bytes);
+  free(crash.bytes);
+  remove(TEST_NAME);
+  remove(CRASH_NAME);
+  printf("ok\n");
+  return 0;
+}
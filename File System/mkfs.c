@@ -0,0 +1,91 @@
+// mkfs.nufs: create a nufs disk image of a given size
+//
+// Usage: ./mkfs.nufs [-s size] [-i inodes] [-m max_size] [-j journal_size] image
+//   size, max_size, journal_size: bytes, with an optional K, M or G suffix
+//   (default: 2M, growing up to 1G or 4 * size, whichever is larger;
+//   a 1M metadata journal, -j 0 for none)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "files/blocks.h"
+#include "files/storage.h"
+
+//============================================================= parse_size =//
+// Parse a size like 4096, 64K, 512M or 2G
+// Args:
+// - text: Size to parse
+// Returns size in blocks (rounded up), else -1
+static long parse_size(const char *text) {
+  char *end;
+  long bytes = strtol(text, &end, 10);
+
+  switch (*end) {
+    case 'G': case 'g': bytes *= 1024;  // fall through
+    case 'M': case 'm': bytes *= 1024;  // fall through
+    case 'K': case 'k': bytes *= 1024; end++; break;
+    case '\0': break;
+    default: return -1;
+  }
+  if (*end != '\0' || bytes <= 0) {
+    return -1;
+  }
+  return (bytes + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [-s size] [-i inodes] [-m max_size] [-j journal_size] image\n",
+          prog);
+  exit(1);
+}
+
+//============================================================= main =//
+int main(int argc, char *argv[]) {
+  long blocks = DEFAULT_BLOCK_COUNT;
+  long inodes = DEFAULT_INODE_COUNT;
+  long max_blocks = 0;  // default: see below
+  long journal_blocks = DEFAULT_JOURNAL_BLOCKS;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:i:m:j:")) != -1) {
+    switch (opt) {
+      case 's': blocks = parse_size(optarg); break;
+      case 'i': inodes = atol(optarg); break;
+      case 'm': max_blocks = parse_size(optarg); break;
+      case 'j': journal_blocks = strcmp(optarg, "0") ? parse_size(optarg) : 0; break;
+      default: usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1 || blocks <= 0 || inodes <= 0 || max_blocks < 0 ||
+      journal_blocks < 0) {
+    usage(argv[0]);
+  }
+
+  if (max_blocks == 0) {
+    max_blocks = blocks * 4 > DEFAULT_MAX_BLOCKS ? blocks * 4 : DEFAULT_MAX_BLOCKS;
+    if (max_blocks > (1 << 30)) max_blocks = 1 << 30;
+  }
+  if (blocks > (1 << 30) || inodes > (1 << 30) || max_blocks > (1 << 30) ||
+      journal_blocks > (1 << 20)) {
+    fprintf(stderr, "%s: size too large\n", argv[0]);
+    return 1;
+  }
+
+  const char *image = argv[optind];
+  if (blocks_format(image, blocks, inodes, max_blocks, journal_blocks) != 0) {
+    fprintf(stderr, "%s: can't format %s (too small for %ld inodes?)\n",
+            argv[0], image, inodes);
+    return 1;
+  }
+
+  // Create the root directory (committed by blocks_free)
+  storage_init(image);
+  storage_free();
+
+  printf("%s: %ld blocks of %d bytes, %ld inodes, may grow to %ld blocks, "
+         "%ld-block journal\n",
+         image, blocks, BLOCK_SIZE, inodes, max_blocks, journal_blocks);
+  return 0;
+}
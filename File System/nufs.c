@@ -17,6 +17,21 @@
 #define FUSE_USE_VERSION 30
 #include <fuse.h>
 
+// Mount options (-o ...)
+typedef struct nufs_config {
+  int writeback_age;  // writeback_age=N: seconds changes may stay in memory
+  int sync_on_close;  // sync_on_close: close makes a file durable (else async)
+} nufs_config_t;
+
+static const struct fuse_opt nufs_opts[] = {
+  {"writeback_age=%d", offsetof(nufs_config_t, writeback_age), 0},
+  {"sync_on_close", offsetof(nufs_config_t, sync_on_close), 1},
+  {"async", offsetof(nufs_config_t, sync_on_close), 0},
+  FUSE_OPT_END
+};
+
+static nufs_config_t config;
+
 //============================================================= nufs_access =//
 // implementation for: man 2 access
 // Checks if a file exists.
@@ -77,8 +92,9 @@ int nufs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
     printf("current item: %s\n", xs->entry.name);
 
     rv = storage_stat(NULL, xs->entry.inum, &st);  // Get stat for every entry
-    assert(rv == 0);
-    filler(buf, xs->entry.name, &st, 0);  // Add entry to buffer
+    if (rv == 0) {
+      filler(buf, xs->entry.name, &st, 0);  // Add entry to buffer (unless just removed)
+    }
 
     // Memory management for list
     dirent_node_t *to_del = xs;
@@ -105,13 +121,10 @@ int nufs_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
 // - rdev: Device ID (Didn't use)
 // Returns 0 on success, -1 on failure.
 int nufs_mknod(const char *path, mode_t mode, dev_t rdev) {
-  char *directory = malloc(strlen(path) + 1);
-  char *name = malloc(strlen(path) + 1);
-  split_path(path, directory, name);  // Split path to directory & file name
-  int rv = storage_mknod(directory, name, -1, mode);  // Create file object
-
-  free(directory);
-  free(name);
+  int parent_len;
+  const char *name = path_split(path, &parent_len);  // Split path to directory & file name
+  int pinum = tree_lookup_n(path, parent_len);  // Find inum (parent directory)
+  int rv = storage_mknod(NULL, name, pinum, mode);  // Create file object
 
   printf("mknod(%s, %04o) -> %d\n", path, mode, rv);
   return rv;
@@ -126,20 +139,10 @@ int nufs_mknod(const char *path, mode_t mode, dev_t rdev) {
 // - mode: Permission mode (directory)
 // Returns 0 if successful, else negative
 int nufs_mkdir(const char *path, mode_t mode) {
-  int rv = nufs_mknod(path, mode | 040000, 0);
-  int inum = tree_lookup(path);  // Find inum (directory)
-  inode_t *node = get_inode(inum);  // Get inode (directory)
-
-  char *from_parent = malloc(strlen(path) + 1);
-  split_path(path, from_parent, NULL);  // Split path/ Get parent dir
-  int parent_inum = tree_lookup(from_parent);  // Find inum (parent directory)
-
-  free(from_parent);
-
-  if (rv >= 0) {
-    directory_put(node, ".", inum);  // Add entry (directory
-    directory_put(node, "..", parent_inum); // Add entry (parent directory)
-  }
+  int parent_len;
+  const char *name = path_split(path, &parent_len);  // Split path/ Get parent dir
+  int parent_inum = tree_lookup_n(path, parent_len);  // Find inum (parent directory)
+  int rv = storage_mknod(NULL, name, parent_inum, mode | 040000);  // Adds "." & ".." too
 
   printf("mkdir(%s) -> %d\n", path, rv);
   return rv;
@@ -152,15 +155,11 @@ int nufs_mkdir(const char *path, mode_t mode) {
 // - path: Path to file
 // Returns 0 if successful, else negative
 int nufs_unlink(const char *path) {
-  char *directory = malloc(strlen(path) + 1);
-  char *child = malloc(strlen(path) + 1);
-  split_path(path, directory, child);  // Split path/ Get dir & filename
-
-  int rv = storage_unlink(directory, -1, child);  // Unlink file
+  int parent_len;
+  const char *child = path_split(path, &parent_len);  // Split path/ Get dir & filename
+  int pinum = tree_lookup_n(path, parent_len);
 
-  // free allocated memory
-  free(directory);
-  free(child);
+  int rv = pinum < 0 ? -ENOENT : storage_unlink(NULL, pinum, child);  // Unlink file
 
   printf("unlink(%s) -> %d\n", path, rv);
   return rv;
@@ -174,16 +173,12 @@ int nufs_unlink(const char *path) {
 // - to: Path to link location
 // Returns 0 if successful, else negative
 int nufs_link(const char *from, const char *to) {
-  char *to_parent = malloc(strlen(to) + 1);
-  char *to_child = malloc(strlen(to) + 1);
+  int to_parent_len;
+  const char *to_child = path_split(to, &to_parent_len);  // Split link location path
+  int to_pinum = tree_lookup_n(to, to_parent_len);
 
-  split_path(to, to_parent, to_child);  // Split link location path
-
-  int rv = storage_link(from, -1, to_parent, -1, to_child);  // Create link
+  int rv = storage_link(from, -1, NULL, to_pinum, to_child);  // Create link
   printf("link(%s => %s) -> %d\n", from, to, rv);
-
-  free(to_parent);
-  free(to_child);
   return rv;
 }
 
@@ -193,17 +188,15 @@ int nufs_link(const char *from, const char *to) {
 // - path: Path to directory
 // Returns 0 if successful, else negative
 int nufs_rmdir(const char *path) {
-  int inum = tree_lookup(path);  // Find inum (directory)
-  inode_t *node = get_inode(inum);  // Get inode (diretory)
+  int parent_len;
+  const char *child = path_split(path, &parent_len);  // Split path/ Get parent & name
+  int pinum = tree_lookup_n(path, parent_len);
 
-  int mode = node->mode;  // Get node of inode
+  // Only empty directories (checked with the directory locked)
+  int rv = pinum < 0 ? -ENOENT : storage_rmdir(NULL, pinum, child);
 
-  // Check mode --> directory
-  if (mode != 040755) {
-    printf("rmdir(%s) -> %d\n", path, -1);
-    return -1;  // Not directory
-  }
-  return nufs_unlink(path);  // Unlink to remove directory
+  printf("rmdir(%s) -> %d\n", path, rv);
+  return rv;
 }
 
 //============================================================= nufs_rename =//
@@ -214,21 +207,14 @@ int nufs_rmdir(const char *path) {
 // - to: New path
 // Returns 0 if successful, else negative
 int nufs_rename(const char *from, const char *to) {
-  char *from_parent = malloc(strlen(from) + 1);
-  char *from_child = malloc(strlen(from) + 1);
-  char *to_parent = malloc(strlen(to) + 1);
-  char *to_child = malloc(strlen(to) + 1);
-
-  split_path(from, from_parent, from_child);  // Split source path
-  split_path(to, to_parent, to_child);  // Split final path
+  int from_parent_len, to_parent_len;
+  const char *from_child = path_split(from, &from_parent_len);  // Split source path
+  const char *to_child = path_split(to, &to_parent_len);  // Split final path
+  int from_pinum = tree_lookup_n(from, from_parent_len);
+  int to_pinum = tree_lookup_n(to, to_parent_len);
 
-  int rv = storage_rename(from_parent, -1, from_child, to_parent, -1, to_child);  // Rename
+  int rv = storage_rename(NULL, from_pinum, from_child, NULL, to_pinum, to_child);  // Rename
   printf("rename(%s => %s) -> %d\n", from, to, rv);
-
-  free(from_parent);
-  free(from_child);
-  free(to_parent);
-  free(to_child);
   return rv;
 }
 
@@ -239,17 +225,7 @@ int nufs_rename(const char *from, const char *to) {
 // - mode: New permission mode
 // Returns 0 if successful, else negative
 int nufs_chmod(const char *path, mode_t mode) {
-  int rv = -1;
-  int inum = tree_lookup(path);  // Find inum (path)
-  inode_t *node = get_inode(inum);  // Get inode (path)
-
-  if (node->mode == mode) {
-    return 0;  // no change
-  } else {
-    node->mode = mode;  // Update mode
-    rv = 0;
-  }
-
+  int rv = storage_chmod(path, -1, mode);  // Update mode
   printf("chmod(%s, %04o) -> %d\n", path, mode, rv);
   return rv;
 }
@@ -261,7 +237,7 @@ int nufs_chmod(const char *path, mode_t mode) {
 // - size: New file size
 // Returns 0 if successful, else negative
 int nufs_truncate(const char *path, off_t size) {
-  int rv = storage_truncate(path, size);
+  int rv = storage_truncate(path, -1, size);
   printf("truncate(%s, %ld bytes) -> %d\n", path, size, rv);
   return rv;
 }
@@ -314,6 +290,33 @@ int nufs_write(const char *path, const char *buf, size_t size, off_t offset,
   return rv;
 }
 
+//============================================================= nufs_fsync =//
+// Make a file's data & metadata durable
+// Args:
+// - path: Path to file/directory
+// - datasync: If set, only data needs syncing (same here: sizes and
+//   block maps are metadata too)
+// - fi: Fuse file info (didn't use)
+// Returns 0 if successful, else negative
+int nufs_fsync(const char *path, int datasync, struct fuse_file_info *fi) {
+  int rv = storage_fsync(path, -1);
+  printf("fsync(%s, %d) -> %d\n", path, datasync, rv);
+  return rv;
+}
+
+//============================================================= nufs_flush =//
+// Called on each close of a file: with sync_on_close, make it durable
+// before close returns (release comes too late: close doesn't wait for it)
+// Args:
+// - path: Path to file
+// - fi: Fuse file info (didn't use)
+// Returns 0 if successful, else negative
+int nufs_flush(const char *path, struct fuse_file_info *fi) {
+  int rv = config.sync_on_close ? storage_fsync(path, -1) : 0;
+  printf("flush(%s) -> %d\n", path, rv);
+  return rv;
+}
+
 //============================================================= nufs_utimens =//
 // Update the timestamps on a file or directory.
 // Args:
@@ -321,12 +324,8 @@ int nufs_write(const char *path, const char *buf, size_t size, off_t offset,
 // - ts: Array of timespec struct, ts[0] = time last accessed, ts[1] = time last mod
 // Returns 0 if successful, else -1
 int nufs_utimens(const char *path, const struct timespec ts[2]) {
-  int inum = tree_lookup(path);  // Find inum (path)
-  inode_t *node = get_inode(inum);  // Get inode (path)
-  time_t time = ts->tv_sec;  // Update time modded
-  node->mtime = time;
-
-  if (node == NULL) {
+  int rv = storage_set_time(path, -1, ts[1].tv_sec);  // Update time modded
+  if (rv < 0) {
     return -1;  // Inode not found
   }
 
@@ -374,15 +373,31 @@ static const struct fuse_operations nufs_ops = {
 
   .read = nufs_read,
   .write = nufs_write,
+  .flush = nufs_flush,
+  .fsync = nufs_fsync,
+  .fsyncdir = nufs_fsync,
   .utimens = nufs_utimens,
   .ioctl = nufs_ioctl,
 };
 
 //============================================================= main =//
+// Usage: ./nufs [FUSE options] [-o writeback_age=N] [-o sync_on_close|async]
+//               mountpoint image
 int main(int argc, char *argv[]) {
-  assert(argc > 2 && argc < 6);
+  assert(argc > 2);
 
   // initalize blocks
   storage_init(argv[--argc]);
-  return fuse_main(argc, argv, &nufs_ops, NULL);
+
+  struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+  if (fuse_opt_parse(&args, &config, nufs_opts, NULL) == -1) {
+    return 1;
+  }
+  storage_set_writeback(config.writeback_age);
+
+  int rv = fuse_main(args.argc, args.argv, &nufs_ops, NULL);
+  fuse_opt_free_args(&args);
+
+  storage_free();  // Write back & commit the journal
+  return rv;
 }
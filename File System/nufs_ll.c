@@ -0,0 +1,420 @@
+// nufs on the FUSE low-level API
+//
+// The kernel names files by inode number, and nufs inums are used as
+// FUSE inode numbers as-is (ROOT_INODE == FUSE_ROOT_ID), so every callback
+// goes straight to storage by inum; only lookup searches a directory, one
+// name at a time. Each entry replied to the kernel counts a reference
+// (storage_lookup), dropped again on forget.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "files/inode.h"
+#include "files/storage.h"
+#include "files/directory.h"
+
+#define FUSE_USE_VERSION 30
+#include <fuse_lowlevel.h>
+
+// Seconds the kernel may cache names & attributes (all changes go through
+// this mount, so it stays coherent)
+#define NUFS_LL_TIMEOUT 1.0
+
+// Mount options (-o ...), as for nufs
+typedef struct nufs_config {
+  int writeback_age;  // writeback_age=N: seconds changes may stay in memory
+  int sync_on_close;  // sync_on_close: close makes a file durable (else async)
+} nufs_config_t;
+
+static const struct fuse_opt nufs_opts[] = {
+  {"writeback_age=%d", offsetof(nufs_config_t, writeback_age), 0},
+  {"sync_on_close", offsetof(nufs_config_t, sync_on_close), 1},
+  {"async", offsetof(nufs_config_t, sync_on_close), 0},
+  FUSE_OPT_END
+};
+
+static nufs_config_t config;
+
+//============================================================= reply_entry =//
+// Reply with the entry for a name in a directory, counting a reference
+// Args:
+// - req: Request to reply to
+// - parent: Inum of directory
+// - name: Name within directory
+static void reply_entry(fuse_req_t req, fuse_ino_t parent, const char *name) {
+  struct fuse_entry_param e;
+  memset(&e, 0, sizeof(e));
+
+  int inum = storage_lookup(parent, name, 1);
+  if (inum < 0) {
+    fuse_reply_err(req, -inum);
+    return;
+  }
+  storage_stat(NULL, inum, &e.attr);  // Can't be freed while referenced
+
+  e.ino = inum;
+  e.attr_timeout = NUFS_LL_TIMEOUT;
+  e.entry_timeout = NUFS_LL_TIMEOUT;
+  if (fuse_reply_entry(req, &e) != 0) {
+    storage_forget(inum, 1);  // Kernel never got it
+  }
+}
+
+//============================================================= reply_attr =//
+// Reply with the attributes of an object
+// Args:
+// - req: Request to reply to
+// - ino: Inum of object
+static void reply_attr(fuse_req_t req, fuse_ino_t ino) {
+  struct stat st;
+  if (storage_stat(NULL, ino, &st) < 0) {
+    fuse_reply_err(req, ENOENT);
+    return;
+  }
+  fuse_reply_attr(req, &st, NUFS_LL_TIMEOUT);
+}
+
+//============================================================= reply_status =//
+// Reply with the result of a storage call that returns 0 or -errno
+static void reply_status(fuse_req_t req, int rv) {
+  fuse_reply_err(req, rv < 0 ? -rv : 0);
+}
+
+//============================================================= ll_lookup =//
+// Find a name in a directory
+// Args:
+// - parent: Inum of directory
+// - name: Name within directory
+static void ll_lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
+  printf("lookup(%lu, %s)\n", parent, name);
+  reply_entry(req, parent, name);
+}
+
+//============================================================= ll_forget =//
+// Kernel dropped nlookup references to an inode
+static void ll_forget(fuse_req_t req, fuse_ino_t ino, unsigned long nlookup) {
+  storage_forget(ino, nlookup);
+  fuse_reply_none(req);
+}
+
+//============================================================= ll_getattr =//
+// Get an object's attributes (man 2 stat)
+static void ll_getattr(fuse_req_t req, fuse_ino_t ino,
+                       struct fuse_file_info *fi) {
+  reply_attr(req, ino);
+}
+
+//============================================================= ll_setattr =//
+// Change an object's mode, size and/or modification time
+// (chmod, truncate, utimens)
+// Args:
+// - attr: New attributes
+// - to_set: Which of them to set (FUSE_SET_ATTR_*)
+static void ll_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr,
+                       int to_set, struct fuse_file_info *fi) {
+  int rv = 0;
+
+  if (to_set & FUSE_SET_ATTR_MODE) {
+    rv = storage_chmod(NULL, ino, attr->st_mode);
+  }
+  if (rv == 0 && (to_set & FUSE_SET_ATTR_SIZE)) {
+    rv = storage_truncate(NULL, ino, attr->st_size);
+  }
+  if (rv == 0 && (to_set & FUSE_SET_ATTR_MTIME_NOW)) {
+    rv = storage_set_time(NULL, ino, time(NULL));
+  } else if (rv == 0 && (to_set & FUSE_SET_ATTR_MTIME)) {
+    rv = storage_set_time(NULL, ino, attr->st_mtime);
+  }
+
+  printf("setattr(%lu, %#x) -> %d\n", ino, to_set, rv);
+  if (rv < 0) {
+    reply_status(req, rv);
+  } else {
+    reply_attr(req, ino);
+  }
+}
+
+//============================================================= ll_mknod =//
+// Create a file (or directory) in a directory
+// Args:
+// - parent: Inum of directory
+// - name: Name of new object
+// - mode: Type & permissions of new object
+static void ll_mknod(fuse_req_t req, fuse_ino_t parent, const char *name,
+                     mode_t mode, dev_t rdev) {
+  int rv = storage_mknod(NULL, name, parent, mode);
+  printf("mknod(%lu, %s, %04o) -> %d\n", parent, name, mode, rv);
+  if (rv < 0) {
+    reply_status(req, rv);
+  } else {
+    reply_entry(req, parent, name);
+  }
+}
+
+//============================================================= ll_mkdir =//
+// Create a directory in a directory
+static void ll_mkdir(fuse_req_t req, fuse_ino_t parent, const char *name,
+                     mode_t mode) {
+  ll_mknod(req, parent, name, mode | 040000, 0);  // Adds "." & ".." too
+}
+
+//============================================================= ll_unlink =//
+// Remove a name from a directory (the object goes once unused)
+static void ll_unlink(fuse_req_t req, fuse_ino_t parent, const char *name) {
+  int rv = storage_unlink(NULL, parent, name);
+  printf("unlink(%lu, %s) -> %d\n", parent, name, rv);
+  reply_status(req, rv);
+}
+
+//============================================================= ll_rmdir =//
+// Remove an empty directory from a directory
+static void ll_rmdir(fuse_req_t req, fuse_ino_t parent, const char *name) {
+  int rv = storage_rmdir(NULL, parent, name);
+  printf("rmdir(%lu, %s) -> %d\n", parent, name, rv);
+  reply_status(req, rv);
+}
+
+//============================================================= ll_link =//
+// Add a name for an object
+// Args:
+// - ino: Inum of object
+// - newparent: Inum of directory
+// - newname: New name within directory
+static void ll_link(fuse_req_t req, fuse_ino_t ino, fuse_ino_t newparent,
+                    const char *newname) {
+  int rv = storage_link(NULL, ino, NULL, newparent, newname);
+  printf("link(%lu => %lu, %s) -> %d\n", ino, newparent, newname, rv);
+  if (rv < 0) {
+    reply_status(req, rv);
+  } else {
+    reply_entry(req, newparent, newname);
+  }
+}
+
+//============================================================= ll_rename =//
+// Move an object to another name (and/or directory)
+static void ll_rename(fuse_req_t req, fuse_ino_t parent, const char *name,
+                      fuse_ino_t newparent, const char *newname) {
+  int rv = storage_rename(NULL, parent, name, NULL, newparent, newname);
+  printf("rename(%lu, %s => %lu, %s) -> %d\n", parent, name, newparent,
+         newname, rv);
+  reply_status(req, rv);
+}
+
+//============================================================= ll_open =//
+// Open a file; nothing to set up, it's named by inum from now on
+static void ll_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+  struct stat st;
+  if (storage_stat(NULL, ino, &st) < 0) {
+    fuse_reply_err(req, ENOENT);
+  } else if (S_ISDIR(st.st_mode)) {
+    fuse_reply_err(req, EISDIR);
+  } else {
+    fuse_reply_open(req, fi);
+  }
+}
+
+//============================================================= ll_read =//
+// Read up to size bytes at off
+static void ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+                    struct fuse_file_info *fi) {
+  char *buf = malloc(size);
+  if (buf == NULL) {
+    fuse_reply_err(req, ENOMEM);
+    return;
+  }
+
+  int rv = storage_read(NULL, ino, buf, size, off);
+  if (rv < 0) {
+    reply_status(req, rv);
+  } else {
+    fuse_reply_buf(req, buf, rv);
+  }
+  free(buf);
+}
+
+//============================================================= ll_write =//
+// Write size bytes at off
+static void ll_write(fuse_req_t req, fuse_ino_t ino, const char *buf,
+                     size_t size, off_t off, struct fuse_file_info *fi) {
+  int rv = storage_write(NULL, ino, buf, size, off);
+  if (rv < 0) {
+    reply_status(req, rv);
+  } else {
+    fuse_reply_write(req, rv);
+  }
+}
+
+// Directory listing in the kernel's format, built on opendir
+typedef struct dirbuf {
+  char *p;
+  size_t size;
+} dirbuf_t;
+
+//============================================================= dirbuf_add =//
+// Append an entry to a listing
+// Args:
+// - b: Listing
+// - name: Name of entry
+// - st: Its attributes (only st_ino & the type in st_mode are used)
+static void dirbuf_add(fuse_req_t req, dirbuf_t *b, const char *name,
+                       const struct stat *st) {
+  size_t old = b->size;
+  b->size += fuse_add_direntry(req, NULL, 0, name, NULL, 0);
+  b->p = realloc(b->p, b->size);
+  assert(b->p != NULL);
+  fuse_add_direntry(req, b->p + old, b->size - old, name, st, b->size);
+}
+
+//============================================================= ll_opendir =//
+// Snapshot a directory's entries; readdir then hands them out by offset
+static void ll_opendir(fuse_req_t req, fuse_ino_t ino,
+                       struct fuse_file_info *fi) {
+  dirent_node_t *items = storage_list(NULL, ino);
+  if (items == NULL) {
+    fuse_reply_err(req, ENOENT);
+    return;
+  }
+
+  dirbuf_t *b = calloc(1, sizeof(dirbuf_t));
+  assert(b != NULL);
+  for (dirent_node_t *xs = items; xs != 0;) {
+    struct stat st;
+    if (storage_stat(NULL, xs->entry.inum, &st) == 0) {
+      dirbuf_add(req, b, xs->entry.name, &st);  // (unless just removed)
+    }
+
+    // Memory management for list
+    dirent_node_t *to_del = xs;
+    xs = to_struct((list_next(&xs->dirent_list)), dirent_node_t, dirent_list);
+    list_del(&to_del->dirent_list);
+    free(to_del);
+
+    if (to_del == xs) {
+      break;
+    }
+  }
+
+  fi->fh = (unsigned long)b;
+  if (fuse_reply_open(req, fi) != 0) {
+    free(b->p);
+    free(b);
+  }
+}
+
+//============================================================= ll_readdir =//
+// Hand out up to size bytes of the listing, from offset off
+static void ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+                       struct fuse_file_info *fi) {
+  dirbuf_t *b = (dirbuf_t *)fi->fh;
+  if ((size_t)off < b->size) {
+    size_t left = b->size - off;
+    fuse_reply_buf(req, b->p + off, left < size ? left : size);
+  } else {
+    fuse_reply_buf(req, NULL, 0);
+  }
+}
+
+//============================================================= ll_fsync =//
+// Make a file or directory durable (datasync can't skip anything: sizes
+// and block maps are metadata too)
+static void ll_fsync(fuse_req_t req, fuse_ino_t ino, int datasync,
+                     struct fuse_file_info *fi) {
+  reply_status(req, storage_fsync(NULL, ino));
+}
+
+//============================================================= ll_flush =//
+// Called on each close: with sync_on_close, make the file durable first
+static void ll_flush(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+  reply_status(req, config.sync_on_close ? storage_fsync(NULL, ino) : 0);
+}
+
+//============================================================= ll_releasedir =//
+// Free the listing made by opendir
+static void ll_releasedir(fuse_req_t req, fuse_ino_t ino,
+                          struct fuse_file_info *fi) {
+  dirbuf_t *b = (dirbuf_t *)fi->fh;
+  free(b->p);
+  free(b);
+  fuse_reply_err(req, 0);
+}
+
+//============================================================= struct =//
+static const struct fuse_lowlevel_ops nufs_ll_ops = {
+  .lookup = ll_lookup,
+  .forget = ll_forget,
+  .getattr = ll_getattr,
+  .setattr = ll_setattr,
+
+  .mknod = ll_mknod,
+  .mkdir = ll_mkdir,
+  .link = ll_link,
+
+  .unlink = ll_unlink,
+  .rmdir = ll_rmdir,
+  .rename = ll_rename,
+
+  .open = ll_open,
+  .read = ll_read,
+  .write = ll_write,
+  .flush = ll_flush,
+  .fsync = ll_fsync,
+
+  .opendir = ll_opendir,
+  .readdir = ll_readdir,
+  .releasedir = ll_releasedir,
+  .fsyncdir = ll_fsync,
+};
+
+//============================================================= main =//
+// Usage: ./nufs_ll [FUSE options] [-o writeback_age=N] [-o sync_on_close|async]
+//                  mountpoint image
+int main(int argc, char *argv[]) {
+  assert(argc > 2);
+  assert(ROOT_INODE == FUSE_ROOT_ID);
+
+  // initalize blocks
+  storage_init(argv[--argc]);
+
+  struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+  char *mountpoint;
+  int multithreaded, foreground;
+  int err = -1;
+
+  if (fuse_opt_parse(&args, &config, nufs_opts, NULL) == -1) {
+    return 1;
+  }
+  storage_set_writeback(config.writeback_age);
+
+  if (fuse_parse_cmdline(&args, &mountpoint, &multithreaded, &foreground) == -1) {
+    return 1;
+  }
+
+  struct fuse_chan *ch = fuse_mount(mountpoint, &args);
+  if (ch != NULL) {
+    struct fuse_session *se =
+        fuse_lowlevel_new(&args, &nufs_ll_ops, sizeof(nufs_ll_ops), NULL);
+    if (se != NULL) {
+      if (fuse_set_signal_handlers(se) != -1) {
+        fuse_session_add_chan(se, ch);
+        fuse_daemonize(foreground);
+        err = multithreaded ? fuse_session_loop_mt(se) : fuse_session_loop(se);
+        fuse_remove_signal_handlers(se);
+        fuse_session_remove_chan(ch);
+      }
+      fuse_session_destroy(se);
+    }
+    fuse_unmount(mountpoint, ch);
+  }
+
+  free(mountpoint);
+  fuse_opt_free_args(&args);
+  storage_free();
+  return err ? 1 : 0;
+}